@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * This file is shared between libc and the kernel, so don't put anything
+ * in here that won't work in both contexts.
+ */
+
+#ifdef _KERNEL
+#include <types.h>
+#include <lib.h>
+#else
+#include <stdlib.h>
+#include <string.h>
+#endif
+
+/*
+ * Value of the digit CH (0-9, then a-z or A-Z for 10-35), or 36 if it
+ * isn't one.
+ */
+static
+unsigned
+digitval(int ch)
+{
+	if (ch >= '0' && ch <= '9') {
+		return ch - '0';
+	}
+	if (ch >= 'a' && ch <= 'z') {
+		return ch - 'a' + 10;
+	}
+	if (ch >= 'A' && ch <= 'Z') {
+		return ch - 'A' + 10;
+	}
+	return 36;
+}
+
+/*
+ * Standard C function: parse a string that represents an unsigned
+ * integer in base BASE (2 to 36), or, if BASE is 0, in decimal, octal
+ * with a leading 0, or hex with a leading 0x. Leading whitespace and
+ * a sign are allowed. If ENDP isn't null, a pointer to the first
+ * character not used is stored there. Overflow gives the largest
+ * value, but isn't reported through errno.
+ */
+
+unsigned long
+strtoul(const char *s, char **endp, int base)
+{
+	const unsigned long max = (unsigned long)-1;
+	const char *start = s;	/* for ENDP if there are no digits */
+	unsigned long val=0;	/* value we're accumulating */
+	int neg=0;		/* set to true if we see a minus sign */
+	int any=0;		/* set to true once we see a digit */
+	int overflow=0;		/* set to true if VAL got too big */
+	unsigned digit;
+
+	if (base < 0 || base == 1 || base > 36) {
+		if (endp != NULL) {
+			*endp = (char *)start;
+		}
+		return 0;
+	}
+
+	/* skip whitespace */
+	while (*s==' ' || *s=='\t') {
+		s++;
+	}
+
+	/* check for sign */
+	if (*s=='-') {
+		neg=1;
+		s++;
+	}
+	else if (*s=='+') {
+		s++;
+	}
+
+	/* check for a prefix giving the base */
+	if ((base == 0 || base == 16) && s[0] == '0' &&
+	    (s[1] == 'x' || s[1] == 'X') && digitval(s[2]) < 16) {
+		s += 2;
+		base = 16;
+	}
+	else if (base == 0) {
+		base = (s[0] == '0') ? 8 : 10;
+	}
+
+	/* process each digit, stopping at anything not a digit */
+	while ((digit = digitval(*s)) < (unsigned)base) {
+		any=1;
+
+		/* shift the number over and add in the new digit */
+		if (val > (max - digit) / base) {
+			overflow=1;
+		}
+		else {
+			val = val*base + digit;
+		}
+
+		/* look at the next character */
+		s++;
+	}
+
+	if (endp != NULL) {
+		*endp = (char *)(any ? s : start);
+	}
+
+	if (overflow) {
+		return max;
+	}
+
+	/* handle negative numbers */
+	if (neg) {
+		return -val;
+	}
+
+	/* done */
+	return val;
+}
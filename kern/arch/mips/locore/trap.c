@@ -160,10 +160,13 @@ mips_trap(struct trapframe *tf)
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
 		int old_in;
+		bool old_user;
 		bool doadjust;
 
 		old_in = curthread->t_in_interrupt;
+		old_user = curthread->t_intr_user;
 		curthread->t_in_interrupt = 1;
+		curthread->t_intr_user = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -203,6 +206,15 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+		curthread->t_intr_user = old_user;
+
+		/*
+		 * If we interrupted user code and another thread is
+		 * taking the process down, don't go back.
+		 */
+		if (!iskern && curproc->p_exiting) {
+			proc_exitcheck();
+		}
 		goto done2;
 	}
 
@@ -323,6 +335,11 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/* Likewise if a syscall or fault came from user mode. */
+	if (!iskern) {
+		proc_exitcheck();
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -444,3 +461,27 @@ enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 	mips_usermode(&tf);
 }
+
+/*
+ * enter_new_thread: go to user mode in a new thread of the current
+ * process.
+ *
+ * TF is a copy of the creating thread's trapframe, which supplies
+ * the rest of the register state (in particular the global pointer);
+ * the new thread begins executing at ENTRY with ARG as its argument
+ * and STACK as its stack pointer. There is no return address; the
+ * entry function must call threadexit() rather than return.
+ */
+void
+enter_new_thread(struct trapframe *tf, vaddr_t entry, vaddr_t arg,
+		 vaddr_t stack)
+{
+	tf->tf_epc = entry;
+	tf->tf_a0 = arg;
+	tf->tf_sp = stack;
+	tf->tf_ra = 0;
+	tf->tf_v0 = 0;
+	tf->tf_a3 = 0;
+
+	mips_usermode(tf);
+}
@@ -33,11 +33,13 @@
 #include <endian.h>
 #include <lib.h>
 #include <mips/trapframe.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <copyinout.h>
 #include <syscall.h>
 #include <proc.h>
+#include <trace.h>
 
 
 /*
@@ -84,12 +86,16 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+	uint32_t start;
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	TRACE(TR_SYSCALL, callno, tf->tf_a0, tf->tf_a1);
+	syscallstat_enter(callno);
+	start = cpu_getcycles();
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -114,6 +120,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -139,10 +150,99 @@ syscall(struct trapframe *tf)
 			&retval);
 		break;
 
+	    case SYS_wait4:
+		err = sys_wait4(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			(userptr_t)tf->tf_a3,
+			&retval);
+		break;
+
 	    case SYS_getpid:
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_getrlimit:
+		err = sys_getrlimit(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_setrlimit:
+		err = sys_setrlimit(tf->tf_a0, (const_userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sched_setaffinity:
+		err = sys_sched_setaffinity(tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_sched_getaffinity:
+		err = sys_sched_getaffinity(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex:
+		err = sys_futex((userptr_t)tf->tf_a0,
+				tf->tf_a1,
+				tf->tf_a2,
+				(const_userptr_t)tf->tf_a3,
+				&retval);
+		break;
+
+	    case SYS___threadfork:
+		err = sys___threadfork(tf,
+				       (userptr_t)tf->tf_a0,
+				       (userptr_t)tf->tf_a1,
+				       (userptr_t)tf->tf_a2,
+				       &retval);
+		break;
+
+	    case SYS_threadexit:
+		sys_threadexit(tf->tf_a0);
+		panic("Returning from threadexit\n");
+
+	    case SYS___threadjoin:
+		err = sys___threadjoin(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_setpriority:
+		err = sys_setpriority(tf->tf_a0, tf->tf_a1, tf->tf_a2);
+		break;
+
+	    case SYS_getpriority:
+		err = sys_getpriority(tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
+	    case SYS___sysctl:
+		{
+			/* The last two arguments are on the stack. */
+			userptr_t newp;
+			size_t newlen;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &newp, sizeof(newp));
+			if (err) {
+				break;
+			}
+			err = copyin((userptr_t)tf->tf_sp + 20,
+				     &newlen, sizeof(newlen));
+			if (err) {
+				break;
+			}
+			err = sys___sysctl((const_userptr_t)tf->tf_a0,
+					   tf->tf_a1,
+					   (userptr_t)tf->tf_a2,
+					   (userptr_t)tf->tf_a3,
+					   newp, newlen);
+		}
+		break;
+
+	    case SYS_schedstat:
+		err = sys_schedstat(tf->tf_a0, (userptr_t)tf->tf_a1, &retval);
+		break;
+
 
 	    /* file calls */
 
@@ -161,6 +261,10 @@ syscall(struct trapframe *tf)
 			&retval);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
 	    case SYS_close:
 		err = sys_close(tf->tf_a0);
 		break;
@@ -179,6 +283,69 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
+	    case SYS_pread:
+	    case SYS_pwrite:
+	    case SYS_preadv:
+	    case SYS_pwritev:
+		{
+			/*
+			 * The position is 64 bits wide, and 64-bit
+			 * arguments go in aligned register pairs, so
+			 * as the fourth argument it doesn't fit in a3
+			 * and comes on the stack instead.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+
+			switch (callno) {
+			    case SYS_pread:
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_pwrite:
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_preadv:
+				err = sys_preadv(tf->tf_a0,
+						 (const_userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    default:
+				err = sys_pwritev(tf->tf_a0,
+						  (const_userptr_t)tf->tf_a1,
+						  tf->tf_a2, pos, &retval);
+				break;
+			}
+		}
+		break;
+	    case SYS_ioctl:
+		err = sys_ioctl(tf->tf_a0, tf->tf_a1, (userptr_t)tf->tf_a2);
+		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -260,6 +427,9 @@ syscall(struct trapframe *tf)
 
 	tf->tf_epc += 4;
 
+	syscallstat_exit(callno, err, cpu_getcycles() - start);
+	TRACE(TR_SYSRET, callno, err, retval);
+
 	/* Make sure the syscall code didn't forget to lower spl */
 	KASSERT(curthread->t_curspl == 0);
 	/* ...or leak any spinlocks */
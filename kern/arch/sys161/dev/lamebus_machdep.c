@@ -40,6 +40,8 @@
 #include <membar.h>
 #include <synch.h>
 #include <mainbus.h>
+#include <prof.h>
+#include <platform/maxcpus.h>
 #include <sys161/bus.h>
 #include <lamebus/lamebus.h>
 #include "autoconf.h"
@@ -52,17 +54,52 @@
  */
 #define CPU_FREQUENCY 25000000 /* 25 MHz */
 
+/* Cycles per hardclock tick. */
+#define TICK_CYCLES (CPU_FREQUENCY / HZ)
+
 /*
  * Access to the on-chip timer.
  *
  * The c0_count register increments on every cycle; when the value
  * matches the c0_compare register, the timer interrupt line is
- * asserted. Writing to c0_compare again clears the interrupt.
+ * asserted. Writing to c0_compare again clears the interrupt and
+ * starts c0_count over from zero.
+ *
+ * Because c0_count keeps being reset, cpu_getcycles adds on the
+ * cycles counted before the last reset, which we keep per cpu in
+ * mips_timer_base[].
  */
+static volatile uint32_t mips_timer_base[MAXCPUS];
+
+/* Timer interrupts since the last hardclock, while profiling. */
+static unsigned mips_timer_subticks[MAXCPUS];
+
+/*
+ * How far past the last hardclock's tick boundary we were when
+ * c0_count last started over, in cycles. Tickless idle resets the
+ * count at arbitrary points; this keeps the partial tick from being
+ * dropped each time, so ticks still come out right on a cpu that is
+ * woken more often than once a tick.
+ */
+static uint32_t mips_timer_phase[MAXCPUS];
+
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile("mfc0 %0, $9" : "=r" (count));
+	return count;
+}
+
 static
 void
 mips_timer_set(uint32_t count)
 {
+	mips_timer_base[curcpu->c_number] += mips_timer_count();
+
 	/*
 	 * $11 == c0_compare; we can't use the symbolic name inside
 	 * the asm string.
@@ -75,6 +112,77 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read the cycle counter. If the timer interrupt resets c0_count
+ * while we're at it, the base will have changed; try again.
+ */
+uint32_t
+cpu_getcycles(void)
+{
+	volatile uint32_t *basep;
+	uint32_t base, count;
+
+	basep = &mips_timer_base[curcpu->c_number];
+	do {
+		base = *basep;
+		count = mips_timer_count();
+	} while (base != *basep);
+	return base + count;
+}
+
+/*
+ * Cycles since the last hardclock's tick boundary.
+ */
+static
+uint32_t
+mips_timer_since(void)
+{
+	return mips_timer_phase[curcpu->c_number] + mips_timer_count();
+}
+
+/*
+ * Tickless idle support; see mainbus.h. The timer interrupt handler
+ * below puts the timer back to one tick whenever it goes off.
+ *
+ * Both ends keep to the tick boundaries: the deferred interrupt comes
+ * on one, and resuming arms the timer for the next one (or the next
+ * sampling point, while profiling) with the partial tick carried
+ * over in mips_timer_phase.
+ */
+void
+mainbus_timer_defer(unsigned ticks)
+{
+	uint32_t since;
+
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(ticks > 0 && ticks <= MAINBUS_TIMER_MAXTICKS);
+	COMPILE_ASSERT(MAINBUS_TIMER_MAXTICKS <= 0xffffffffU / TICK_CYCLES);
+
+	since = mips_timer_since();
+	if (since >= TICK_CYCLES) {
+		/* the tick is already due; don't go past the next one */
+		since = TICK_CYCLES - 1;
+	}
+	mips_timer_set(ticks * TICK_CYCLES - since);
+	mips_timer_phase[curcpu->c_number] = since;
+}
+
+unsigned
+mainbus_timer_resume(void)
+{
+	unsigned num = curcpu->c_number;
+	uint32_t since, step;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	since = mips_timer_since();
+	step = prof_enabled ? TICK_CYCLES / PROF_TICKDIV : TICK_CYCLES;
+	mips_timer_set(step - (since % TICK_CYCLES) % step);
+	mips_timer_subticks[num] = (since % TICK_CYCLES) / step;
+	mips_timer_phase[num] = since % TICK_CYCLES;
+	return since / TICK_CYCLES;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -115,7 +223,7 @@ mainbus_bootstrap(void)
 	/*
 	 * Configure the MIPS on-chip timer to interrupt HZ times a second.
 	 */
-	mips_timer_set(CPU_FREQUENCY / HZ);
+	mips_timer_set(TICK_CYCLES);
 }
 
 /*
@@ -288,7 +396,8 @@ void
 mainbus_interrupt(struct trapframe *tf)
 {
 	uint32_t cause;
-	bool seen = false;
+	unsigned *subticks;
+	bool tick, seen = false;
 
 	/* interrupts should be off */
 	KASSERT(curthread->t_curspl > 0);
@@ -304,10 +413,38 @@ mainbus_interrupt(struct trapframe *tf)
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
-		/* and call hardclock */
-		hardclock();
+		if (prof_enabled) {
+			prof_sample(tf->tf_epc, tf->tf_ra,
+				    (tf->tf_status & CST_KUp) != 0);
+		}
+		/*
+		 * Reset the timer (this clears the interrupt) and call
+		 * hardclock. While profiling, the timer goes off
+		 * PROF_TICKDIV times per tick and only every
+		 * PROF_TICKDIV'th time is a hardclock; coming out of
+		 * tickless idle always is one.
+		 */
+		tick = true;
+		if (prof_enabled && curcpu->c_tickless == 0) {
+			mips_timer_set(TICK_CYCLES / PROF_TICKDIV);
+			subticks = &mips_timer_subticks[curcpu->c_number];
+			if (++*subticks < PROF_TICKDIV) {
+				tick = false;
+			}
+			else {
+				*subticks = 0;
+			}
+			mips_timer_phase[curcpu->c_number] =
+				*subticks * (TICK_CYCLES / PROF_TICKDIV);
+		}
+		else {
+			mips_timer_set(TICK_CYCLES);
+			mips_timer_subticks[curcpu->c_number] = 0;
+			mips_timer_phase[curcpu->c_number] = 0;
+		}
+		if (tick) {
+			hardclock();
+		}
 		seen = true;
 	}
 
@@ -630,7 +630,7 @@ emufs_write(struct vnode *v, struct uio *uio)
  */
 static
 int
-emufs_ioctl(struct vnode *v, int op, userptr_t data)
+emufs_ioctl(struct vnode *v, int op, userptr_t data, int accmode)
 {
 	/*
 	 * No ioctls.
@@ -639,6 +639,7 @@ emufs_ioctl(struct vnode *v, int op, userptr_t data)
 	(void)v;
 	(void)op;
 	(void)data;
+	(void)accmode;
 
 	return EINVAL;
 }
@@ -39,6 +39,7 @@
 #include <synch.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <trace.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -207,6 +208,8 @@ lhd_io(struct device *d, struct uio *uio)
 		return EINVAL;
 	}
 
+	TRACE(TR_DISKIO, sector, len, uio->uio_rw == UIO_WRITE);
+
 	/* Set up the value to write into the status register. */
 	if (uio->uio_rw==UIO_WRITE) {
 		statval |= LHD_ISWRITE;
@@ -31,6 +31,7 @@
 #define SEMFS_H
 
 #include <array.h>
+#include <spinlock.h>
 #include <fs.h>
 #include <vnode.h>
 
@@ -48,12 +49,14 @@
  * A user-facing semaphore.
  *
  * We don't use the kernel-level semaphore to implement it (although
- * that would be tidy) because we'd have to violate its abstraction.
- * XXX: or would we? review once all this is done.
+ * that would be tidy) because we'd have to violate its abstraction:
+ * P and V here move arbitrary amounts at once. The count is guarded
+ * by a spinlock so the ioctl fast path is a single lock acquire.
  */
 struct semfs_sem {
-	struct lock *sems_lock;			/* Lock to protect count */
-	struct cv *sems_cv;			/* CV to wait */
+	struct spinlock sems_lock;		/* Lock to protect count */
+	char *sems_name;			/* Name at creation */
+	struct wchan *sems_wchan;		/* Wait channel for P */
 	unsigned sems_count;			/* Semaphore count */
 	bool sems_hasvnode;			/* The vnode exists */
 	bool sems_linked;			/* In the directory */
@@ -80,6 +83,7 @@ struct semfs_vnode {
 	struct vnode semv_absvn;		/* Abstract vnode */
 	struct semfs *semv_semfs;		/* Back-pointer to fs */
 	unsigned semv_semnum;			/* Which semaphore */
+	struct semfs_sem *semv_sem;		/* The semaphore (NULL for dir) */
 };
 
 /*
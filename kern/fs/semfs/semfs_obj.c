@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <synch.h>
+#include <wchan.h>
 
 #define SEMFS_INLINE
 #include "semfs.h"
@@ -44,31 +45,28 @@ struct semfs_sem *
 semfs_sem_create(const char *name)
 {
 	struct semfs_sem *sem;
-	char lockname[32];
-	char cvname[32];
-
-	snprintf(lockname, sizeof(lockname), "sem:l.%s", name);
-	snprintf(cvname, sizeof(cvname), "sem:%s", name);
 
 	sem = kmalloc(sizeof(*sem));
 	if (sem == NULL) {
 		goto fail_return;
 	}
-	sem->sems_lock = lock_create(lockname);
-	if (sem->sems_lock == NULL) {
+	/* wchan_create doesn't copy the name, so give it our own copy */
+	sem->sems_name = kstrdup(name);
+	if (sem->sems_name == NULL) {
 		goto fail_sem;
 	}
-	sem->sems_cv = cv_create(cvname);
-	if (sem->sems_cv == NULL) {
-		goto fail_lock;
+	sem->sems_wchan = wchan_create(sem->sems_name);
+	if (sem->sems_wchan == NULL) {
+		goto fail_name;
 	}
+	spinlock_init(&sem->sems_lock);
 	sem->sems_count = 0;
 	sem->sems_hasvnode = false;
 	sem->sems_linked = false;
 	return sem;
 
- fail_lock:
-	lock_destroy(sem->sems_lock);
+ fail_name:
+	kfree(sem->sems_name);
  fail_sem:
 	kfree(sem);
  fail_return:
@@ -81,8 +79,9 @@ semfs_sem_create(const char *name)
 void
 semfs_sem_destroy(struct semfs_sem *sem)
 {
-	cv_destroy(sem->sems_cv);
-	lock_destroy(sem->sems_lock);
+	wchan_destroy(sem->sems_wchan);
+	kfree(sem->sems_name);
+	spinlock_cleanup(&sem->sems_lock);
 	kfree(sem);
 }
 
@@ -30,9 +30,11 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/ioctl.h>
 #include <stat.h>
 #include <uio.h>
 #include <synch.h>
+#include <wchan.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -64,11 +66,12 @@ semfs_eachopen(struct vnode *vn, int openflags)
 
 static
 int
-semfs_ioctl(struct vnode *vn, int op, userptr_t data)
+semfs_dirioctl(struct vnode *vn, int op, userptr_t data, int accmode)
 {
 	(void)vn;
 	(void)op;
 	(void)data;
+	(void)accmode;
 	return EINVAL;
 }
 
@@ -107,29 +110,15 @@ semfs_fsync(struct vnode *vn)
 // semaphore ops
 
 /*
- * XXX fold these two together
+ * Get the semaphore for a vnode. The vnode holds the pointer; the
+ * semaphore can't go away while the vnode exists (see semfs_reclaim).
  */
-
-static
-struct semfs_sem *
-semfs_getsembynum(struct semfs *semfs, unsigned semnum)
-{
-	struct semfs_sem *sem;
-
-	lock_acquire(semfs->semfs_tablelock);
-	sem = semfs_semarray_get(semfs->semfs_sems, semnum);
-	lock_release(semfs->semfs_tablelock);
-
-	return sem;
-}
-
 static
 struct semfs_sem *
 semfs_getsem(struct semfs_vnode *semv)
 {
-	struct semfs *semfs = semv->semv_semfs;
-
-	return semfs_getsembynum(semfs, semv->semv_semnum);
+	KASSERT(semv->semv_sem != NULL);
+	return semv->semv_sem;
 }
 
 /*
@@ -146,11 +135,124 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 		return;
 	}
 	if (newcount == 1) {
-		cv_signal(sem->sems_cv, sem->sems_lock);
+		wchan_wakeone(sem->sems_wchan, &sem->sems_lock);
 	}
 	else {
-		cv_broadcast(sem->sems_cv, sem->sems_lock);
+		wchan_wakeall(sem->sems_wchan, &sem->sems_lock);
+	}
+}
+
+/*
+ * P(): take AMOUNT units, waiting as needed. Units are taken as they
+ * become available, as with a read of that many bytes.
+ *
+ * The wait can be interrupted by proc_exit, as in P_intr; then we
+ * give back whatever we took, so a P that didn't finish takes
+ * nothing, and fail with EINTR.
+ */
+static
+int
+semfs_sem_p(struct semfs_sem *sem, unsigned semnum, unsigned amount)
+{
+	unsigned consume, taken, newcount;
+	int result;
+
+	result = proc_intr_begin(sem->sems_wchan, &sem->sems_lock);
+	if (result) {
+		return result;
+	}
+
+	taken = 0;
+	spinlock_acquire(&sem->sems_lock);
+	while (amount > 0) {
+		if (sem->sems_count > 0) {
+			consume = amount;
+			if (consume > sem->sems_count) {
+				consume = sem->sems_count;
+			}
+			DEBUG(DB_SEMFS, "semfs: sem%u: P, count %u -> %u\n",
+			      semnum, sem->sems_count,
+			      sem->sems_count - consume);
+			sem->sems_count -= consume;
+			amount -= consume;
+			taken += consume;
+		}
+		if (amount == 0) {
+			break;
+		}
+		if (curproc->p_exiting) {
+			DEBUG(DB_SEMFS, "semfs: sem%u: P interrupted\n",
+			      semnum);
+			newcount = sem->sems_count + taken;
+			if (newcount >= sem->sems_count) {
+				semfs_wakeup(sem, newcount);
+				sem->sems_count = newcount;
+			}
+			result = EINTR;
+			break;
+		}
+		if (sem->sems_count == 0) {
+			DEBUG(DB_SEMFS, "semfs: sem%u: blocking\n", semnum);
+			wchan_sleep(sem->sems_wchan, &sem->sems_lock);
+		}
+	}
+	spinlock_release(&sem->sems_lock);
+	proc_intr_end();
+	return result;
+}
+
+/*
+ * V(): add AMOUNT units and wake up waiters.
+ */
+static
+int
+semfs_sem_v(struct semfs_sem *sem, unsigned semnum, unsigned amount)
+{
+	unsigned newcount;
+
+	spinlock_acquire(&sem->sems_lock);
+	newcount = sem->sems_count + amount;
+	if (newcount < sem->sems_count) {
+		/* overflow */
+		spinlock_release(&sem->sems_lock);
+		return EFBIG;
 	}
+	DEBUG(DB_SEMFS, "semfs: sem%u: V, count %u -> %u\n",
+	      semnum, sem->sems_count, newcount);
+	semfs_wakeup(sem, newcount);
+	sem->sems_count = newcount;
+	spinlock_release(&sem->sems_lock);
+	return 0;
+}
+
+/*
+ * ioctl for semaphore vnodes: P and V without going through uio and
+ * the file offset machinery. DATA is the count, passed by value;
+ * see <kern/ioctl.h>. P is a read and V is a write, so they need the
+ * same access as read() and write() would.
+ */
+static
+int
+semfs_semioctl(struct vnode *vn, int op, userptr_t data, int accmode)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	unsigned amount = (unsigned)(uintptr_t)data;
+
+	switch (op) {
+	    case SEMIOC_P:
+		if (accmode == O_WRONLY) {
+			return EBADF;
+		}
+		return semfs_sem_p(semfs_getsem(semv), semv->semv_semnum,
+				   amount);
+	    case SEMIOC_V:
+		if (accmode == O_RDONLY) {
+			return EBADF;
+		}
+		return semfs_sem_v(semfs_getsem(semv), semv->semv_semnum,
+				   amount);
+	}
+	return EINVAL;
 }
 
 /*
@@ -167,10 +269,10 @@ semfs_semstat(struct vnode *vn, struct stat *buf)
 
 	bzero(buf, sizeof(*buf));
 
-	lock_acquire(sem->sems_lock);
+	spinlock_acquire(&sem->sems_lock);
 	buf->st_size = sem->sems_count;
 	buf->st_nlink = sem->sems_linked ? 1 : 0;
-	lock_release(sem->sems_lock);
+	spinlock_release(&sem->sems_lock);
 
 	buf->st_mode = S_IFREG | 0666;
 	buf->st_blocks = 0;
@@ -189,35 +291,15 @@ int
 semfs_read(struct vnode *vn, struct uio *uio)
 {
 	struct semfs_vnode *semv = vn->vn_data;
-	struct semfs_sem *sem;
-	size_t consume;
-
-	sem = semfs_getsem(semv);
+	int result;
 
-	lock_acquire(sem->sems_lock);
-	while (uio->uio_resid > 0) {
-		if (sem->sems_count > 0) {
-			consume = uio->uio_resid;
-			if (consume > sem->sems_count) {
-				consume = sem->sems_count;
-			}
-			DEBUG(DB_SEMFS, "semfs: sem%u: P, count %u -> %u\n",
-			      semv->semv_semnum, sem->sems_count,
-			      sem->sems_count - consume);
-			sem->sems_count -= consume;
-			/* don't bother advancing the uio data pointers */
-			uio->uio_resid -= consume;
-		}
-		if (uio->uio_resid == 0) {
-			break;
-		}
-		if (sem->sems_count == 0) {
-			DEBUG(DB_SEMFS, "semfs: sem%u: blocking\n",
-			      semv->semv_semnum);
-			cv_wait(sem->sems_cv, sem->sems_lock);
-		}
+	/* don't bother advancing the uio data pointers */
+	result = semfs_sem_p(semfs_getsem(semv), semv->semv_semnum,
+			     uio->uio_resid);
+	if (result) {
+		return result;
 	}
-	lock_release(sem->sems_lock);
+	uio->uio_resid = 0;
 	return 0;
 }
 
@@ -230,26 +312,17 @@ int
 semfs_write(struct vnode *vn, struct uio *uio)
 {
 	struct semfs_vnode *semv = vn->vn_data;
-	struct semfs_sem *sem;
-	unsigned newcount;
-
-	sem = semfs_getsem(semv);
+	int result;
 
-	lock_acquire(sem->sems_lock);
-	while (uio->uio_resid > 0) {
-		newcount = sem->sems_count + uio->uio_resid;
-		if (newcount < sem->sems_count) {
-			/* overflow */
-			lock_release(sem->sems_lock);
-			return EFBIG;
-		}
-		DEBUG(DB_SEMFS, "semfs: sem%u: V, count %u -> %u\n",
-		      semv->semv_semnum, sem->sems_count, newcount);
-		semfs_wakeup(sem, newcount);
-		sem->sems_count = newcount;
-		uio->uio_resid = 0;
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+	result = semfs_sem_v(semfs_getsem(semv), semv->semv_semnum,
+			     uio->uio_resid);
+	if (result) {
+		return result;
 	}
-	lock_release(sem->sems_lock);
+	uio->uio_resid = 0;
 	return 0;
 }
 
@@ -281,10 +354,10 @@ semfs_truncate(struct vnode *vn, off_t len)
 
 	sem = semfs_getsem(semv);
 
-	lock_acquire(sem->sems_lock);
+	spinlock_acquire(&sem->sems_lock);
 	semfs_wakeup(sem, newcount);
 	sem->sems_count = newcount;
-	lock_release(sem->sems_lock);
+	spinlock_release(&sem->sems_lock);
 
 	return 0;
 }
@@ -489,21 +562,19 @@ semfs_remove(struct vnode *dirvn, const char *name)
 		}
 		if (!strcmp(name, dent->semd_name)) {
 			/* found */
-			sem = semfs_getsembynum(semfs, dent->semd_semnum);
-			lock_acquire(sem->sems_lock);
+			lock_acquire(semfs->semfs_tablelock);
+			sem = semfs_semarray_get(semfs->semfs_sems,
+						 dent->semd_semnum);
+			spinlock_acquire(&sem->sems_lock);
 			KASSERT(sem->sems_linked);
 			sem->sems_linked = false;
+			spinlock_release(&sem->sems_lock);
 			if (sem->sems_hasvnode == false) {
-				lock_acquire(semfs->semfs_tablelock);
 				semfs_semarray_set(semfs->semfs_sems,
 						   dent->semd_semnum, NULL);
-				lock_release(semfs->semfs_tablelock);
-				lock_release(sem->sems_lock);
 				semfs_sem_destroy(sem);
 			}
-			else {
-				lock_release(sem->sems_lock);
-			}
+			lock_release(semfs->semfs_tablelock);
 			semfs_direntryarray_set(semfs->semfs_dents, i, NULL);
 			semfs_direntry_destroy(dent);
 			result = 0;
@@ -656,7 +727,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_readlink = vopfail_uio_isdir,
 	.vop_getdirentry = semfs_getdirentry,
 	.vop_write = vopfail_uio_isdir,
-	.vop_ioctl = semfs_ioctl,
+	.vop_ioctl = semfs_dirioctl,
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
@@ -689,7 +760,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = semfs_write,
-	.vop_ioctl = semfs_ioctl,
+	.vop_ioctl = semfs_semioctl,
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
@@ -734,6 +805,7 @@ semfs_vnode_create(struct semfs *semfs, unsigned semnum)
 
 	semv->semv_semfs = semfs;
 	semv->semv_semnum = semnum;
+	semv->semv_sem = NULL;
 
 	result = vnode_init(&semv->semv_absvn, optable,
 			    &semfs->semfs_absfs, semv);
@@ -789,6 +861,7 @@ semfs_getvnode(struct semfs *semfs, unsigned semnum, struct vnode **ret)
 		KASSERT(sem != NULL);
 		KASSERT(sem->sems_hasvnode == false);
 		sem->sems_hasvnode = true;
+		semv->semv_sem = sem;
 	}
 	lock_release(semfs->semfs_tablelock);
 
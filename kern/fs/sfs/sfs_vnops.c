@@ -133,7 +133,7 @@ sfs_write(struct vnode *v, struct uio *uio)
  */
 static
 int
-sfs_ioctl(struct vnode *v, int op, userptr_t data)
+sfs_ioctl(struct vnode *v, int op, userptr_t data, int accmode)
 {
 	/*
 	 * No ioctls.
@@ -142,6 +142,7 @@ sfs_ioctl(struct vnode *v, int op, userptr_t data)
 	(void)v;
 	(void)op;
 	(void)data;
+	(void)accmode;
 
 	return EINVAL;
 }
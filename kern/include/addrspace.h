@@ -115,9 +115,12 @@ int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
  *    load_elf - load an ELF user program executable into the current
  *               address space. Returns the entry point (initial PC)
  *               in the space pointed to by ENTRYPOINT.
+ *    execcache_printstats - print hit/miss counts of the cache of
+ *               executable headers load_elf keeps.
  */
 
 int load_elf(struct vnode *v, vaddr_t *entrypoint);
+void execcache_printstats(void);
 
 //A6 added here
 struct pt_entry *pt_create(size_t size);   //initialize pagetable
@@ -36,6 +36,8 @@
 
 #include <kern/time.h>
 
+struct cpu;	/* from <cpu.h> */
+
 
 /*
  * hardclock() is called on every CPU HZ times a second, possibly only
@@ -49,8 +51,18 @@ void hardclock_bootstrap(void);
 void hardclock(void);
 
 /*
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * Tickless idle: hardclock_idle turns off the clock tick on a cpu
+ * that is about to idle, until the next timeout is due;
+ * hardclock_unidle turns it back on. Both are called by the thread
+ * code. hardclock_printstats shows how many ticks were skipped.
+ */
+void hardclock_idle(void);
+void hardclock_unidle(void);
+void hardclock_printstats(void);
+
+/*
+ * timerclock() is called on one CPU once a second. Timed operations
+ * now use timeouts (below) instead.
  */
 void timerclock(void);
 
@@ -73,11 +85,58 @@ void timespec_sub(const struct timespec *t1,
 		  const struct timespec *t2,
 		  struct timespec *ret);
 
+/*
+ * Timeouts: have a function called from hardclock() after a given
+ * number of ticks (hardclocks).
+ *
+ * Each CPU keeps the timeouts added on it in a hashed timer wheel of
+ * TIMEOUT_WHEELSIZE buckets indexed by expiry tick, so adding and
+ * cancelling are constant time and each tick only looks at one
+ * bucket. The function is called on the CPU the timeout was added
+ * on, in interrupt context (so it may not sleep), with no spinlocks
+ * held.
+ *
+ * timeout_init   - set up a timeout to call FUNC(ARG).
+ * timeout_add    - arm it to go off TICKS (at least 1) ticks from
+ *                  now. Must not already be pending.
+ * timeout_cancel - disarm it. Returns true if it was still pending.
+ *                  If the function is running on another CPU, waits
+ *                  for it to finish, so once this returns the
+ *                  timeout is no longer in use and may be freed.
+ *                  Must not be called from the timeout's own function.
+ *
+ * timeout_ticks converts a time interval to the number of ticks that
+ * are certain to cover it, rounding up and allowing for being part
+ * way through the current tick. The result is clipped to
+ * TIMEOUT_MAXTICKS.
+ */
+
+#define TIMEOUT_WHEELSIZE	64		/* must be a power of 2 */
+#define TIMEOUT_MAXTICKS	0x7fffffff
+
+struct timeout {
+	struct timeout *to_next;	/* Link in wheel bucket */
+	struct timeout **to_pprev;	/* Pointer to whatever points to us */
+	struct cpu *to_cpu;		/* CPU whose wheel we were added to */
+	unsigned to_expire;		/* Value of c_hardclocks to fire at */
+	bool to_pending;		/* True if armed */
+	void (*to_func)(void *);	/* Function to call */
+	void *to_arg;			/* Argument for it */
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *arg);
+void timeout_add(struct timeout *to, unsigned ticks);
+bool timeout_cancel(struct timeout *to);
+unsigned timeout_ticks(const struct timespec *ts);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ *
+ * clocksleep_ticks() is the same but takes a number of ticks.
  */
 void clocksleep(int seconds);
+void clocksleep_ticks(unsigned ticks);
 
 
 #endif /* _CLOCK_H_ */
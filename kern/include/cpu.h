@@ -33,6 +33,8 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <clock.h>	/* for TIMEOUT_WHEELSIZE */
+#include <kern/schedstat.h> /* for struct schedstat */
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
@@ -59,8 +61,17 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
-	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	struct thread *c_idlethread;	/* Runs when there's nothing else */
+	struct thread *c_migrant;	/* Thread leaving for another cpu */
+	struct threadlist c_threadcache; /* Exited threads kept for reuse */
+	unsigned c_threadcache_hits;	/* thread_fork calls using cache */
+	unsigned c_threadcache_misses;	/* thread_fork calls that kmalloc */
+	unsigned c_hardclocks;		/* Counter of hardclock ticks */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	unsigned c_tickless;		/* Ticks the timer is deferred for */
+	unsigned c_ticks_skipped;	/* Ticks with no hardclock() call */
+	unsigned c_tickless_idles;	/* Times the timer was deferred */
+	struct schedstat c_schedstat;	/* Run queue/time slice histograms */
 
 	/*
 	 * Accessed by other cpus.
@@ -70,6 +81,15 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Timer wheel. Accessed by other cpus (to cancel timeouts).
+	 * Protected by the timeout lock.
+	 */
+	struct timeout *c_timeouts[TIMEOUT_WHEELSIZE];
+	unsigned c_ntimeouts;		/* Number pending in the wheel */
+	struct timeout *c_timeout_running; /* Timeout whose function is running */
+	struct spinlock c_timeout_lock;
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -110,11 +130,25 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Number of CPUs, and CPU number N. Valid once all CPUs are created.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned n);
+
 /*
  * Produce a string describing the CPU type.
  */
 void cpu_identify(char *buf, size_t max);
 
+/*
+ * Read the current CPU's cycle counter. The counter is 32 bits wide
+ * and wraps, so only the (unsigned) difference between two nearby
+ * readings is meaningful. Call with interrupts off, so the thread
+ * can't move to another CPU part way through.
+ */
+uint32_t cpu_getcycles(void);
+
 /*
  * Hardware-level interrupt on/off, for the current CPU.
  *
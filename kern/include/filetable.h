@@ -35,28 +35,49 @@
 #define _FILETABLE_H_
 
 #include <limits.h> /* for OPEN_MAX */
+#include <spinlock.h>
 
 
 /*
  * The file table is an array of open files.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * It starts small and grows (doubling) as files are opened, up to
+ * the process's limit, which is OPEN_MAX by default and can be set
+ * with setrlimit(RLIMIT_NOFILE) up to NOFILE_MAX. To find the lowest
+ * free descriptor quickly there's a two-level bitmap: fs_inuse has a
+ * bit per slot, set if it's in use, and fs_full a bit per word of
+ * fs_inuse, set if all 32 slots there are in use. A search looks at
+ * one word of fs_full per 1024 slots and then one word of fs_inuse.
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * On fork, the table is copied lazily: the two processes share one
+ * array of slots (struct fileslots, reference counted) until either
+ * of them changes it by opening, closing or dup2'ing, and only then
+ * gets a private copy. So forking doesn't cost anything per open
+ * file, and a child that just execs or exits never copies at all.
+ * Shared slots are never modified; private ones are protected by
+ * ft_lock, because the threads of a multithreaded process share one
+ * filetable.
+ *
+ * A file fetched with filetable_get carries its own reference until
+ * the matching filetable_put, so if one thread calls close() while
+ * another is in the middle of e.g. read() on the same handle, the
+ * read finishes on the file it started with and the last reference
+ * goes away when it's done.
  */
+struct fileslots {
+	struct spinlock fs_reflock;		/* Protects fs_refcount */
+	unsigned fs_refcount;			/* Filetables using these */
+	unsigned fs_max;			/* Number of slots */
+	struct openfile **fs_openfiles;		/* The slots */
+	uint32_t *fs_inuse;			/* Bit per slot */
+	uint32_t *fs_full;			/* Bit per fs_inuse word */
+};
+
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct spinlock ft_lock;
+	struct fileslots *ft_slots;
+	unsigned ft_limit;			/* Soft RLIMIT_NOFILE */
+	unsigned ft_hardlimit;			/* Hard RLIMIT_NOFILE */
 };
 
 /*
@@ -64,14 +85,20 @@ struct filetable {
  *
  * create -  Construct an empty file table.
  * destroy - Wipe out a file table, closing anything open in it.
- * copy -    Clone a file table.
- * okfd -    Check if a file handle is in range.
+ * copy -    Clone a file table (sharing its slots until modified).
+ * okfd -    Check if a file handle is in range (below the soft limit).
  * get/put - Retrieve a fd for use and put it back when done. (Checks
  *           okfd and also fails on files not open; returned openfile
- *           is not NULL.) Call put with the file returned from get.
+ *           is not NULL and holds a reference that put drops.) Call
+ *           put with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
- *           previously there.
+ *           previously there. Can fail only if the table has to be
+ *           unshared or grown and there's no memory to do it.
+ * unplace - Undo place: take a file back out of its slot and drop the
+ *           table's reference, unless another thread has already
+ *           closed or replaced it.
+ * getlimit/setlimit - Get and set the RLIMIT_NOFILE limits.
  */
 
 struct filetable *filetable_create(void);
@@ -83,8 +110,12 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
+void filetable_unplace(struct filetable *ft, int fd, struct openfile *file);
+
+void filetable_getlimit(struct filetable *ft, unsigned *cur, unsigned *max);
+int filetable_setlimit(struct filetable *ft, unsigned cur, unsigned max);
 
 
 #endif /* _FILETABLE_H_ */
@@ -34,6 +34,13 @@
  * ioctl operation codes
  */
 
-/* (none yet) */
+/*
+ * Semaphores in semfs ("sem:"). These do P and V directly, skipping
+ * the read/write path. Unlike most ioctls the argument is not a
+ * pointer: it's the count itself, cast to void *. As with read and
+ * write, P needs the file open for reading and V for writing.
+ */
+#define SEMIOC_P	1	/* Take COUNT units, waiting as needed */
+#define SEMIOC_V	2	/* Add COUNT units */
 
 #endif /* _KERN_IOCTL_H_*/
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SYSCTL_H_
+#define _KERN_SYSCTL_H_
+
+/*
+ * Names for __sysctl().
+ *
+ * A name is an array of integers naming a path down a tree, as in
+ * BSD. __sysctl(name, namelen, oldp, oldlenp, newp, newlen) copies
+ * the current value out to OLDP, if it isn't NULL, and sets *OLDLENP
+ * to its size; if *OLDLENP is too small, nothing is copied and the
+ * call fails with ENOMEM. If NEWP isn't NULL the value is then set
+ * from it, for the names that can be set.
+ */
+
+/* Top level */
+#define CTL_KERN		1	/* kernel */
+
+/* Second level under CTL_KERN */
+#define KERN_NCPUS		1	/* int: number of cpus */
+#define KERN_SYSCALLSTATS	2	/* struct syscallstat[] (below) */
+
+/*
+ * KERN_SYSCALLSTATS is an array of SYSCALLSTAT_NCALLS syscallstats,
+ * indexed by system call number, added up over all cpus; a third
+ * level picks a single cpu. Setting it (to anything) zeroes the
+ * counts.
+ *
+ * ss_calls counts calls as they start, so it includes calls like
+ * execv and _exit that don't return; the other fields count only
+ * calls that returned. Times are in cycles of the CPU cycle counter,
+ * and ss_hist is a log2 histogram of them: bucket N holds times from
+ * 2^N to 2^(N+1)-1, and bucket 0 also holds 0.
+ */
+#define SYSCALLSTAT_NCALLS	128
+#define SYSCALLSTAT_BUCKETS	32
+
+struct syscallstat {
+	unsigned ss_calls;		/* calls made */
+	unsigned ss_errors;		/* calls that failed */
+	unsigned long long ss_cycles;	/* total time in returned calls */
+	unsigned ss_hist[SYSCALLSTAT_BUCKETS];
+};
+
+
+#endif /* _KERN_SYSCTL_H_ */
@@ -153,6 +153,7 @@ void *memmove(void *dest, const void *src, size_t len);
 void *memset(void *block, int ch, size_t len);
 void bzero(void *ptr, size_t len);
 int atoi(const char *str);
+unsigned long strtoul(const char *str, char **endp, int base);
 
 int snprintf(char *buf, size_t maxlen, const char *fmt, ...) __PF(3,4);
 
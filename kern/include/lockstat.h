@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock statistics ("lockstat").
+ *
+ * When lockstat_enabled is set, spinlock_acquire/release and
+ * lock_acquire/release report each acquisition here. Spinlocks have
+ * no names, so they are recorded per call site, the return address of
+ * spinlock_acquire; e.g. all the spinlocks taken at one place in the
+ * vnode code share a line. Sleep locks are recorded per lk_name.
+ *
+ * For each record we keep the number of acquisitions, how many of
+ * them found the lock already held, the total cycles spent spinning
+ * or sleeping for it, and the longest time it was held.
+ *
+ * Times are in cycles of the CPU cycle counter (cpu_getcycles). A
+ * sleep lock waiter may wake up on a different CPU than it went to
+ * sleep on; this assumes the counters on the different CPUs run in
+ * step, which they do on System/161.
+ *
+ * The counters are kept per cpu and only added up by lockstat_dump,
+ * so that counting doesn't make the cpus wait on each other.
+ * lockstat_start allocates them, and fails with ENOMEM if it can't.
+ *
+ * Records are never freed, only zeroed by lockstat_reset, so the
+ * pointer returned by a lookup stays good forever. If the table fills
+ * up, further acquisitions of unrecorded locks are only counted in
+ * the overflow total.
+ */
+
+struct spinlock;
+struct lock;
+struct lockstat;
+
+/* Set by lockstat_start, cleared by lockstat_stop. */
+extern volatile bool lockstat_enabled;
+
+int lockstat_start(void);
+void lockstat_stop(void);
+void lockstat_reset(void);
+void lockstat_dump(void);
+
+/*
+ * Hooks for the lock code. The "acquired" functions are called, only
+ * if lockstat_enabled is set, with the lock just acquired; they look
+ * up the record, count the acquisition, and stamp the lock with the
+ * time. The "released" functions are called, if the lock was stamped,
+ * just before it is given up, and account the hold time.
+ */
+void lockstat_spinlock_acquired(struct spinlock *lk, const void *caller,
+				bool contended, uint32_t cycles);
+void lockstat_spinlock_released(struct spinlock *lk);
+void lockstat_lock_acquired(struct lock *lk, bool contended, uint32_t cycles);
+void lockstat_lock_released(struct lock *lk);
+
+
+#endif /* _LOCKSTAT_H_ */
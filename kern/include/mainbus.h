@@ -55,6 +55,22 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Control of the current CPU's clock tick, for tickless idle. Call
+ * with interrupts off.
+ *
+ * mainbus_timer_defer makes the next timer interrupt come TICKS
+ * ticks from now, rather than one.
+ *
+ * mainbus_timer_resume goes back to one tick at a time and returns
+ * how many whole ticks went by since the last hardclock. The partial
+ * tick is carried over: the next tick comes when it would have if
+ * the timer had never been deferred.
+ */
+#define MAINBUS_TIMER_MAXTICKS	1000
+void mainbus_timer_defer(unsigned ticks);
+unsigned mainbus_timer_resume(void);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
@@ -63,6 +63,10 @@ struct openfile {
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* make a pipe and wrap both ends in openfile objects */
+int openfile_pipe(struct openfile **readfile_ret,
+		  struct openfile **writefile_ret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
@@ -35,6 +35,8 @@
 #define _PID_H_
 
 
+struct rusage;
+
 #define INVALID_PID	0	/* nothing has this pid */
 #define KERNEL_PID	1	/* kernel proc has this pid */
 
@@ -59,16 +61,19 @@ void pid_unalloc(pid_t targetpid);
 void pid_disown(pid_t targetpid);
 
 /*
- * Set the exit status of the current thread to status.  Wakes up any threads
- * waiting to read this status, and decrefs the current thread's pid.
+ * Set the exit status of the current thread to status, and its
+ * resource usage to ru.  Wakes up any threads waiting to read this
+ * status, and decrefs the current thread's pid.
  */
-void pid_setexitstatus(int status);
+void pid_setexitstatus(int status, const struct rusage *ru);
 
 /*
- * Causes the current thread to wait for the thread with pid PID to
- * exit, returning the exit status when it does.
+ * Causes the current thread to wait for the thread with pid PID, or
+ * any child if PID is -1, to exit, returning the exit status and
+ * resource usage when it does.
  */
-int pid_wait(pid_t targetpid, int *status, int flags, pid_t *retpid);
+int pid_wait(pid_t targetpid, int *status, int flags, struct rusage *ru,
+	     pid_t *retpid);
 
 
 #endif /* _PID_H_ */
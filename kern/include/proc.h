@@ -36,11 +36,25 @@
  * Note: curproc is defined by <current.h>.
  */
 
+#include <kern/time.h>
+#include <kern/resource.h> /* for struct rusage */
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
 
 struct addrspace;
 struct vnode;
+struct wchan;
+
+/*
+ * Exit record for a user thread made with threadfork(). It stays on
+ * the process until another thread collects it with threadjoin().
+ */
+struct uthread {
+	int ut_tid;			/* Thread id */
+	bool ut_exited;			/* True once the thread has exited */
+	int ut_status;			/* Exit status (valid if exited) */
+	struct uthread *ut_next;	/* Next record in process */
+};
 
 /*
  * Process structure.
@@ -50,6 +64,18 @@ struct proc {
 	struct spinlock p_lock;		/* Lock for this structure */
 	struct threadarray p_threads;	/* Threads in this process */
 	pid_t p_pid;			/* Process ID */
+	cpumask_t p_affinity;		/* CPUs new threads may run on */
+	int p_pri;			/* Priority of new threads */
+
+	/* resource usage */
+	struct threadusage p_usage;	/* Of threads that have left */
+	struct rusage p_cusage;		/* Of children waited for */
+
+	/* user threads */
+	struct wchan *p_wchan;		/* For threadjoin and exit */
+	struct uthread *p_uthreads;	/* Threads not yet joined */
+	int p_nexttid;			/* Next thread id to try */
+	volatile bool p_exiting;	/* Process is exiting */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
@@ -88,12 +114,59 @@ void proc_destroy(struct proc *proc);
  */
 void proc_exit(int status);
 
+/*
+ * Make the current thread exit, leaving the rest of the process
+ * running. If it's the last thread, the whole process exits with
+ * STATUS as its exit code.
+ */
+__DEAD void proc_threadexit(int status);
+
+/*
+ * If another thread is making the process exit, make the current
+ * thread go away. Called on the way back to user mode.
+ */
+void proc_exitcheck(void);
+
+/*
+ * Bracket an interruptible sleep on wait channel WC, whose spinlock
+ * is LK, so that proc_exit can wake the current thread. Call
+ * proc_intr_begin before taking LK; it fails with EINTR if the
+ * process is already exiting. Then, holding LK, check p_exiting once
+ * more before sleeping. Used by cv_wait_intr, P_intr, and semfs.
+ */
+int proc_intr_begin(struct wchan *wc, struct spinlock *lk);
+void proc_intr_end(void);
+
+/* Allocate an exit record and thread id for a new user thread. */
+int proc_newuthread(struct proc *proc, struct uthread **ret);
+
+/* Undo proc_newuthread if the thread never ran. */
+void proc_unnewuthread(struct proc *proc, struct uthread *ut);
+
+/* Wait for a user thread of the current process to exit. */
+int proc_threadjoin(int tid, int *status);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/* Restrict a process and all its threads to the CPUs in a mask. */
+int proc_setaffinity(struct proc *proc, cpumask_t mask);
+
+/* Set the priority of a process and all its threads. */
+void proc_setpriority(struct proc *proc, int pri);
+
+/*
+ * Get the resource usage of a process (RUSAGE_SELF) or of its
+ * children that have been waited for (RUSAGE_CHILDREN).
+ */
+void proc_getrusage(struct proc *proc, int who, struct rusage *ru);
+
+/* Charge the usage of a child just waited for to the current process. */
+void proc_addchildusage(const struct rusage *ru);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * Sampling profiler.
+ *
+ * While profiling is on, the timer interrupt handler records, for
+ * each interrupt, the PC it interrupted, the return address register
+ * at that point, the current pid, and whether it was in user or
+ * kernel mode, in a buffer kept by each cpu. To get a useful number
+ * of samples the timer runs PROF_TICKDIV times faster than usual
+ * while profiling is on; hardclock() still runs HZ times a second.
+ *
+ * The buffers hold the first PROF_NSAMPLES samples on each cpu;
+ * later ones are only counted (unlike the trace ring, which keeps
+ * the last events), so a profile covers the start of a run evenly
+ * rather than just its end.
+ *
+ * prof_dump writes the samples to a file for symbolizing on the host
+ * with hostbin/host-profsym:
+ *
+ *    struct prof_header
+ *    for each cpu:
+ *       struct prof_cpuheader
+ *       pc_count times struct prof_sample
+ *
+ * All fields are 32-bit words in the machine's byte order (big-endian
+ * on System/161).
+ *
+ * ps_ra is only a hint for call-site profiles: in a leaf function it
+ * is the return address into the caller, but a function that has
+ * called something else may hold a stale value or be using $31 for
+ * something else.
+ */
+
+#define PROF_TICKDIV	10	/* samples per hardclock */
+#define PROF_NSAMPLES	16384	/* per cpu */
+#define PROF_MAGIC	0x50524f46	/* "PROF" */
+#define PROF_VERSION	1
+
+/* ps_flags */
+#define PS_USER		1	/* interrupted user mode */
+
+struct prof_sample {
+	uint32_t ps_pc;
+	uint32_t ps_ra;
+	uint32_t ps_pid;		/* 0 if no process */
+	uint32_t ps_flags;
+};
+
+struct prof_header {
+	uint32_t ph_magic;
+	uint32_t ph_version;
+	uint32_t ph_ncpus;
+	uint32_t ph_samplesize;		/* sizeof(struct prof_sample) */
+	uint32_t ph_rate;		/* samples per second per cpu */
+};
+
+struct prof_cpuheader {
+	uint32_t pc_cpu;
+	uint32_t pc_count;		/* samples that follow */
+	uint32_t pc_lost;		/* samples that didn't fit */
+};
+
+extern volatile bool prof_enabled;
+
+/*
+ * Record a sample. Called by the timer interrupt handler, which
+ * knows how to get these out of the trapframe.
+ */
+void prof_sample(uint32_t pc, uint32_t ra, bool user);
+
+/*
+ * Control: prof_start allocates the buffers the first time and may
+ * fail with ENOMEM. prof_clear empties them. prof_dump stops
+ * profiling and writes the samples to PATH.
+ */
+int prof_start(void);
+void prof_stop(void);
+void prof_clear(void);
+void prof_printstats(void);
+int prof_dump(const char *path);
+
+
+#endif /* _PROF_H_ */
@@ -37,6 +37,8 @@
 
 #include <cdefs.h>
 
+struct lockstat;	/* from <lockstat.h> */
+
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
 #define SPINLOCK_INLINE INLINE
@@ -50,19 +52,28 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * This is a ticket lock: each acquirer atomically takes the next
+ * number from splk_next and spins until splk_serving reaches it, so
+ * waiters get the lock in FIFO order and only the release writes the
+ * word everyone spins on.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
-	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	volatile spinlock_data_t splk_next;    /* Next ticket to hand out. */
+	volatile spinlock_data_t splk_serving; /* Ticket now holding it. */
+	struct cpu *splk_holder;	       /* CPU holding this lock. */
+	struct lockstat *splk_stat;	       /* Lockstat record, if stamped. */
+	uint32_t splk_stamp;		       /* Cycle count at acquire. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	\
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, NULL, 0 }
 
 /*
  * Spinlock functions.
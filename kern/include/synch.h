@@ -58,8 +58,13 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ * P_intr is P for sleeps on behalf of a user process that may not
+ * end on their own: if the process starts exiting, it gives up and
+ * returns EINTR without decrementing.
  */
 void P(struct semaphore *);
+int P_intr(struct semaphore *);
 void V(struct semaphore *);
 
 
@@ -70,12 +75,18 @@ void V(struct semaphore *);
  * when the lock is destroyed, no thread should be holding it.
  *
  * The name field is for easier debugging. A copy of the name is
- * (should be) made internally.
+ * made internally.
  */
 struct lock {
         char *lk_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	struct wchan *lk_wchan;
+	struct spinlock lk_lock;	/* protects lk_holder and lk_wchan */
+	struct thread *volatile lk_holder;
+	struct lockstat *lk_stat;	/* lockstat record, once looked up */
+	bool lk_stamped;		/* lockstat is timing this hold */
+	uint32_t lk_stamp;		/* cycle count at acquire */
+	struct thread *lk_waiters;	/* threads waiting, via t_lknext */
+	struct lock *lk_heldnext;	/* next in lk_holder->t_heldlocks */
 };
 
 struct lock *lock_create(const char *name);
@@ -90,12 +101,23 @@ void lock_destroy(struct lock *);
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
  *
- * These operations must be atomic. You get to write them.
+ * These operations must be atomic.
  */
 void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+/*
+ * Locks do priority inheritance: while a thread waits for a lock,
+ * the holder runs at (at least) the waiter's priority, and so on
+ * down the chain if the holder is itself waiting for a lock. When
+ * the lock is released, the highest-priority waiter gets it next.
+ *
+ * lock_setbasepri sets thread T's own priority (PRI_MIN to PRI_MAX)
+ * and passes the change along any such chain.
+ */
+void lock_setbasepri(struct thread *t, int pri);
+
 
 /*
  * Condition variable.
@@ -108,13 +130,13 @@ bool lock_do_i_hold(struct lock *);
  * guarantees are made about scheduling.
  *
  * The name field is for easier debugging. A copy of the name is
- * (should be) made internally.
+ * made internally.
  */
 
 struct cv {
         char *cv_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	struct wchan *cv_wchan;
+	struct spinlock cv_lock;	/* protects cv_wchan */
 };
 
 struct cv *cv_create(const char *name);
@@ -131,9 +153,13 @@ void cv_destroy(struct cv *);
  * in. Note that under normal circumstances the same lock should be used
  * on all operations with any particular CV.
  *
- * These operations must be atomic. You get to write them.
+ * cv_wait_intr is cv_wait, but returns EINTR (with the lock held
+ * again) if the current process is exiting; see P_intr.
+ *
+ * These operations must be atomic.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_wait_intr(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
@@ -33,6 +33,7 @@
 
 #include <cdefs.h> /* for __DEAD */
 struct trapframe; /* from <machine/trapframe.h> */
+struct addrspace; /* from <addrspace.h> */
 
 /*
  * The system call dispatcher.
@@ -54,6 +55,23 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Enter user mode in a new thread of the current process. Does not return. */
+__DEAD void enter_new_thread(struct trapframe *tf, vaddr_t entrypoint,
+			     vaddr_t arg, vaddr_t stackptr);
+
+/* Setup function for futex. */
+void futex_bootstrap(void);
+
+/* Wake every futex waiter in an address space, for process exit. */
+void futex_wakeall(struct addrspace *as);
+
+/* Setup function for sysctl and the syscall statistics. */
+void sysctl_bootstrap(void);
+
+/* Per-syscall statistics, kept by the syscall dispatcher. */
+void syscallstat_enter(int callno);
+void syscallstat_exit(int callno, int err, uint32_t cycles);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,19 +82,49 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
+int sys_wait4(pid_t pid, userptr_t returncode, int flags, userptr_t rusage,
+	      pid_t *retval);
 int sys_getpid(pid_t *retval);
+int sys_getrusage(int who, userptr_t rusage);
+int sys_getrlimit(int resource, userptr_t rlimit);
+int sys_setrlimit(int resource, const_userptr_t rlimit);
+int sys_sched_setaffinity(pid_t pid, unsigned mask);
+int sys_sched_getaffinity(pid_t pid, userptr_t mask);
+int sys_futex(userptr_t uaddr, int op, int val, const_userptr_t timeout,
+	      int *retval);
+int sys___threadfork(struct trapframe *tf, userptr_t entrypoint,
+		     userptr_t arg, userptr_t stackptr, int *retval);
+__DEAD void sys_threadexit(int status);
+int sys___threadjoin(int tid, userptr_t status);
+int sys_schedstat(int cpunum, userptr_t stats, int *retval);
+int sys_setpriority(int which, pid_t who, int prio);
+int sys_getpriority(int which, pid_t who, int *retval);
+int sys___sysctl(const_userptr_t name, unsigned namelen,
+		 userptr_t oldp, userptr_t oldlenp,
+		 const_userptr_t newp, size_t newlen);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t fds);
 int sys_close(int fd);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	       int *retval);
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+		int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
+int sys_ioctl(int fd, int code, userptr_t data);
 
 int sys_chdir(const_userptr_t path);
 int sys___getcwd(userptr_t buf, size_t buflen, int *retval);
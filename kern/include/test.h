@@ -56,6 +56,9 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int spinlocktest(int, char **);
+int timeouttest(int, char **);
+int pitest(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
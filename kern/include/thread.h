@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -55,6 +56,32 @@ struct cpu;
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
+/* Names up to this long (with the null) are kept inside struct thread */
+#define THREAD_NAMELEN 24
+
+/* Exited threads kept per cpu for reuse by thread_fork */
+#define THREADCACHE_MAX 8
+
+
+/*
+ * CPU affinity mask: bit N is set if the thread may run on the cpu
+ * whose c_number is N. MAXCPUS is at most 32, so one word suffices.
+ */
+typedef uint32_t cpumask_t;
+#define CPUMASK_ALL	((cpumask_t)0xffffffff)
+#define CPUMASK_BIT(n)	((cpumask_t)1 << (n))
+
+/*
+ * Thread priorities. Run queues are kept in priority order, highest
+ * first, so a runnable thread only gets the cpu when no thread of
+ * higher priority is waiting for it -- counting the bonus it gets by
+ * aging while it waits (see schedule()), so that it isn't starved.
+ * The user-visible nice value of setpriority() is PRI_DEFAULT minus
+ * the priority.
+ */
+#define PRI_MIN		0
+#define PRI_DEFAULT	20
+#define PRI_MAX		40
 
 /* States a thread can be in. */
 typedef enum {
@@ -64,6 +91,20 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Resource usage charged to a thread. Folded into its process's
+ * p_usage when the thread leaves the process; see proc.c.
+ */
+struct threadusage {
+	unsigned tu_uticks;		/* Clock ticks taken in user mode */
+	unsigned tu_sticks;		/* Clock ticks taken in the kernel */
+	unsigned tu_minflt;		/* Page faults handled */
+	unsigned tu_inblock;		/* Successful read calls */
+	unsigned tu_oublock;		/* Successful write calls */
+	unsigned tu_nvcsw;		/* Switches because we slept */
+	unsigned tu_nivcsw;		/* Switches because we were preempted */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -77,12 +118,17 @@ struct thread {
 	/*
 	 * Thread subsystem internal fields.
 	 */
+	char t_namebuf[THREAD_NAMELEN];	/* Holds t_name if it fits */
 	struct thread_machdep t_machdep; /* Any machine-dependent goo */
 	struct threadlistnode t_listnode; /* Link for run/sleep/zombie lists */
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	unsigned t_allindex;		/* Index into allthreads[] */
+	uint32_t t_statestamp;		/* cpu_getcycles() when t_state last set */
+	struct wchan *t_lastwchan;	/* Channel last woken from (not timed out) */
 
 	/*
 	 * Interrupt state fields.
@@ -100,11 +146,39 @@ struct thread {
 	bool t_in_interrupt;		/* Are we in an interrupt? */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
+	bool t_intr_user;		/* Interrupt came from user mode? */
 
 	/*
 	 * Public fields
 	 */
 
+	cpumask_t t_affinity;		/* CPUs this thread may run on */
+	int t_tid;			/* User thread id (0 if not threadforked) */
+
+	/*
+	 * Priority. t_pri is what the scheduler uses: t_basepri, or
+	 * higher if a thread waiting for one of our locks has a
+	 * higher priority (priority inheritance). The fields other
+	 * than t_pri and t_agebonus belong to the lock code in synch.c.
+	 * t_agebonus is added to t_pri while the thread waits to run;
+	 * it is protected by the run queue lock.
+	 */
+	int t_basepri;			/* Priority set for this thread */
+	int t_pri;			/* Effective priority */
+	int t_agebonus;			/* Bonus from aging on a run queue */
+	struct lock *t_blockedon;	/* Lock we're waiting for */
+	struct thread *t_lknext;	/* Next waiter for t_blockedon */
+	struct lock *t_heldlocks;	/* Held locks with waiters (lk_heldnext) */
+
+	struct threadusage t_usage;	/* Resource usage (see getrusage) */
+
+	/*
+	 * Where we're in an interruptible sleep (cv_wait_intr, P_intr),
+	 * so proc_exit can wake us. Protected by our process's p_lock.
+	 */
+	struct wchan *t_intrwchan;
+	struct spinlock *t_intrlock;
+
 	/* add more here as needed */
 };
 
@@ -144,6 +218,35 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Give a thread a new name. NAME must have come from kmalloc and the
+ * thread takes ownership of it.
+ */
+void thread_rename(struct thread *t, char *name);
+
+/*
+ * Print the hit rate of the per-cpu caches of exited threads that
+ * thread_fork draws on.
+ */
+void thread_printcachestats(void);
+
+/*
+ * Print every thread with its state, wait channel, cpu, and the time
+ * in cycles since it entered that state. This takes only spinlocks,
+ * so it can be used from the menu while a workload is running.
+ */
+void thread_printall(void);
+
+/*
+ * Scheduler latency histograms (see <kern/schedstat.h>): get those
+ * of one cpu, or summed over all cpus if CPUNUM is -1; print them by
+ * cpu; or zero them.
+ */
+struct schedstat;
+int thread_getschedstat(int cpunum, struct schedstat *ss);
+void thread_printschedstats(void);
+void thread_resetschedstats(void);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,6 +260,25 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Return the mask of CPUs that are currently online.
+ */
+cpumask_t thread_onlinecpus(void);
+
+/*
+ * Restrict the current thread to the CPUs in MASK, moving it off the
+ * current CPU if that's no longer allowed. Fails with EINVAL if MASK
+ * includes no CPU that's online.
+ */
+int thread_setaffinity(cpumask_t mask);
+
+/*
+ * Change a thread's effective priority, moving it up or down its run
+ * queue if it's on one. Only for the lock code; use lock_setbasepri
+ * to set a thread's own priority.
+ */
+void thread_setpri(struct thread *t, int pri);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel event trace.
+ *
+ * While tracing is on, each TRACE() records the cycle counter, cpu,
+ * current thread, an event code, and three arguments in a ring of
+ * the last TRACE_NEVENTS events kept by each cpu. Recording takes no
+ * locks, only splhigh, so TRACE can be used anywhere, including in
+ * interrupt handlers and with spinlocks held, and costs one test of
+ * trace_enabled when tracing is off.
+ *
+ * trace_dump writes the rings to a file (which can be on emufs, so
+ * it ends up on the host) for offline analysis:
+ *
+ *    struct trace_header
+ *    for each cpu:
+ *       struct trace_cpuheader
+ *       tc_count times struct trace_event, oldest first
+ *
+ * All fields are 32-bit words in the machine's byte order (big-endian
+ * on System/161). te_cycles wraps around; within one cpu the events
+ * are in order, so the wraps can be undone by watching for it to go
+ * backwards. te_thread is the struct thread pointer.
+ */
+
+/* Event codes and their arguments */
+#define TR_SWITCH	1	/* new thread, old thread's new state, 0 */
+#define TR_VMFAULT	2	/* fault type, address, 0 */
+#define TR_SYSCALL	3	/* call number, a0, a1 */
+#define TR_SYSRET	4	/* call number, error, return value */
+#define TR_DISKIO	5	/* sector, sector count, 1 if write */
+
+#define TRACE_NEVENTS	2048	/* per cpu; must be a power of 2 */
+#define TRACE_MAGIC	0x54524345	/* "TRCE" */
+#define TRACE_VERSION	1
+
+struct trace_event {
+	uint32_t te_cycles;
+	uint32_t te_cpu;
+	uint32_t te_event;
+	uint32_t te_thread;
+	uint32_t te_args[3];
+};
+
+struct trace_header {
+	uint32_t th_magic;
+	uint32_t th_version;
+	uint32_t th_ncpus;
+	uint32_t th_eventsize;		/* sizeof(struct trace_event) */
+};
+
+struct trace_cpuheader {
+	uint32_t tc_cpu;
+	uint32_t tc_count;		/* events that follow */
+	uint32_t tc_lost;		/* older events overwritten */
+};
+
+extern volatile bool trace_enabled;
+
+#define TRACE(ev, a, b, c) \
+	do { \
+		if (trace_enabled) { \
+			trace_log((ev), (uint32_t)(a), (uint32_t)(b), \
+				  (uint32_t)(c)); \
+		} \
+	} while (0)
+
+void trace_log(unsigned event, uint32_t a, uint32_t b, uint32_t c);
+
+/*
+ * Control: trace_start allocates the rings the first time and may
+ * fail with ENOMEM. trace_clear empties them. trace_dump stops
+ * tracing and writes the rings to PATH.
+ */
+int trace_start(void);
+void trace_stop(void);
+void trace_clear(void);
+void trace_printstats(void);
+int trace_dump(const char *path);
+
+
+#endif /* _TRACE_H_ */
@@ -99,6 +99,12 @@ int vfs_lookparent(char *path, struct vnode **result,
  *
  *    vfs_close  - Close a vnode opened with vfs_open. Does not fail.
  *                 (See vfspath.c for a discussion of why.)
+ *
+ *    vfs_dumpopen  - Create or truncate PATH for writing out kernel
+ *                    data, such as the trace and profile dumps. PATH
+ *                    is left alone. Close with vfs_close.
+ *    vfs_dumpwrite - Write LEN bytes from kernel buffer BUF to VN at
+ *                    *POS, advancing *POS. A short write is ENOSPC.
  */
 
 int vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret);
@@ -114,6 +120,9 @@ int vfs_rename(char *oldpath, char *newpath);
 int vfs_chdir(char *path);
 int vfs_getcwd(struct uio *buf);
 
+int vfs_dumpopen(const char *path, struct vnode **ret);
+int vfs_dumpwrite(struct vnode *vn, off_t *pos, const void *buf, size_t len);
+
 /*
  * Misc
  *
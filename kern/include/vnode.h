@@ -50,13 +50,15 @@ struct stat;
  */
 struct vnode {
 	int vn_refcount;                /* Reference count */
-	struct spinlock vn_countlock;   /* Lock for vn_refcount */
+	struct spinlock vn_countlock;   /* Lock for vn_refcount, vn_version */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
 	void *vn_data;                  /* Filesystem-specific data */
 
 	const struct vnode_ops *vn_ops; /* Functions on this vnode */
+
+	uint64_t vn_version;            /* Changes on write/truncate */
 };
 
 /*
@@ -105,7 +107,9 @@ struct vnode {
  *
  *    vop_ioctl       - Perform ioctl operation OP on file using data
  *                      DATA. The interpretation of the data is specific
- *                      to each ioctl.
+ *                      to each ioctl. ACCMODE is the O_ACCMODE part of
+ *                      the flags the file was opened with, for ioctls
+ *                      that amount to reading or writing it.
  *
  *    vop_stat        - Return info about a file. The pointer is a
  *                      pointer to struct stat; see kern/stat.h.
@@ -188,7 +192,8 @@ struct vnode_ops {
 	int (*vop_readlink)(struct vnode *link, struct uio *uio);
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
-	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
+	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data,
+			 int accmode);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
@@ -231,14 +236,14 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
-#define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
-#define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
+#define VOP_WRITE(vn, uio)              (vnode_write(vn, uio))
+#define VOP_IOCTL(vn, code, buf, acc)   (__VOP(vn, ioctl)(vn,code,buf,acc))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
-#define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
+#define VOP_TRUNCATE(vn, pos)           (vnode_truncate(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
@@ -257,6 +262,21 @@ struct vnode_ops {
  */
 void vnode_check(struct vnode *, const char *op);
 
+/*
+ * Version numbers. Every vnode gets one that no other vnode has had
+ * (even one previously at the same address), and a new one each time
+ * it's written or truncated, so (vnode, version) identifies a file's
+ * contents. Used by caches of things read from files. VOP_WRITE and
+ * VOP_TRUNCATE go through vnode_write and vnode_truncate, which change
+ * the version both before and after the operation, so anything read
+ * while it's in progress is filed under a version that's already gone
+ * once it's finished.
+ */
+void vnode_newversion(struct vnode *);
+uint64_t vnode_getversion(struct vnode *);
+int vnode_write(struct vnode *, struct uio *);
+int vnode_truncate(struct vnode *, off_t);
+
 /*
  * Reference count manipulation (handled above filesystem level)
  */
@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct thread; /* in thread.h */
 struct wchan; /* Opaque */
 
 /*
@@ -66,6 +67,14 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Like wchan_sleep, but also wake up after TICKS hardclocks if nobody
+ * has done so first. Returns 0 if woken by wchan_wake*, or ETIMEDOUT
+ * if the time ran out. (If TICKS is 0, returns ETIMEDOUT at once.)
+ */
+int wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk,
+			unsigned ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
@@ -76,5 +85,22 @@ void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Wake up thread TARGET if it is sleeping on the wait channel.
+ * Returns true if it was. The associated spinlock should be locked.
+ */
+bool wchan_wakethread(struct wchan *wc, struct spinlock *lk,
+		      struct thread *target);
+
+/*
+ * Print the sleep and wakeup counts of all wait channels, merged by
+ * name, or zero them. A "resleep" is a thread going back to sleep on
+ * the channel it was last woken from (not by timeout) without having
+ * slept anywhere else in between; for a condition-wait loop that is a
+ * wakeup that found nothing to do. Times are in cycles.
+ */
+void wchan_printstats(void);
+void wchan_resetstats(void);
+
 
 #endif /* _WCHAN_H_ */
@@ -131,6 +131,43 @@ bitmap_translate(unsigned bitno, unsigned *ix, WORD_TYPE *mask)
         *mask = ((WORD_TYPE)1) << offset;
 }
 
+/*
+ * Like bitmap_alloc, but look for a cleared bit starting at START and
+ * wrapping around, so that successive calls can hand bits out
+ * round-robin instead of always reusing the lowest.
+ */
+int
+bitmap_allocfrom(struct bitmap *b, unsigned start, unsigned *index)
+{
+        unsigned i, bitno, ix, skip;
+        WORD_TYPE mask;
+
+        KASSERT(start < b->nbits);
+
+        for (i=0; i<b->nbits; i++) {
+                bitno = start + i;
+                if (bitno >= b->nbits) {
+                        bitno -= b->nbits;
+                }
+                bitmap_translate(bitno, &ix, &mask);
+                if (b->v[ix] == WORD_ALLBITS) {
+                        /* skip the rest of the word, but not past the end */
+                        skip = BITS_PER_WORD - bitno % BITS_PER_WORD;
+                        if (skip > b->nbits - bitno) {
+                                skip = b->nbits - bitno;
+                        }
+                        i += skip - 1;
+                        continue;
+                }
+                if ((b->v[ix] & mask) == 0) {
+                        b->v[ix] |= mask;
+                        *index = bitno;
+                        return 0;
+                }
+        }
+        return ENOSPC;
+}
+
 void
 bitmap_mark(struct bitmap *b, unsigned index)
 {
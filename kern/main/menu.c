@@ -36,9 +36,14 @@
 #include <lib.h>
 #include <uio.h>
 #include <clock.h>
+#include <lockstat.h>
+#include <trace.h>
+#include <prof.h>
 #include <thread.h>
+#include <wchan.h>
 #include <proc.h>
 #include <vfs.h>
+#include <addrspace.h>
 #include <sfs.h>
 #include <pid.h>
 #include <syscall.h>
@@ -100,11 +105,12 @@ cmd_progthread(void *ptr, unsigned long nargs)
 }
 
 /*
- * Common code for cmd_prog and cmd_shell.
+ * Common code for cmd_prog, cmd_shell, and cmd_taskset. The program
+ * runs on the CPUs in AFFINITY.
  */
 static
 int
-common_prog(int nargs, char **args)
+common_prog(int nargs, char **args, cpumask_t affinity)
 {
 	struct proc *proc;
 	int result;
@@ -118,6 +124,13 @@ common_prog(int nargs, char **args)
 	}
 	childpid = proc->p_pid;
 
+	result = proc_setaffinity(proc, affinity);
+	if (result) {
+		kprintf("No online CPUs in mask 0x%x\n", affinity);
+		proc_unfork(proc);
+		return result;
+	}
+
 	result = thread_fork(args[0] /* thread name */,
 			proc /* new process */,
 			cmd_progthread /* thread function */,
@@ -128,7 +141,7 @@ common_prog(int nargs, char **args)
 		return result;
 	}
 
-	pid_wait(childpid, &status, 0, NULL);
+	pid_wait(childpid, &status, 0, NULL, NULL);
 	if (WIFEXITED(status)) {
 		kprintf("Program (pid %d) exited with status %d\n",
 			childpid, WEXITSTATUS(status));
@@ -161,7 +174,36 @@ cmd_prog(int nargs, char **args)
 	args++;
 	nargs--;
 
-	return common_prog(nargs, args);
+	return common_prog(nargs, args, CPUMASK_ALL);
+}
+
+/*
+ * Command for running a program restricted to some CPUs. The mask is
+ * given in C syntax: 0x5 or 5 for cpus 0 and 2.
+ */
+static
+int
+cmd_taskset(int nargs, char **args)
+{
+	cpumask_t mask;
+	char *end;
+
+	if (nargs < 3) {
+		kprintf("Usage: taskset mask program [arguments]\n");
+		return EINVAL;
+	}
+
+	mask = strtoul(args[1], &end, 0);
+	if (end == args[1] || *end != '\0') {
+		kprintf("taskset: %s: Invalid mask\n", args[1]);
+		return EINVAL;
+	}
+
+	/* drop the leading "taskset mask" */
+	args += 2;
+	nargs -= 2;
+
+	return common_prog(nargs, args, mask);
 }
 
 /*
@@ -179,7 +221,7 @@ cmd_shell(int nargs, char **args)
 
 	args[0] = (char *)_PATH_SHELL;
 
-	return common_prog(nargs, args);
+	return common_prog(nargs, args, CPUMASK_ALL);
 }
 
 /*
@@ -408,6 +450,218 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_threadcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printcachestats();
+
+	return 0;
+}
+
+static
+int
+cmd_execcachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	execcache_printstats();
+
+	return 0;
+}
+
+/*
+ * Thread for "ps N": print the thread list once a second, N times,
+ * so it can be watched while the menu is busy running a program.
+ */
+static
+void
+cmd_psthread(void *unused, unsigned long count)
+{
+	unsigned long i;
+
+	(void)unused;
+
+	for (i=0; i<count; i++) {
+		clocksleep(1);
+		thread_printall();
+	}
+}
+
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	int count, result;
+
+	if (nargs == 1) {
+		thread_printall();
+		return 0;
+	}
+	count = nargs == 2 ? atoi(args[1]) : 0;
+	if (count <= 0) {
+		kprintf("Usage: ps [count]\n");
+		return EINVAL;
+	}
+	result = thread_fork("ps", NULL, cmd_psthread, NULL, count);
+	if (result) {
+		kprintf("thread_fork failed: %s\n", strerror(result));
+		return result;
+	}
+	return 0;
+}
+
+static
+int
+cmd_wchanstats(int nargs, char **args)
+{
+	if (nargs == 1) {
+		wchan_printstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		wchan_resetstats();
+	}
+	else {
+		kprintf("Usage: wchans [reset]\n");
+	}
+
+	return 0;
+}
+
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 1) {
+		trace_printstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		result = trace_start();
+		if (result) {
+			kprintf("trace: %s\n", strerror(result));
+			return result;
+		}
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		trace_stop();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clear")) {
+		trace_clear();
+	}
+	else if (nargs == 3 && !strcmp(args[1], "dump")) {
+		result = trace_dump(args[2]);
+		if (result) {
+			kprintf("trace: %s: %s\n", args[2], strerror(result));
+			return result;
+		}
+	}
+	else {
+		kprintf("Usage: trace [on|off|clear|dump file]\n");
+	}
+
+	return 0;
+}
+
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 1) {
+		prof_printstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		result = prof_start();
+		if (result) {
+			kprintf("prof: %s\n", strerror(result));
+			return result;
+		}
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		prof_stop();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clear")) {
+		prof_clear();
+	}
+	else if (nargs == 3 && !strcmp(args[1], "dump")) {
+		result = prof_dump(args[2]);
+		if (result) {
+			kprintf("prof: %s: %s\n", args[2], strerror(result));
+			return result;
+		}
+	}
+	else {
+		kprintf("Usage: prof [on|off|clear|dump file]\n");
+	}
+
+	return 0;
+}
+
+static
+int
+cmd_schedstats(int nargs, char **args)
+{
+	if (nargs == 1) {
+		thread_printschedstats();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		thread_resetschedstats();
+	}
+	else {
+		kprintf("Usage: sched [reset]\n");
+	}
+
+	return 0;
+}
+
+static
+int
+cmd_tickstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	hardclock_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 1) {
+		lockstat_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		result = lockstat_start();
+		if (result) {
+			kprintf("lockstat: %s\n", strerror(result));
+			return result;
+		}
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		lockstat_stop();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else {
+		kprintf("Usage: lockstat [on|off|reset]\n");
+	}
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -440,6 +694,7 @@ showmenu(const char *name, const char *x[])
 static const char *opsmenu[] = {
 	"[s]       Shell                     ",
 	"[p]       Other program             ",
+	"[taskset] Program on some CPUs      ",
 	"[mount]   Mount a filesystem        ",
 	"[unmount] Unmount a filesystem      ",
 	"[bootfs]  Set \"boot\" filesystem     ",
@@ -481,6 +736,9 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
+	"[slt] Spinlock contention test      ",
+	"[tmt] Timeout test                  ",
+	"[pit] Priority inheritance test     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
@@ -512,6 +770,15 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[lockstat] Lock stats [on|off|reset]",
+	"[ticks] Per-CPU clock tick stats    ",
+	"[tc] Thread cache stats             ",
+	"[ec] Exec header cache stats        ",
+	"[ps] List threads [count]           ",
+	"[wchans] Wait channel stats [reset] ",
+	"[sched] Scheduler latency [reset]   ",
+	"[trace] Event trace [on|off|dump f] ",
+	"[prof] Profiler [on|off|dump f]     ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -545,6 +812,7 @@ static struct {
 	/* operations */
 	{ "s",		cmd_shell },
 	{ "p",		cmd_prog },
+	{ "taskset",	cmd_taskset },
 	{ "mount",	cmd_mount },
 	{ "unmount",	cmd_unmount },
 	{ "bootfs",	cmd_bootfs },
@@ -561,6 +829,15 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "lockstat",   cmd_lockstat },
+	{ "ticks",      cmd_tickstats },
+	{ "tc",         cmd_threadcachestats },
+	{ "ec",         cmd_execcachestats },
+	{ "ps",         cmd_ps },
+	{ "wchans",     cmd_wchanstats },
+	{ "sched",      cmd_schedstats },
+	{ "trace",      cmd_trace },
+	{ "prof",       cmd_prof },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -582,6 +859,9 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "slt",	spinlocktest },
+	{ "tmt",	timeouttest },
+	{ "pit",	pitest },
 
 	/* system call assignment tests */
 	/* For testing the wait implementation. */
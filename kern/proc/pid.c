@@ -34,10 +34,14 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <limits.h>
 #include <lib.h>
 #include <array.h>
+#include <bitmap.h>
 #include <clock.h>
+#include <membar.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -47,29 +51,75 @@
 /*
  * Structure for holding exit data of a thread.
  *
+ * Each process's pidinfo lists its children: those still running in
+ * pi_kids, and those that have exited but not been waited for in
+ * pi_zombies, oldest first, so waiting for any child is O(1). A
+ * process waits for its children on its own pi_cv.
+ *
  * If pi_ppid is INVALID_PID, the parent has gone away and will not be
  * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
  * structure can be freed.
  */
+struct pidinfo;
+
+struct kidlist {
+	struct pidinfo *kl_head;
+	struct pidinfo *kl_tail;
+};
+
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct rusage pi_rusage;	// usage (only valid if exited)
+	struct pidinfo *pi_prev;	// siblings, in parent's list
+	struct pidinfo *pi_next;
+	struct kidlist pi_kids;		// running children
+	struct kidlist pi_zombies;	// exited children, oldest first
+	struct cv *pi_cv;		// use to wait for children
 };
 
 
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table is a two-level radix tree indexed by pid: a
+ * fixed top-level array of PIDTABLE_NLEAVES pointers to leaves of
+ * PIDLEAF_SIZE slots each. Leaves are allocated as the pids they
+ * cover are first handed out and never freed, so finding a pid's leaf
+ * needs no locking.
+ *
+ * Each leaf has its own lock. It protects the leaf's slots, and also
+ * the families of the processes in it: their child lists, and the
+ * pi_ppid, pi_exited, exit status, and sibling links of their
+ * children. A process waits for its children with the lock of its
+ * own leaf. Processes that don't share a leaf never contend, except
+ * a parent and child as the child exits.
+ *
+ * Free pids are found with a bitmap, searched round-robin from
+ * nextpid so that a pid isn't reused right after it's freed. The
+ * bitmap, nextpid, nprocs, and the creation of leaves are protected
+ * by pidalloclock. A pid's bit is set from pid_alloc until its
+ * pidinfo is dropped, so an allocated pid whose pidinfo hasn't been
+ * installed yet (or was just removed) can't be handed out twice.
+ *
+ * Lock order: a leaf lock may be held while getting pidalloclock
+ * (to free a pid), never the other way around, and no two leaf locks
+ * are held at once.
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
+#define PIDLEAF_SIZE		256
+#define PIDTABLE_NLEAVES	DIVROUNDUP(PID_MAX + 1, PIDLEAF_SIZE)
+
+struct pidleaf {
+	struct lock *pl_lock;
+	struct pidinfo *pl_slots[PIDLEAF_SIZE];
+};
+
+static struct pidleaf *pidtable[PIDTABLE_NLEAVES];
+
+static struct lock *pidalloclock;	// lock for pid allocation
+static struct bitmap *pidmap;		// pids in use
 static pid_t nextpid;			// next candidate pid
 static int nprocs;			// number of allocated pids
 
@@ -101,6 +151,10 @@ pidinfo_create(pid_t pid, pid_t ppid)
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	bzero(&pi->pi_rusage, sizeof(pi->pi_rusage));
+	pi->pi_prev = pi->pi_next = NULL;
+	pi->pi_kids.kl_head = pi->pi_kids.kl_tail = NULL;
+	pi->pi_zombies.kl_head = pi->pi_zombies.kl_tail = NULL;
 
 	return pi;
 }
@@ -114,10 +168,87 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
+	KASSERT(pi->pi_kids.kl_head == NULL);
+	KASSERT(pi->pi_zombies.kl_head == NULL);
 	cv_destroy(pi->pi_cv);
 	kfree(pi);
 }
 
+/*
+ * Create a leaf of the process table.
+ */
+static
+struct pidleaf *
+pidleaf_create(void)
+{
+	struct pidleaf *pl;
+
+	pl = kmalloc(sizeof(struct pidleaf));
+	if (pl == NULL) {
+		return NULL;
+	}
+	pl->pl_lock = lock_create("pidleaf");
+	if (pl->pl_lock == NULL) {
+		kfree(pl);
+		return NULL;
+	}
+	bzero(pl->pl_slots, sizeof(pl->pl_slots));
+	return pl;
+}
+
+/*
+ * Child lists.
+ */
+static
+void
+kidlist_add(struct kidlist *kl, struct pidinfo *pi)
+{
+	pi->pi_next = NULL;
+	pi->pi_prev = kl->kl_tail;
+	if (kl->kl_tail != NULL) {
+		kl->kl_tail->pi_next = pi;
+	}
+	else {
+		kl->kl_head = pi;
+	}
+	kl->kl_tail = pi;
+}
+
+static
+void
+kidlist_remove(struct kidlist *kl, struct pidinfo *pi)
+{
+	if (pi->pi_prev != NULL) {
+		pi->pi_prev->pi_next = pi->pi_next;
+	}
+	else {
+		KASSERT(kl->kl_head == pi);
+		kl->kl_head = pi->pi_next;
+	}
+	if (pi->pi_next != NULL) {
+		pi->pi_next->pi_prev = pi->pi_prev;
+	}
+	else {
+		KASSERT(kl->kl_tail == pi);
+		kl->kl_tail = pi->pi_prev;
+	}
+	pi->pi_prev = pi->pi_next = NULL;
+}
+
+static
+struct pidinfo *
+kidlist_find(struct kidlist *kl, pid_t pid)
+{
+	struct pidinfo *pi;
+
+	for (pi = kl->kl_head; pi != NULL; pi = pi->pi_next) {
+		if (pi->pi_pid == pid) {
+			return pi;
+		}
+	}
+	return NULL;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -126,154 +257,222 @@ pidinfo_destroy(struct pidinfo *pi)
 void
 pid_bootstrap(void)
 {
-	int i;
+	struct pidleaf *pl;
+	struct pidinfo *pi;
+	unsigned i;
 
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
+	pidalloclock = lock_create("pidalloc");
+	if (pidalloclock == NULL) {
 		panic("Out of memory creating pid lock\n");
 	}
 
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
+	pidmap = bitmap_create(PID_MAX + 1);
+	if (pidmap == NULL) {
+		panic("Out of memory creating pid bitmap\n");
+	}
+	/* Reserve the pids below PID_MIN, including INVALID_PID. */
+	for (i=0; i<PID_MIN; i++) {
+		bitmap_mark(pidmap, i);
 	}
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
+	pl = pidleaf_create();
+	pi = pidinfo_create(KERNEL_PID, INVALID_PID);
+	if (pl == NULL || pi == NULL) {
 		panic("Out of memory creating kernel pid data\n");
 	}
+	pl->pl_slots[KERNEL_PID] = pi;
+	pidtable[0] = pl;
 
 	nextpid = PID_MIN;
 	nprocs = 1;
 }
 
 /*
- * pi_get: look up a pidinfo in the process table.
+ * Find the leaf for a pid, which may not exist yet. No locking is
+ * needed because leaves are never freed.
+ */
+static
+struct pidleaf *
+pid_leaf(pid_t pid)
+{
+	KASSERT(pid > 0 && pid <= PID_MAX);
+	return pidtable[pid / PIDLEAF_SIZE];
+}
+
+/*
+ * pi_get: look up a pidinfo in the process table. The caller must
+ * hold the lock of the pid's leaf.
  */
 static
 struct pidinfo *
-pi_get(pid_t pid)
+pi_get(struct pidleaf *pl, pid_t pid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(lock_do_i_hold(pl->pl_lock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	if (pi==NULL) {
-		return NULL;
-	}
-	if (pi->pi_pid != pid) {
-		return NULL;
-	}
+	pi = pl->pl_slots[pid % PIDLEAF_SIZE];
+	KASSERT(pi == NULL || pi->pi_pid == pid);
 	return pi;
 }
 
 /*
- * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * pi_find: look up a pidinfo that can't go away underneath us: our
+ * own, or that of a child we haven't waited for or disowned.
  */
 static
-void
-pi_put(pid_t pid, struct pidinfo *pi)
+struct pidinfo *
+pi_find(pid_t pid)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidleaf *pl;
+	struct pidinfo *pi;
+
+	pl = pid_leaf(pid);
+	KASSERT(pl != NULL);
+	lock_acquire(pl->pl_lock);
+	pi = pi_get(pl, pid);
+	lock_release(pl->pl_lock);
+	KASSERT(pi != NULL);
+	return pi;
+}
 
+/*
+ * pi_put: insert a new pidinfo in the process table. Its pid must
+ * have come from pid_alloc, so the slot is empty.
+ */
+static
+void
+pi_put(struct pidleaf *pl, pid_t pid, struct pidinfo *pi)
+{
+	KASSERT(lock_do_i_hold(pl->pl_lock));
 	KASSERT(pid != INVALID_PID);
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	KASSERT(pl->pl_slots[pid % PIDLEAF_SIZE] == NULL);
+	pl->pl_slots[pid % PIDLEAF_SIZE] = pi;
 }
 
 /*
  * pi_drop: remove a pidinfo structure from the process table and free
- * it. It should reflect a process that has already exited and been
- * waited for.
+ * it, and free its pid. It should reflect a process that has already
+ * exited and been waited for (or has no parent to wait for it) and
+ * is no longer on any child list, so nothing else can reach it.
  */
 static
 void
 pi_drop(pid_t pid)
 {
+	struct pidleaf *pl;
 	struct pidinfo *pi;
 
-	KASSERT(lock_do_i_hold(pidlock));
+	pl = pid_leaf(pid);
+	lock_acquire(pl->pl_lock);
 
-	pi = pidinfo[pid % PROCS_MAX];
+	pi = pl->pl_slots[pid % PIDLEAF_SIZE];
 	KASSERT(pi != NULL);
 	KASSERT(pi->pi_pid == pid);
 
 	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
+	pl->pl_slots[pid % PIDLEAF_SIZE] = NULL;
+
+	lock_acquire(pidalloclock);
+	bitmap_unmark(pidmap, pid);
 	nprocs--;
-}
+	lock_release(pidalloclock);
 
-////////////////////////////////////////////////////////////
+	lock_release(pl->pl_lock);
+}
 
 /*
- * Helper function for pid_alloc.
+ * Lock the family PI belongs to as a child, that is, its parent's
+ * leaf, and return the parent's pidinfo; or, if it has no parent,
+ * lock nothing and return NULL. PI's pi_ppid can only change with
+ * that lock held, so it has to be checked again once we have it.
  */
 static
-void
-inc_nextpid(void)
+struct pidinfo *
+pi_lockparent(struct pidinfo *pi, struct pidleaf **ret)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidleaf *pl;
+	pid_t ppid;
 
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
+	while (1) {
+		ppid = pi->pi_ppid;
+		if (ppid == INVALID_PID) {
+			return NULL;
+		}
+		pl = pid_leaf(ppid);
+		lock_acquire(pl->pl_lock);
+		if (pi->pi_ppid == ppid) {
+			*ret = pl;
+			return pi_get(pl, ppid);
+		}
+		lock_release(pl->pl_lock);
 	}
 }
 
+////////////////////////////////////////////////////////////
+
 /*
  * pid_alloc: allocate a process id.
  */
 int
 pid_alloc(pid_t *retval)
 {
-	struct pidinfo *pi;
-	pid_t pid;
-	int count;
+	struct pidinfo *pi, *us;
+	struct pidleaf *pl;
+	unsigned pid;
+	int result;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* lock the table */
-	lock_acquire(pidlock);
+	lock_acquire(pidalloclock);
 
 	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
+		lock_release(pidalloclock);
 		return EAGAIN;
 	}
 
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
-
-		inc_nextpid();
+	/* There's always a free pid, since PROCS_MAX is less than PID_MAX. */
+	result = bitmap_allocfrom(pidmap, nextpid, &pid);
+	KASSERT(result == 0);
+
+	pl = pidtable[pid / PIDLEAF_SIZE];
+	if (pl == NULL) {
+		pl = pidleaf_create();
+		if (pl == NULL) {
+			bitmap_unmark(pidmap, pid);
+			lock_release(pidalloclock);
+			return ENOMEM;
+		}
+		/* Initialize it fully before pid_leaf can see it. */
+		membar_store_store();
+		pidtable[pid / PIDLEAF_SIZE] = pl;
 	}
 
-	pid = nextpid;
-
 	pi = pidinfo_create(pid, curproc->p_pid);
-	if (pi==NULL) {
-		lock_release(pidlock);
+	if (pi == NULL) {
+		bitmap_unmark(pidmap, pid);
+		lock_release(pidalloclock);
 		return ENOMEM;
 	}
 
-	pi_put(pid, pi);
+	nprocs++;
+	nextpid = pid == PID_MAX ? PID_MIN : pid + 1;
+
+	lock_release(pidalloclock);
 
-	inc_nextpid();
+	lock_acquire(pl->pl_lock);
+	pi_put(pl, pid, pi);
+	lock_release(pl->pl_lock);
 
-	lock_release(pidlock);
+	/* Now make it our child. */
+	pl = pid_leaf(curproc->p_pid);
+	lock_acquire(pl->pl_lock);
+	us = pi_get(pl, curproc->p_pid);
+	KASSERT(us != NULL);
+	kidlist_add(&us->pi_kids, pi);
+	lock_release(pl->pl_lock);
 
 	*retval = pid;
 	return 0;
@@ -286,25 +485,29 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidleaf *pl;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	them = pi_find(theirpid);
+
+	pl = pid_leaf(curproc->p_pid);
+	lock_acquire(pl->pl_lock);
+	us = pi_get(pl, curproc->p_pid);
 
-	them = pi_get(theirpid);
-	KASSERT(them != NULL);
 	KASSERT(them->pi_exited == false);
 	KASSERT(them->pi_ppid == curproc->p_pid);
+	kidlist_remove(&us->pi_kids, them);
 
 	/* keep pidinfo_destroy from complaining */
 	them->pi_exitstatus = 0xdead;
 	them->pi_exited = true;
 	them->pi_ppid = INVALID_PID;
 
-	pi_drop(theirpid);
+	lock_release(pl->pl_lock);
 
-	lock_release(pidlock);
+	pi_drop(theirpid);
 }
 
 /*
@@ -314,85 +517,119 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidleaf *pl;
+	struct pidinfo *us, *them;
+	bool exited;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	them = pi_find(theirpid);
+
+	pl = pid_leaf(curproc->p_pid);
+	lock_acquire(pl->pl_lock);
+	us = pi_get(pl, curproc->p_pid);
 
-	them = pi_get(theirpid);
-	KASSERT(them != NULL);
 	KASSERT(them->pi_ppid==curproc->p_pid);
 
+	exited = them->pi_exited;
+	kidlist_remove(exited ? &us->pi_zombies : &us->pi_kids, them);
 	them->pi_ppid = INVALID_PID;
-	if (them->pi_exited) {
-		pi_drop(them->pi_pid);
-	}
 
-	lock_release(pidlock);
+	lock_release(pl->pl_lock);
+
+	if (exited) {
+		pi_drop(theirpid);
+	}
 }
 
 /*
- * pid_setexitstatus: Sets the exit status of this process. Must only
- * be called if the thread actually had a pid assigned. Wakes up any
- * waiters and disposes of the piddata if nobody else is still using it.
+ * pid_setexitstatus: Sets the exit status and final resource usage of
+ * this process. Must only be called if the thread actually had a pid
+ * assigned. Wakes up any waiters and disposes of the piddata if
+ * nobody else is still using it.
  *
  * As far as the process is concerned, this releases its pid for
  * subsequent reuse; thus we set curproc->p_pid to INVALID_PID.
  */
 void
-pid_setexitstatus(int status)
+pid_setexitstatus(int status, const struct rusage *ru)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidleaf *pl;
+	struct pidinfo *us, *parent, *pi;
+	struct kidlist dead;
+	pid_t ourpid;
 
-	lock_acquire(pidlock);
-	KASSERT(curproc->p_pid != INVALID_PID);
+	ourpid = curproc->p_pid;
+	KASSERT(ourpid != INVALID_PID);
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
-		}
-	}
+	us = pi_find(ourpid);
 
-	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
+	/*
+	 * First, disown all children. The ones still running will
+	 * clean up after themselves when they exit; collect the ones
+	 * that already have, to drop them once we no longer hold the
+	 * lock.
+	 */
+	dead.kl_head = dead.kl_tail = NULL;
+	pl = pid_leaf(ourpid);
+	lock_acquire(pl->pl_lock);
+	while ((pi = us->pi_kids.kl_head) != NULL) {
+		kidlist_remove(&us->pi_kids, pi);
+		pi->pi_ppid = INVALID_PID;
+	}
+	while ((pi = us->pi_zombies.kl_head) != NULL) {
+		kidlist_remove(&us->pi_zombies, pi);
+		pi->pi_ppid = INVALID_PID;
+		kidlist_add(&dead, pi);
+	}
+	lock_release(pl->pl_lock);
 
-	us->pi_exitstatus = status;
-	us->pi_exited = true;
+	while ((pi = dead.kl_head) != NULL) {
+		kidlist_remove(&dead, pi);
+		pi_drop(pi->pi_pid);
+	}
 
-	if (us->pi_ppid == INVALID_PID) {
-		/* no parent */
-		pi_drop(curproc->p_pid);
+	/* Now, wake up our parent */
+	parent = pi_lockparent(us, &pl);
+	if (parent != NULL) {
+		us->pi_exitstatus = status;
+		us->pi_rusage = *ru;
+		us->pi_exited = true;
+		kidlist_remove(&parent->pi_kids, us);
+		kidlist_add(&parent->pi_zombies, us);
+		cv_broadcast(parent->pi_cv, pl->pl_lock);
+		lock_release(pl->pl_lock);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		/* no parent */
+		us->pi_exitstatus = status;
+		us->pi_exited = true;
+		pi_drop(ourpid);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
 }
 
 /*
- * Waits on a pid, returning the exit status when it's available.
- * status and ret are a kernel pointers, but pid/flags may come from
- * userland and may thus be maliciously invalid.
+ * Waits on a pid, or on any child if the pid is -1, returning the
+ * exit status and resource usage when it's available. status, ru,
+ * and ret are kernel pointers, but pid/flags may come from userland
+ * and may thus be maliciously invalid.
  *
- * status may be null, in which case the status is thrown away. ret
- * may only be null if WNOHANG is not set.
+ * status and ru may be null, in which case they're thrown away. ret
+ * may only be null if WNOHANG is not set and pid isn't -1.
+ *
+ * If the current process starts exiting while we wait, give up with
+ * EINTR.
  */
 int
-pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
+pid_wait(pid_t theirpid, int *status, int flags, struct rusage *ru,
+	 pid_t *ret)
 {
-	struct pidinfo *them;
+	struct pidleaf *pl;
+	struct pidinfo *us, *them;
+	bool exists;
+	int result;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
@@ -402,64 +639,83 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 	}
 
 	/*
-	 * We don't support the Unix meanings of negative pids or 0
-	 * (0 is INVALID_PID) and other code may break on them, so
-	 * check now.
+	 * We don't support the Unix meanings of 0 and pids below -1
+	 * (process groups; 0 is also INVALID_PID) and other code may
+	 * break on them, so check now.
 	 */
-	if (theirpid == INVALID_PID || theirpid<0) {
+	if (theirpid == INVALID_PID || theirpid < -1) {
 		return ENOSYS;
 	}
+	if (theirpid > PID_MAX) {
+		return ESRCH;
+	}
 
 	/* Only valid options */
 	if (flags != 0 && flags != WNOHANG) {
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
-
-	them = pi_get(theirpid);
-	if (them==NULL) {
-		lock_release(pidlock);
-		return ESRCH;
-	}
-
-	KASSERT(them->pi_pid==theirpid);
+	pl = pid_leaf(curproc->p_pid);
+	lock_acquire(pl->pl_lock);
+	us = pi_get(pl, curproc->p_pid);
+	KASSERT(us != NULL);
 
-	/* Only allow waiting for own children. */
-	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
-		return EPERM;
-	}
+	while (1) {
+		if (theirpid == -1) {
+			them = us->pi_zombies.kl_head;
+			if (them != NULL) {
+				break;
+			}
+			if (us->pi_kids.kl_head == NULL) {
+				lock_release(pl->pl_lock);
+				return ECHILD;
+			}
+		}
+		else {
+			them = kidlist_find(&us->pi_zombies, theirpid);
+			if (them != NULL) {
+				break;
+			}
+			if (kidlist_find(&us->pi_kids, theirpid) == NULL) {
+				/* Not our child; does it exist at all? */
+				lock_acquire(pidalloclock);
+				exists = bitmap_isset(pidmap, theirpid);
+				lock_release(pidalloclock);
+				lock_release(pl->pl_lock);
+				return exists ? EPERM : ESRCH;
+			}
+		}
 
-	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			lock_release(pl->pl_lock);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+		result = cv_wait_intr(us->pi_cv, pl->pl_lock);
+		if (result) {
+			lock_release(pl->pl_lock);
+			return result;
+		}
 	}
 
+	KASSERT(them->pi_exited == true);
+	kidlist_remove(&us->pi_zombies, them);
+	them->pi_ppid = INVALID_PID;
+
+	lock_release(pl->pl_lock);
+
 	if (status != NULL) {
 		*status = them->pi_exitstatus;
 	}
+	if (ru != NULL) {
+		*ru = them->pi_rusage;
+	}
+	proc_addchildusage(&them->pi_rusage);
 	if (ret != NULL) {
-		/*
-		 * In Unix you can wait for any of several possible
-		 * processes by passing particular magic values of
-		 * pid. wait then returns the pid you actually
-		 * found. We don't support this, so always return the
-		 * pid we looked for.
-		 */
-		*ret = theirpid;
+		*ret = them->pi_pid;
 	}
 
-	them->pi_ppid = 0;
 	pi_drop(them->pi_pid);
-
-	lock_release(pidlock);
 	return 0;
 }
@@ -38,19 +38,28 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * Besides the kernel process, user processes can have more than one
+ * thread; extra ones are made with threadfork().
  */
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
 #include <spl.h>
+#include <lib.h>
+#include <wchan.h>
+#include <synch.h>
 #include <proc.h>
 #include <current.h>
+#include <clock.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <syscall.h>
+
+/* Largest user thread id before they wrap around. */
+#define TID_MAX 0x7fffffff
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -76,9 +85,27 @@ proc_create(const char *name)
 		return NULL;
 	}
 
+	proc->p_wchan = wchan_create(proc->p_name);
+	if (proc->p_wchan == NULL) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+
 	threadarray_init(&proc->p_threads);
 	spinlock_init(&proc->p_lock);
 	proc->p_pid = INVALID_PID;
+	proc->p_affinity = CPUMASK_ALL;
+	proc->p_pri = PRI_DEFAULT;
+
+	/* resource usage */
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
+
+	/* user threads */
+	proc->p_uthreads = NULL;
+	proc->p_nexttid = 1;
+	proc->p_exiting = false;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
@@ -174,8 +201,17 @@ proc_destroy(struct proc *proc)
 		as_destroy(as);
 	}
 
+	/* Exit records nobody joined */
+	while (proc->p_uthreads != NULL) {
+		struct uthread *ut = proc->p_uthreads;
+
+		proc->p_uthreads = ut->ut_next;
+		kfree(ut);
+	}
+
 	KASSERT(proc->p_pid == INVALID_PID);
 	threadarray_cleanup(&proc->p_threads);
+	wchan_destroy(proc->p_wchan);
 	spinlock_cleanup(&proc->p_lock);
 
 	kfree(proc->p_name);
@@ -228,15 +264,17 @@ proc_create_runprogram(const char *name, struct proc **ret)
 	/* VFS fields */
 
 	/*
-	 * Lock the current process to copy its current directory.
-	 * (We don't need to lock the new process, though, as we have
-	 * the only reference to it.)
+	 * Lock the current process to copy its current directory, CPU
+	 * affinity and priority. (We don't need to lock the new
+	 * process, though, as we have the only reference to it.)
 	 */
 	spinlock_acquire(&curproc->p_lock);
 	if (curproc->p_cwd != NULL) {
 		VOP_INCREF(curproc->p_cwd);
 		newproc->p_cwd = curproc->p_cwd;
 	}
+	newproc->p_affinity = curproc->p_affinity;
+	newproc->p_pri = curproc->p_pri;
 	spinlock_release(&curproc->p_lock);
 
 	*ret = newproc;
@@ -309,15 +347,17 @@ proc_fork(struct proc **ret)
 	}
 
 	/*
-	 * Lock the current process to copy its current directory.
-	 * (We don't need to lock the new process, though, as we have
-	 * the only reference to it.)
+	 * Lock the current process to copy its current directory, CPU
+	 * affinity and priority. (We don't need to lock the new
+	 * process, though, as we have the only reference to it.)
 	 */
 	spinlock_acquire(&curproc->p_lock);
 	if (curproc->p_cwd != NULL) {
 		VOP_INCREF(curproc->p_cwd);
 		newproc->p_cwd = curproc->p_cwd;
 	}
+	newproc->p_affinity = curproc->p_affinity;
+	newproc->p_pri = curproc->p_pri;
 	spinlock_release(&curproc->p_lock);
 
 	*ret = newproc;
@@ -335,19 +375,247 @@ proc_unfork(struct proc *newproc)
 	proc_destroy(newproc);
 }
 
+/*
+ * Detach the current thread from its process, which is exiting, and
+ * let it die.
+ */
+static
+__DEAD
+void
+proc_threadleave(void)
+{
+	/* This wakes up the exiting thread if we're the last. */
+	proc_remthread(curthread);
+	proc_addthread(kproc, curthread);
+	thread_exit();
+}
+
+/*
+ * Add one set of thread usage counts to another.
+ */
+static
+void
+threadusage_add(struct threadusage *to, const struct threadusage *from)
+{
+	to->tu_uticks += from->tu_uticks;
+	to->tu_sticks += from->tu_sticks;
+	to->tu_minflt += from->tu_minflt;
+	to->tu_inblock += from->tu_inblock;
+	to->tu_oublock += from->tu_oublock;
+	to->tu_nvcsw += from->tu_nvcsw;
+	to->tu_nivcsw += from->tu_nivcsw;
+}
+
+/*
+ * Convert a count of clock ticks to a timeval.
+ */
+static
+void
+ticks_to_timeval(unsigned ticks, struct timeval *tv)
+{
+	tv->tv_sec = ticks / HZ;
+	tv->tv_usec = (ticks % HZ) * (1000000 / HZ);
+}
+
+/*
+ * Add one timeval to another.
+ */
+static
+void
+timeval_add(struct timeval *to, const struct timeval *from)
+{
+	to->tv_sec += from->tv_sec;
+	to->tv_usec += from->tv_usec;
+	if (to->tv_usec >= 1000000) {
+		to->tv_usec -= 1000000;
+		to->tv_sec++;
+	}
+}
+
+/*
+ * Add one rusage to another. Only the fields we keep are touched.
+ */
+static
+void
+rusage_add(struct rusage *to, const struct rusage *from)
+{
+	timeval_add(&to->ru_utime, &from->ru_utime);
+	timeval_add(&to->ru_stime, &from->ru_stime);
+	to->ru_minflt += from->ru_minflt;
+	to->ru_majflt += from->ru_majflt;
+	to->ru_inblock += from->ru_inblock;
+	to->ru_oublock += from->ru_oublock;
+	to->ru_nvcsw += from->ru_nvcsw;
+	to->ru_nivcsw += from->ru_nivcsw;
+}
+
+/*
+ * Get resource usage. For RUSAGE_SELF that's what threads that have
+ * left the process used plus what the ones still in it have used so
+ * far. The counters of running threads are read without stopping
+ * them, so the result can be a tick behind.
+ *
+ * Nothing here pages, so there are no major faults, and there's no
+ * block cache, so each read or write call counts as one block.
+ */
+void
+proc_getrusage(struct proc *proc, int who, struct rusage *ru)
+{
+	struct threadusage tu;
+	unsigned i, num;
+
+	KASSERT(who == RUSAGE_SELF || who == RUSAGE_CHILDREN);
+
+	spinlock_acquire(&proc->p_lock);
+	if (who == RUSAGE_CHILDREN) {
+		*ru = proc->p_cusage;
+		spinlock_release(&proc->p_lock);
+		return;
+	}
+	tu = proc->p_usage;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		threadusage_add(&tu,
+				&threadarray_get(&proc->p_threads, i)->t_usage);
+	}
+	spinlock_release(&proc->p_lock);
+
+	bzero(ru, sizeof(*ru));
+	ticks_to_timeval(tu.tu_uticks, &ru->ru_utime);
+	ticks_to_timeval(tu.tu_sticks, &ru->ru_stime);
+	ru->ru_minflt = tu.tu_minflt;
+	ru->ru_inblock = tu.tu_inblock;
+	ru->ru_oublock = tu.tu_oublock;
+	ru->ru_nvcsw = tu.tu_nvcsw;
+	ru->ru_nivcsw = tu.tu_nivcsw;
+}
+
+/*
+ * Charge the usage of a child we just waited for to ourselves.
+ */
+void
+proc_addchildusage(const struct rusage *ru)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proc->p_lock);
+	rusage_add(&proc->p_cusage, ru);
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Interruptible sleeps. The thread records where it's going to sleep
+ * under p_lock before taking the wait channel's spinlock, and clears
+ * it after letting go of that lock, so it never holds both and the
+ * order p_lock, then the channel lock, is safe. While the record is
+ * there the thread can't have left the sleep, so the object the
+ * channel belongs to is still around.
+ */
+int
+proc_intr_begin(struct wchan *wc, struct spinlock *lk)
+{
+	struct proc *proc = curproc;
+
+	KASSERT(curthread->t_intrwchan == NULL);
+
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_exiting) {
+		spinlock_release(&proc->p_lock);
+		return EINTR;
+	}
+	curthread->t_intrwchan = wc;
+	curthread->t_intrlock = lk;
+	spinlock_release(&proc->p_lock);
+	return 0;
+}
+
+void
+proc_intr_end(void)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proc->p_lock);
+	curthread->t_intrwchan = NULL;
+	curthread->t_intrlock = NULL;
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Wake every thread of PROC that's in an interruptible sleep. Called
+ * by proc_exit with p_lock held, after setting p_exiting. A thread
+ * that isn't on its channel yet will see p_exiting when it takes the
+ * channel lock and not go to sleep.
+ */
+static
+void
+proc_intr_wakeall(struct proc *proc)
+{
+	struct thread *t;
+	unsigned i, num;
+
+	KASSERT(spinlock_do_i_hold(&proc->p_lock));
+	KASSERT(proc->p_exiting);
+
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t->t_intrwchan == NULL) {
+			continue;
+		}
+		spinlock_acquire(t->t_intrlock);
+		wchan_wakethread(t->t_intrwchan, t->t_intrlock, t);
+		spinlock_release(t->t_intrlock);
+	}
+}
+
 /*
  * Make the current process exit.
+ *
+ * Any other threads in the process are made to exit first: they
+ * notice p_exiting on their way back to user mode (see
+ * proc_exitcheck) and leave, and we wait until they're all gone.
+ * Threads sleeping in futex or threadjoin, or in an interruptible
+ * sleep (reading a pipe or the console, in waitpid), are woken up
+ * and fail with EINTR; ones blocked elsewhere in the kernel leave
+ * when whatever they're doing finishes. If another thread is already
+ * taking the process down, just leave quietly.
  */
 void
 proc_exit(int status)
 {
 	struct proc *proc = curproc;
+	struct rusage ru, cru;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
-	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_exiting) {
+		spinlock_release(&proc->p_lock);
+		proc_threadleave();
+	}
+	proc->p_exiting = true;
+	wchan_wakeall(proc->p_wchan, &proc->p_lock);
+	proc_intr_wakeall(proc);
+	spinlock_release(&proc->p_lock);
+
+	futex_wakeall(proc_getas());
+
+	spinlock_acquire(&proc->p_lock);
+	while (threadarray_num(&proc->p_threads) > 1) {
+		wchan_sleep(proc->p_wchan, &proc->p_lock);
+	}
+	spinlock_release(&proc->p_lock);
+
+	/*
+	 * Set exit status and wake up anyone waiting for us. What
+	 * the parent collects with our status covers us and all our
+	 * children that we waited for.
+	 */
+	proc_getrusage(proc, RUSAGE_SELF, &ru);
+	proc_getrusage(proc, RUSAGE_CHILDREN, &cru);
+	rusage_add(&ru, &cru);
+	pid_setexitstatus(status, &ru);
 
 	/* Detach from the process and attach to the kernel process. */
 	KASSERT(curthread->t_proc == proc);
@@ -392,6 +660,38 @@ proc_addthread(struct proc *proc, struct thread *t)
 	return 0;
 }
 
+/*
+ * Take a thread out of a process's thread array, moving its resource
+ * usage into the process's. If the process is exiting, wake up the
+ * thread waiting for the others to leave. The caller must hold the
+ * process lock.
+ */
+static
+void
+proc_unlinkthread(struct proc *proc, struct thread *t)
+{
+	unsigned i, num;
+
+	KASSERT(spinlock_do_i_hold(&proc->p_lock));
+
+	/* ugh: find the thread in the array */
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		if (threadarray_get(&proc->p_threads, i) == t) {
+			threadarray_remove(&proc->p_threads, i);
+			threadusage_add(&proc->p_usage, &t->t_usage);
+			bzero(&t->t_usage, sizeof(t->t_usage));
+			if (proc->p_exiting) {
+				wchan_wakeall(proc->p_wchan, &proc->p_lock);
+			}
+			return;
+		}
+	}
+	/* Did not find it. */
+	spinlock_release(&proc->p_lock);
+	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
+}
+
 /*
  * Remove a thread from its process. Either the thread or the process
  * might or might not be current.
@@ -405,28 +705,245 @@ void
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
-	unsigned i, num;
 	int spl;
 
 	proc = t->t_proc;
 	KASSERT(proc != NULL);
 
 	spinlock_acquire(&proc->p_lock);
-	/* ugh: find the thread in the array */
-	num = threadarray_num(&proc->p_threads);
-	for (i=0; i<num; i++) {
-		if (threadarray_get(&proc->p_threads, i) == t) {
-			threadarray_remove(&proc->p_threads, i);
+	proc_unlinkthread(proc, t);
+	spinlock_release(&proc->p_lock);
+
+	spl = splhigh();
+	t->t_proc = NULL;
+	splx(spl);
+}
+
+/*
+ * Allocate an exit record, and with it a thread id, for a new user
+ * thread in PROC. Thread ids count up from 1 and skip any still in
+ * use when they wrap around.
+ */
+int
+proc_newuthread(struct proc *proc, struct uthread **ret)
+{
+	struct uthread *ut, *other;
+
+	ut = kmalloc(sizeof(*ut));
+	if (ut == NULL) {
+		return ENOMEM;
+	}
+	ut->ut_exited = false;
+	ut->ut_status = 0;
+
+	spinlock_acquire(&proc->p_lock);
+ again:
+	ut->ut_tid = proc->p_nexttid;
+	proc->p_nexttid = (proc->p_nexttid == TID_MAX) ?
+		1 : proc->p_nexttid + 1;
+	for (other = proc->p_uthreads; other != NULL; other = other->ut_next) {
+		if (other->ut_tid == ut->ut_tid) {
+			goto again;
+		}
+	}
+	ut->ut_next = proc->p_uthreads;
+	proc->p_uthreads = ut;
+	spinlock_release(&proc->p_lock);
+
+	*ret = ut;
+	return 0;
+}
+
+/*
+ * Find the link pointing at the exit record for thread TID. The
+ * caller must hold the process lock. Returns a pointer to the null
+ * at the end of the list if there's no such record.
+ */
+static
+struct uthread **
+proc_finduthread(struct proc *proc, int tid)
+{
+	struct uthread **pp;
+
+	KASSERT(spinlock_do_i_hold(&proc->p_lock));
+
+	for (pp = &proc->p_uthreads; *pp != NULL; pp = &(*pp)->ut_next) {
+		if ((*pp)->ut_tid == tid) {
+			break;
+		}
+	}
+	return pp;
+}
+
+/*
+ * Undo proc_newuthread if the thread never ran.
+ */
+void
+proc_unnewuthread(struct proc *proc, struct uthread *ut)
+{
+	struct uthread **pp;
+
+	spinlock_acquire(&proc->p_lock);
+	pp = proc_finduthread(proc, ut->ut_tid);
+	KASSERT(*pp == ut);
+	*pp = ut->ut_next;
+	spinlock_release(&proc->p_lock);
+	kfree(ut);
+}
+
+/*
+ * Make the current user thread exit without taking the process with
+ * it. Its exit record is filled in for threadjoin. The last thread
+ * out turns into a process exit. Deciding that and taking ourselves
+ * out of the process happen under the same lock hold, so two
+ * threads exiting together can't both think someone else is last.
+ */
+void
+proc_threadexit(int status)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	int spl;
+
+	KASSERT(proc != kproc);
+
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_exiting) {
+		spinlock_release(&proc->p_lock);
+		proc_threadleave();
+	}
+	if (threadarray_num(&proc->p_threads) == 1) {
+		spinlock_release(&proc->p_lock);
+		proc_exit(_MKWAIT_EXIT(status));
+		thread_exit();
+	}
+
+	if (curthread->t_tid != 0) {
+		ut = *proc_finduthread(proc, curthread->t_tid);
+		KASSERT(ut != NULL);
+		ut->ut_exited = true;
+		ut->ut_status = status;
+		wchan_wakeall(proc->p_wchan, &proc->p_lock);
+	}
+	proc_unlinkthread(proc, curthread);
+	spinlock_release(&proc->p_lock);
+
+	spl = splhigh();
+	curthread->t_proc = NULL;
+	splx(spl);
+
+	proc_addthread(kproc, curthread);
+	thread_exit();
+}
+
+/*
+ * Called on the way back to user mode: if another thread is making
+ * the process exit, go away instead.
+ */
+void
+proc_exitcheck(void)
+{
+	struct proc *proc = curproc;
+
+	if (proc != NULL && proc->p_exiting) {
+		proc_threadleave();
+	}
+}
+
+/*
+ * Wait for user thread TID of the current process to exit, collect
+ * its exit status, and free its record. A given thread can only be
+ * joined once; after that its id is unknown (ESRCH). If the process
+ * starts exiting while we wait, give up with EINTR.
+ */
+int
+proc_threadjoin(int tid, int *status)
+{
+	struct proc *proc = curproc;
+	struct uthread **pp, *ut;
+
+	if (tid <= 0) {
+		return ESRCH;
+	}
+	if (tid == curthread->t_tid) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&proc->p_lock);
+	while (1) {
+		pp = proc_finduthread(proc, tid);
+		ut = *pp;
+		if (ut == NULL) {
 			spinlock_release(&proc->p_lock);
-			spl = splhigh();
-			t->t_proc = NULL;
-			splx(spl);
-			return;
+			return ESRCH;
+		}
+		if (ut->ut_exited) {
+			break;
 		}
+		if (proc->p_exiting) {
+			spinlock_release(&proc->p_lock);
+			return EINTR;
+		}
+		wchan_sleep(proc->p_wchan, &proc->p_lock);
+	}
+	*pp = ut->ut_next;
+	spinlock_release(&proc->p_lock);
+
+	*status = ut->ut_status;
+	kfree(ut);
+	return 0;
+}
+
+/*
+ * Set the CPU affinity of a process. The mask applies to the threads
+ * already in the process and is inherited by threads created in it
+ * later (including by fork). Bits for CPUs that aren't online are
+ * dropped; it is an error if none are left.
+ *
+ * The new mask is enforced by the thread code the next time each
+ * thread is scheduled; see thread_make_runnable.
+ */
+int
+proc_setaffinity(struct proc *proc, cpumask_t mask)
+{
+	unsigned i, num;
+
+	mask &= thread_onlinecpus();
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&proc->p_lock);
+	proc->p_affinity = mask;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		threadarray_get(&proc->p_threads, i)->t_affinity = mask;
+	}
+	spinlock_release(&proc->p_lock);
+
+	return 0;
+}
+
+/*
+ * Set the priority of a process: that of its threads, and of threads
+ * created in it later (including by fork). Threads holding contended
+ * locks may keep running at a higher inherited priority until they
+ * release them.
+ */
+void
+proc_setpriority(struct proc *proc, int pri)
+{
+	unsigned i, num;
+
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	spinlock_acquire(&proc->p_lock);
+	proc->p_pri = pri;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		lock_setbasepri(threadarray_get(&proc->p_threads, i), pri);
 	}
-	/* Did not find it. */
 	spinlock_release(&proc->p_lock);
-	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 }
 
 /*
@@ -37,8 +37,10 @@
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
+#include <thread.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
@@ -105,19 +107,66 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * pipe() - make a pipe and put its read and write ends in the file
+ * table, and hand back the two file descriptors.
+ */
+int
+sys_pipe(userptr_t fdsptr)
+{
+	struct filetable *ft;
+	struct openfile *readfile, *writefile;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = openfile_pipe(&readfile, &writefile);
+	if (result) {
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		filetable_unplace(ft, fds[0], readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		/* take them back out, if nobody beat us to it */
+		filetable_unplace(ft, fds[1], writefile);
+		filetable_unplace(ft, fds[0], readfile);
+		return result;
+	}
+
+	return 0;
+}
+
+/*
+ * Common logic for read and write, pread and pwrite, and the
+ * vectored versions of all those.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on the IOVCNT user
+ * buffers in IOV, which add up to SIZE bytes. If POSITIONAL, do the
+ * I/O at POS and leave the seek position (and its lock) alone, so
+ * that I/O through the same openfile by other threads or other
+ * processes can go on at the same time.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite(int fd, struct iovec *iov, unsigned iovcnt, size_t size,
+	      enum uio_rw rw, int badaccmode, bool positional, off_t pos,
+	      ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
 	struct uio useruio;
 	int result;
 
@@ -128,13 +177,26 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	}
 
 	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
-		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+	if (positional) {
+		locked = false;
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			result = ESPIPE;
+			goto fail;
+		}
+		if (pos < 0) {
+			result = EINVAL;
+			goto fail;
+		}
 	}
 	else {
-		pos = 0;
+		locked = VOP_ISSEEKABLE(file->of_vnode);
+		if (locked) {
+			lock_acquire(file->of_offsetlock);
+			pos = file->of_offset;
+		}
+		else {
+			pos = 0;
+		}
 	}
 
 	if (file->of_accmode == badaccmode) {
@@ -142,8 +204,14 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* set up a uio with the buffers, their size, and the offset */
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_offset = pos;
+	useruio.uio_resid = size;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
 
 	/* do the read or write */
 	result = (rw == UIO_READ) ?
@@ -167,6 +235,14 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	 */
 	*retval = size - useruio.uio_resid;
 
+	/* There's no block cache; count each call as one block. */
+	if (rw == UIO_READ) {
+		curthread->t_usage.tu_inblock++;
+	}
+	else {
+		curthread->t_usage.tu_oublock++;
+	}
+
 	return 0;
 
 fail:
@@ -178,21 +254,158 @@ fail:
 }
 
 /*
- * read() - use sys_readwrite
+ * Do I/O on one user buffer.
+ */
+static
+int
+sys_readwrite1(int fd, userptr_t buf, size_t size, enum uio_rw rw,
+	       int badaccmode, bool positional, off_t pos, ssize_t *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, size, rw, badaccmode,
+			     positional, pos, retval);
+}
+
+/* Vectored I/O with up to this many buffers needs no kmalloc. */
+#define SMALLIOV	8
+
+/* The most vectored I/O can do at once: what fits in a ssize_t. */
+#define IOVTOTAL_MAX	((size_t)-1 >> 1)
+
+/*
+ * Do I/O on an array of IOVCNT user buffers at UIOV. The array is
+ * copied in all at once, and the I/O is one VOP call.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, bool positional, off_t pos, ssize_t *retval)
+{
+	struct iovec smalliov[SMALLIOV];
+	struct iovec *iov;
+	size_t size;
+	int i;
+	int result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= SMALLIOV) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	/* kernel and user iovecs are the same apart from the name */
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto done;
+	}
+
+	size = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > IOVTOTAL_MAX - size) {
+			result = EINVAL;
+			goto done;
+		}
+		size += iov[i].iov_len;
+	}
+
+	result = sys_readwrite(fd, iov, iovcnt, size, rw, badaccmode,
+			       positional, pos, retval);
+done:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+/*
+ * read() - use sys_readwrite1
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	return sys_readwrite1(fd, buf, size, UIO_READ, O_WRONLY,
+			      false, 0, retval);
 }
 
 /*
- * write() - use sys_readwrite
+ * write() - use sys_readwrite1
  */
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	return sys_readwrite1(fd, buf, size, UIO_WRITE, O_RDONLY,
+			      false, 0, retval);
+}
+
+/*
+ * pread() - use sys_readwrite1
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite1(fd, buf, size, UIO_READ, O_WRONLY,
+			      true, pos, retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite1
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite1(fd, buf, size, UIO_WRITE, O_RDONLY,
+			      true, pos, retval);
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY,
+			      false, 0, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY,
+			      false, 0, retval);
+}
+
+/*
+ * preadv() - use sys_readwritev
+ */
+int
+sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY,
+			      true, pos, retval);
+}
+
+/*
+ * pwritev() - use sys_readwritev
+ */
+int
+sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY,
+			      true, pos, retval);
 }
 
 /*
@@ -203,16 +416,23 @@ sys_close(int fd)
 {
 	struct filetable *ft;
 	struct openfile *file;
+	int result;
 
 	ft = curproc->p_filetable;
 
-	/* check if the file's in range before calling placeat */
-	if (!filetable_okfd(ft, fd)) {
+	/*
+	 * check if the file's in range before calling placeat; don't
+	 * use okfd, as files above a lowered limit can still be closed
+	 */
+	if (fd < 0 || fd >= NOFILE_MAX) {
 		return EBADF;
 	}
 
 	/* place null in the filetable and get the file previously there */
-	filetable_placeat(ft, NULL, fd, &file);
+	result = filetable_placeat(ft, NULL, fd, &file);
+	if (result) {
+		return result;
+	}
 
 	if (file == NULL) {
 		/* oops, it wasn't open, that's an error */
@@ -288,6 +508,29 @@ sys_lseek(int fd, off_t offset, int whence, off_t *retval)
 	return 0;
 }
 
+/*
+ * ioctl() - miscellaneous operations on a file. Hand them to the
+ * vnode, along with the access mode the file was opened with; it's
+ * up to the vnode to decide what each operation needs. There is no
+ * offset involved, so the offset lock isn't taken.
+ */
+int
+sys_ioctl(int fd, int code, userptr_t data)
+{
+	struct openfile *file;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &file);
+	if (result) {
+		return result;
+	}
+
+	result = VOP_IOCTL(file->of_vnode, code, data, file->of_accmode);
+
+	filetable_put(curproc->p_filetable, fd, file);
+	return result;
+}
+
 /*
  * dup2() - clone a file descriptor.
  */
@@ -321,7 +564,11 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	filetable_put(ft, oldfd, oldfdfile);
 
 	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
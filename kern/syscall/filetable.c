@@ -33,11 +33,258 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <limits.h>
 #include <lib.h>
 #include <openfile.h>
 #include <filetable.h>
 
 
+/* Slots a table starts with; sizes are always multiples of 32. */
+#define FILESLOTS_MIN	32
+
+/*
+ * Index of the lowest clear bit in a word that has one.
+ */
+static
+unsigned
+lowclear(uint32_t word)
+{
+	unsigned bit = 0;
+
+	KASSERT(word != 0xffffffff);
+	word = ~word;
+	if ((word & 0xffff) == 0) {
+		word >>= 16;
+		bit += 16;
+	}
+	if ((word & 0xff) == 0) {
+		word >>= 8;
+		bit += 8;
+	}
+	if ((word & 0xf) == 0) {
+		word >>= 4;
+		bit += 4;
+	}
+	if ((word & 0x3) == 0) {
+		word >>= 2;
+		bit += 2;
+	}
+	if ((word & 0x1) == 0) {
+		bit += 1;
+	}
+	return bit;
+}
+
+/*
+ * Create an empty set of MAX slots. The slots and both bitmaps come
+ * in one allocation with the structure.
+ */
+static
+struct fileslots *
+fileslots_create(unsigned max)
+{
+	struct fileslots *fs;
+	unsigned ninuse, nfull, i;
+
+	KASSERT(max % 32 == 0);
+	ninuse = max / 32;
+	nfull = DIVROUNDUP(ninuse, 32);
+
+	fs = kmalloc(sizeof(struct fileslots)
+		     + max * sizeof(struct openfile *)
+		     + (ninuse + nfull) * sizeof(uint32_t));
+	if (fs == NULL) {
+		return NULL;
+	}
+	fs->fs_openfiles = (struct openfile **)(fs + 1);
+	fs->fs_inuse = (uint32_t *)(fs->fs_openfiles + max);
+	fs->fs_full = fs->fs_inuse + ninuse;
+
+	spinlock_init(&fs->fs_reflock);
+	fs->fs_refcount = 1;
+	fs->fs_max = max;
+	for (i = 0; i < max; i++) {
+		fs->fs_openfiles[i] = NULL;
+	}
+	for (i = 0; i < ninuse; i++) {
+		fs->fs_inuse[i] = 0;
+	}
+	for (i = 0; i < nfull; i++) {
+		fs->fs_full[i] = 0;
+	}
+	/* fs_inuse words past the end count as full so they're skipped */
+	if (ninuse % 32 != 0) {
+		fs->fs_full[nfull - 1] = 0xffffffff << (ninuse % 32);
+	}
+
+	return fs;
+}
+
+/*
+ * Put a file (or NULL) in a slot, keeping the bitmaps up to date.
+ */
+static
+void
+fileslots_set(struct fileslots *fs, unsigned fd, struct openfile *file)
+{
+	unsigned word = fd / 32;
+	uint32_t bit = (uint32_t)1 << (fd % 32);
+
+	KASSERT(fd < fs->fs_max);
+	fs->fs_openfiles[fd] = file;
+	if (file != NULL) {
+		fs->fs_inuse[word] |= bit;
+		if (fs->fs_inuse[word] == 0xffffffff) {
+			fs->fs_full[word / 32] |= (uint32_t)1 << (word % 32);
+		}
+	}
+	else {
+		fs->fs_inuse[word] &= ~bit;
+		fs->fs_full[word / 32] &= ~((uint32_t)1 << (word % 32));
+	}
+}
+
+/*
+ * Find the lowest free slot. Returns -1 if they're all in use.
+ */
+static
+int
+fileslots_lowestfree(struct fileslots *fs)
+{
+	unsigned nfull, i, word;
+
+	nfull = DIVROUNDUP(fs->fs_max / 32, 32);
+	for (i = 0; i < nfull; i++) {
+		if (fs->fs_full[i] != 0xffffffff) {
+			word = i * 32 + lowclear(fs->fs_full[i]);
+			return word * 32 + lowclear(fs->fs_inuse[word]);
+		}
+	}
+	return -1;
+}
+
+/*
+ * Add a filetable to the users of a set of slots.
+ */
+static
+void
+fileslots_incref(struct fileslots *fs)
+{
+	spinlock_acquire(&fs->fs_reflock);
+	fs->fs_refcount++;
+	spinlock_release(&fs->fs_reflock);
+}
+
+/*
+ * Drop a filetable's use of a set of slots. The last one out closes
+ * the files. This can sleep (in the VFS, closing files) so it mustn't
+ * be called with ft_lock held.
+ */
+static
+void
+fileslots_decref(struct fileslots *fs)
+{
+	unsigned fd;
+
+	spinlock_acquire(&fs->fs_reflock);
+	KASSERT(fs->fs_refcount > 0);
+	fs->fs_refcount--;
+	if (fs->fs_refcount > 0) {
+		spinlock_release(&fs->fs_reflock);
+		return;
+	}
+	spinlock_release(&fs->fs_reflock);
+
+	/* Close any open files. */
+	for (fd = 0; fd < fs->fs_max; fd++) {
+		if (fs->fs_openfiles[fd] != NULL) {
+			openfile_decref(fs->fs_openfiles[fd]);
+			fs->fs_openfiles[fd] = NULL;
+		}
+	}
+	spinlock_cleanup(&fs->fs_reflock);
+	kfree(fs);
+}
+
+/*
+ * Check if a set of slots is shared with another filetable.
+ */
+static
+bool
+fileslots_shared(struct fileslots *fs)
+{
+	bool ret;
+
+	spinlock_acquire(&fs->fs_reflock);
+	ret = fs->fs_refcount > 1;
+	spinlock_release(&fs->fs_reflock);
+	return ret;
+}
+
+/*
+ * Lock a filetable for changing it, with at least MINSLOTS slots.
+ * If its slots are shared, or too few, replace them with a private
+ * copy first; a copy to grow the table is twice as big (or more, if
+ * needed). Returns with ft_lock held, unless it fails.
+ *
+ * The copy has to be allocated without holding the lock, so another
+ * thread might unshare or grow the table (or fork, sharing it again)
+ * in the meantime; go around again until it's right.
+ */
+static
+int
+filetable_lockprivate(struct filetable *ft, unsigned minslots)
+{
+	struct fileslots *old, *new;
+	struct openfile *file;
+	unsigned fd, max;
+
+	KASSERT(minslots <= NOFILE_MAX);
+
+	spinlock_acquire(&ft->ft_lock);
+	while (fileslots_shared(ft->ft_slots) ||
+	       ft->ft_slots->fs_max < minslots) {
+		old = ft->ft_slots;
+		max = old->fs_max;
+		while (max < minslots) {
+			max *= 2;
+		}
+		if (max > NOFILE_MAX) {
+			max = NOFILE_MAX;
+		}
+		spinlock_release(&ft->ft_lock);
+
+		new = fileslots_create(max);
+		if (new == NULL) {
+			return ENOMEM;
+		}
+
+		spinlock_acquire(&ft->ft_lock);
+		if (ft->ft_slots != old) {
+			/* someone beat us to it; this one's empty */
+			spinlock_release(&ft->ft_lock);
+			fileslots_decref(new);
+			spinlock_acquire(&ft->ft_lock);
+			continue;
+		}
+
+		/* the copy holds its own references to the files */
+		for (fd = 0; fd < old->fs_max; fd++) {
+			file = old->fs_openfiles[fd];
+			if (file != NULL) {
+				openfile_incref(file);
+				fileslots_set(new, fd, file);
+			}
+		}
+		ft->ft_slots = new;
+		spinlock_release(&ft->ft_lock);
+
+		fileslots_decref(old);
+		spinlock_acquire(&ft->ft_lock);
+	}
+	return 0;
+}
+
 /*
  * Construct a filetable.
  */
@@ -45,7 +292,6 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
@@ -53,10 +299,16 @@ filetable_create(void)
 	}
 
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
+	ft->ft_slots = fileslots_create(FILESLOTS_MIN);
+	if (ft->ft_slots == NULL) {
+		kfree(ft);
+		return NULL;
 	}
 
+	spinlock_init(&ft->ft_lock);
+	ft->ft_limit = OPEN_MAX;
+	ft->ft_hardlimit = NOFILE_MAX;
+
 	return ft;
 }
 
@@ -66,17 +318,12 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
-
 	KASSERT(ft != NULL);
 
-	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
-			openfile_decref(ft->ft_openfiles[fd]);
-			ft->ft_openfiles[fd] = NULL;
-		}
-	}
+	/* Close any open files, unless still shared. */
+	fileslots_decref(ft->ft_slots);
+	ft->ft_slots = NULL;
+	spinlock_cleanup(&ft->ft_lock);
 	kfree(ft);
 }
 
@@ -94,13 +341,14 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * The slots holding them are shared too, until one side changes
+ * them; see filetable_lockprivate. The limits are inherited.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
-	struct openfile *file;
-	int fd;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,34 +356,33 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = kmalloc(sizeof(struct filetable));
 	if (dest == NULL) {
 		return ENOMEM;
 	}
+	spinlock_init(&dest->ft_lock);
 
-	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		file = src->ft_openfiles[fd];
-		if (file != NULL) {
-			openfile_incref(file);
-		}
-		dest->ft_openfiles[fd] = file;
-	}
+	/* share the slots */
+	spinlock_acquire(&src->ft_lock);
+	dest->ft_slots = src->ft_slots;
+	fileslots_incref(dest->ft_slots);
+	dest->ft_limit = src->ft_limit;
+	dest->ft_hardlimit = src->ft_hardlimit;
+	spinlock_release(&src->ft_lock);
 
 	*dest_ret = dest;
 	return 0;
 }
 
 /*
- * Check if a file handle is in range.
+ * Check if a file handle is in range: that is, below the limit on
+ * open files. (Files opened before the limit was lowered can stay
+ * open above it, and filetable_get still finds them.)
  */
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
-	(void)ft;
-
-	return (fd >= 0 && fd < OPEN_MAX);
+	return (fd >= 0 && (unsigned)fd < ft->ft_limit);
 }
 
 /*
@@ -151,40 +398,43 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
 	struct openfile *file;
 
-	if (!filetable_okfd(ft, fd)) {
+	if (fd < 0) {
 		return EBADF;
 	}
 
-	file = ft->ft_openfiles[fd];
+	spinlock_acquire(&ft->ft_lock);
+	if ((unsigned)fd >= ft->ft_slots->fs_max) {
+		spinlock_release(&ft->ft_lock);
+		return EBADF;
+	}
+	file = ft->ft_slots->fs_openfiles[fd];
 	if (file == NULL) {
+		spinlock_release(&ft->ft_lock);
 		return EBADF;
 	}
+	openfile_incref(file);
+	spinlock_release(&ft->ft_lock);
 
 	*ret = file;
 	return 0;
 }
 
 /*
- * Put a file handle back when done with it. This does not actually do
- * anything (other than crosscheck) but it's always good practice to
- * build things so when you take them out you put them back again
- * rather than dropping them on the floor. Then if you need to do
- * something at cleanup time you can put it in this function instead
- * of having to hunt for all the places to insert the new logic.
- *
- * (For example, if you have multithreaded processes you will need to
- * insert additional lock and/or refcount manipulations here and in
- * filetable_get.)
+ * Put a file handle back when done with it. This drops the reference
+ * filetable_get took. The slot may no longer hold the file by now,
+ * if another thread in the process closed or replaced it meanwhile;
+ * that's fine, as the reference kept the file alive until here.
  *
  * The openfile should be the one returned from filetable_get. If you
- * want to manipulate the table so the assertion's no longer true, get
- * your own reference to the openfile (with openfile_incref) and call
- * filetable_put before mucking about.
+ * want to keep the file beyond the put, get your own reference to it
+ * (with openfile_incref) first.
  */
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
-	KASSERT(ft->ft_openfiles[fd] == file);
+	(void)ft;
+	KASSERT(fd >= 0);
+	openfile_decref(file);
 }
 
 /*
@@ -192,7 +442,8 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
  * use the smallest available descriptor, because Unix works that way.
  * (Unix works that way because in the days before dup2 was invented,
  * the behavior had to be defined explicitly in order to allow
- * manipulating stdin/stdout/stderr.)
+ * manipulating stdin/stdout/stderr.) If every slot is in use, grow
+ * the table, as far as the limit allows.
  *
  * Consumes a reference to the openfile object. (That reference is
  * placed in the table.)
@@ -200,15 +451,31 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
+	unsigned minslots;
 	int fd;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
+	minslots = 0;
+	while (1) {
+		result = filetable_lockprivate(ft, minslots);
+		if (result) {
+			return result;
+		}
+		fd = fileslots_lowestfree(ft->ft_slots);
+		if (fd >= 0 && (unsigned)fd < ft->ft_limit) {
+			fileslots_set(ft->ft_slots, fd, file);
+			spinlock_release(&ft->ft_lock);
 			*fd_ret = fd;
 			return 0;
 		}
+		if (fd >= 0 || ft->ft_slots->fs_max >= ft->ft_limit) {
+			break;
+		}
+		/* full, but we may have more; grow */
+		minslots = ft->ft_slots->fs_max + 1;
+		spinlock_release(&ft->ft_lock);
 	}
+	spinlock_release(&ft->ft_lock);
 
 	return EMFILE;
 }
@@ -221,17 +488,116 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails only if the table is shared after a fork, or has to grow,
+ * and can't be copied; then nothing is consumed or returned.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
-	KASSERT(filetable_okfd(ft, fd));
+	int result;
+
+	KASSERT(fd >= 0 && fd < NOFILE_MAX);
+
+	/*
+	 * Putting NULL in a slot that's already empty (as on close of
+	 * a bad fd) changes nothing, so check first, rather than copy
+	 * a table shared after fork just to find that out.
+	 */
+	if (newfile == NULL) {
+		spinlock_acquire(&ft->ft_lock);
+		if ((unsigned)fd >= ft->ft_slots->fs_max ||
+		    ft->ft_slots->fs_openfiles[fd] == NULL) {
+			spinlock_release(&ft->ft_lock);
+			*oldfile_ret = NULL;
+			return 0;
+		}
+		spinlock_release(&ft->ft_lock);
+	}
 
-	*oldfile_ret = ft->ft_openfiles[fd];
-	ft->ft_openfiles[fd] = newfile;
+	/* No need to grow the table to put NULL past the end */
+	result = filetable_lockprivate(ft, newfile != NULL ? fd + 1 : 0);
+	if (result) {
+		return result;
+	}
+	if ((unsigned)fd >= ft->ft_slots->fs_max) {
+		KASSERT(newfile == NULL);
+		*oldfile_ret = NULL;
+	}
+	else {
+		*oldfile_ret = ft->ft_slots->fs_openfiles[fd];
+		fileslots_set(ft->ft_slots, fd, newfile);
+	}
+	spinlock_release(&ft->ft_lock);
+	return 0;
+}
+
+/*
+ * Take FILE, which filetable_place put at FD, back out, for backing
+ * out of a syscall that failed after placing it. Another thread in
+ * the process may have closed the descriptor, or dup2'd something
+ * else onto it, in the meantime; then the slot isn't ours to clear,
+ * and whoever changed it already dealt with the reference.
+ *
+ * If the table is shared after a fork and there's no memory to copy
+ * it, the file stays in place; that's no worse than the other thread
+ * having dup'd it.
+ */
+void
+filetable_unplace(struct filetable *ft, int fd, struct openfile *file)
+{
+	KASSERT(fd >= 0 && fd < NOFILE_MAX);
+	KASSERT(file != NULL);
+
+	if (filetable_lockprivate(ft, 0)) {
+		return;
+	}
+	if ((unsigned)fd >= ft->ft_slots->fs_max ||
+	    ft->ft_slots->fs_openfiles[fd] != file) {
+		spinlock_release(&ft->ft_lock);
+		return;
+	}
+	fileslots_set(ft->ft_slots, fd, NULL);
+	spinlock_release(&ft->ft_lock);
+
+	openfile_decref(file);
+}
+
+/*
+ * Get the limits on open files.
+ */
+void
+filetable_getlimit(struct filetable *ft, unsigned *cur, unsigned *max)
+{
+	spinlock_acquire(&ft->ft_lock);
+	*cur = ft->ft_limit;
+	*max = ft->ft_hardlimit;
+	spinlock_release(&ft->ft_lock);
+}
+
+/*
+ * Set the limits on open files. Like on Unix without privileges, the
+ * hard limit can be lowered but not raised, and the soft limit can
+ * be set anywhere up to it. Lowering the soft limit doesn't close
+ * anything.
+ */
+int
+filetable_setlimit(struct filetable *ft, unsigned cur, unsigned max)
+{
+	if (cur > max) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	if (max > ft->ft_hardlimit) {
+		spinlock_release(&ft->ft_lock);
+		return EPERM;
+	}
+	ft->ft_limit = cur;
+	ft->ft_hardlimit = max;
+	spinlock_release(&ft->ft_lock);
+	return 0;
 }
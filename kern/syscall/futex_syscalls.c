@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futex() - sleeping on a user memory word.
+ *
+ * User-level locks and semaphores keep their state in ordinary
+ * memory and use atomic instructions on it; they only come into the
+ * kernel when they have to wait, or to wake someone up. A waiter is
+ * identified by its address space and the user address of the word.
+ *
+ * Waiters are kept in a fixed hash table of buckets. Each bucket has
+ * a spinlock, a wait channel, and a FIFO list of waiter records that
+ * live on the waiters' stacks. FUTEX_WAKE takes records off the list
+ * and wakes exactly those threads, so waiters on other addresses
+ * that hash to the same bucket are left alone.
+ *
+ * The word can't be read while holding the bucket spinlock (reading
+ * user memory may fault and sleep), so FUTEX_WAIT notes the bucket's
+ * wakeup count, reads the word, then locks the bucket; if there was
+ * a wakeup in the meantime, the word may have been changed under it
+ * and it starts over. Without this a FUTEX_WAKE could slip in
+ * between the check and the sleep and be lost.
+ *
+ * When a process exits, its waiters are woken with EINTR so the
+ * exiting thread isn't left waiting for them forever.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/futex.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_HASHSIZE	64
+
+struct futex_waiter {
+	struct addrspace *fw_as;	/* Address space */
+	userptr_t fw_addr;		/* User address waited on */
+	struct thread *fw_thread;	/* The waiting thread */
+	bool fw_woken;			/* Set by FUTEX_WAKE */
+	struct futex_waiter *fw_next;	/* Next in bucket */
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;
+	struct wchan *fb_wchan;
+	struct futex_waiter *fb_head;	/* Waiters, oldest first */
+	struct futex_waiter **fb_tailp;	/* Where to link the next one */
+	unsigned fb_wakeups;		/* Count of FUTEX_WAKE calls */
+};
+
+static struct futex_bucket futex_table[FUTEX_HASHSIZE];
+
+/*
+ * Setup function.
+ */
+void
+futex_bootstrap(void)
+{
+	struct futex_bucket *fb;
+	unsigned i;
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		fb = &futex_table[i];
+		spinlock_init(&fb->fb_lock);
+		fb->fb_wchan = wchan_create("futex");
+		if (fb->fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		fb->fb_head = NULL;
+		fb->fb_tailp = &fb->fb_head;
+		fb->fb_wakeups = 0;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, userptr_t uaddr)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)as ^ ((uint32_t)(uintptr_t)uaddr >> 2);
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return &futex_table[h % FUTEX_HASHSIZE];
+}
+
+/*
+ * Take a waiter record off its bucket. Bucket lock must be held.
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	struct futex_waiter **pp;
+
+	for (pp = &fb->fb_head; *pp != fw; pp = &(*pp)->fw_next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = fw->fw_next;
+	if (fb->fb_tailp == &fw->fw_next) {
+		fb->fb_tailp = pp;
+	}
+	fw->fw_next = NULL;
+}
+
+static
+int
+futex_wait(userptr_t uaddr, int val, const struct timespec *timeout)
+{
+	struct futex_waiter fw;
+	struct futex_bucket *fb;
+	unsigned wakeups;
+	int cur, result;
+
+	fw.fw_as = proc_getas();
+	fw.fw_addr = uaddr;
+	fw.fw_thread = curthread;
+	fw.fw_woken = false;
+	fw.fw_next = NULL;
+	fb = futex_hash(fw.fw_as, uaddr);
+
+	while (1) {
+		spinlock_acquire(&fb->fb_lock);
+		wakeups = fb->fb_wakeups;
+		spinlock_release(&fb->fb_lock);
+
+		result = copyin(uaddr, &cur, sizeof(cur));
+		if (result) {
+			return result;
+		}
+		if (cur != val) {
+			return EAGAIN;
+		}
+
+		spinlock_acquire(&fb->fb_lock);
+		if (fb->fb_wakeups == wakeups) {
+			break;
+		}
+		spinlock_release(&fb->fb_lock);
+	}
+
+	/*
+	 * Still holding the bucket lock: queue up and sleep. Check
+	 * for process exit after queueing; futex_wakeall sets
+	 * p_exiting before it takes the bucket locks, so either it
+	 * finds us here or we see the flag.
+	 */
+	*fb->fb_tailp = &fw;
+	fb->fb_tailp = &fw.fw_next;
+
+	result = 0;
+	if (curproc->p_exiting) {
+		/* nothing */
+	}
+	else if (timeout == NULL) {
+		while (!fw.fw_woken) {
+			wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+		}
+	}
+	else {
+		wchan_sleep_timeout(fb->fb_wchan, &fb->fb_lock,
+				    timeout_ticks(timeout));
+		if (!fw.fw_woken) {
+			result = ETIMEDOUT;
+		}
+	}
+	if (!fw.fw_woken) {
+		futex_unlink(fb, &fw);
+	}
+	if (curproc->p_exiting) {
+		result = EINTR;
+	}
+	spinlock_release(&fb->fb_lock);
+	return result;
+}
+
+static
+int
+futex_wake(userptr_t uaddr, int count, int *retval)
+{
+	struct addrspace *as;
+	struct futex_bucket *fb;
+	struct futex_waiter *fw, *next;
+	int n;
+
+	as = proc_getas();
+	fb = futex_hash(as, uaddr);
+
+	n = 0;
+	spinlock_acquire(&fb->fb_lock);
+	fb->fb_wakeups++;
+	for (fw = fb->fb_head; fw != NULL && n < count; fw = next) {
+		next = fw->fw_next;
+		if (fw->fw_as != as || fw->fw_addr != uaddr) {
+			continue;
+		}
+		/*
+		 * If its timeout has already fired, it's off the wait
+		 * channel and on its way back to take itself off the
+		 * list and return ETIMEDOUT. Leave it be and don't
+		 * count it.
+		 */
+		if (!wchan_wakethread(fb->fb_wchan, &fb->fb_lock,
+				      fw->fw_thread)) {
+			continue;
+		}
+		futex_unlink(fb, fw);
+		fw->fw_woken = true;
+		n++;
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = n;
+	return 0;
+}
+
+/*
+ * Wake every waiter in address space AS. Used when the process is
+ * exiting (and has set p_exiting); the waiters return EINTR.
+ */
+void
+futex_wakeall(struct addrspace *as)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw, *next;
+	unsigned i;
+
+	if (as == NULL) {
+		return;
+	}
+
+	for (i=0; i<FUTEX_HASHSIZE; i++) {
+		fb = &futex_table[i];
+		spinlock_acquire(&fb->fb_lock);
+		for (fw = fb->fb_head; fw != NULL; fw = next) {
+			next = fw->fw_next;
+			if (fw->fw_as != as) {
+				continue;
+			}
+			futex_unlink(fb, fw);
+			fw->fw_woken = true;
+			wchan_wakethread(fb->fb_wchan, &fb->fb_lock,
+					 fw->fw_thread);
+		}
+		spinlock_release(&fb->fb_lock);
+	}
+}
+
+/*
+ * The system call.
+ */
+int
+sys_futex(userptr_t uaddr, int op, int val, const_userptr_t utimeout,
+	  int *retval)
+{
+	struct timespec timeout;
+	int result;
+
+	if ((uintptr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	switch (op) {
+	    case FUTEX_WAIT:
+		if (utimeout == NULL) {
+			return futex_wait(uaddr, val, NULL);
+		}
+		result = copyin(utimeout, &timeout, sizeof(timeout));
+		if (result) {
+			return result;
+		}
+		if (timeout.tv_sec < 0 || timeout.tv_nsec < 0 ||
+		    timeout.tv_nsec >= 1000000000) {
+			return EINVAL;
+		}
+		return futex_wait(uaddr, val, &timeout);
+	    case FUTEX_WAKE:
+		if (val < 0) {
+			return EINVAL;
+		}
+		return futex_wake(uaddr, val, retval);
+	}
+	return EINVAL;
+}
@@ -56,6 +56,7 @@
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
+#include <spinlock.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
@@ -146,21 +147,133 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
+ * Exec header cache.
  *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * This keeps the already read and checked headers of recently
+ * executed files, so running the same program again (which the shell
+ * does all the time) can go straight to loading the segments. Entries
+ * are keyed by vnode and vnode version: writing or truncating a file
+ * gives it a new version, and so does a vnode being recycled for
+ * another file, so entries that are out of date never match again
+ * and just age out. The vnode pointer is never dereferenced through
+ * the cache, so we don't need to hold a reference.
+ */
+#define EXECCACHE_SIZE	8	/* number of files */
+#define EXEC_MAXSEGS	8	/* loadable segments per file */
+
+/* What we need from the headers to load a file. */
+struct execinfo {
+	vaddr_t ei_entry;			/* Entry point */
+	unsigned ei_nsegs;			/* Number of PT_LOAD segments */
+	Elf_Phdr ei_segs[EXEC_MAXSEGS];		/* The PT_LOAD segments */
+};
+
+struct execcache_entry {
+	struct vnode *ec_vn;			/* File, or NULL if unused */
+	uint64_t ec_version;			/* Version of the file */
+	unsigned ec_lastuse;			/* For replacement */
+	struct execinfo ec_info;
+};
+
+static struct spinlock execcache_lock = SPINLOCK_INITIALIZER;
+static struct execcache_entry execcache[EXECCACHE_SIZE];
+static unsigned execcache_clock;
+static unsigned execcache_hits, execcache_misses;
+
+/*
+ * Look up the headers of version VERSION of V in the cache. Returns
+ * true and fills in INFO if found.
+ */
+static
+bool
+execcache_lookup(struct vnode *v, uint64_t version, struct execinfo *info)
+{
+	unsigned i;
+
+	spinlock_acquire(&execcache_lock);
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i].ec_vn == v &&
+		    execcache[i].ec_version == version) {
+			execcache[i].ec_lastuse = ++execcache_clock;
+			*info = execcache[i].ec_info;
+			execcache_hits++;
+			spinlock_release(&execcache_lock);
+			return true;
+		}
+	}
+	execcache_misses++;
+	spinlock_release(&execcache_lock);
+	return false;
+}
+
+/*
+ * Enter the headers of version VERSION of V into the cache, in place
+ * of any older version of it, or else of the least recently used
+ * entry.
+ */
+static
+void
+execcache_insert(struct vnode *v, uint64_t version,
+		 const struct execinfo *info)
+{
+	struct execcache_entry *ec;
+	unsigned i;
+
+	spinlock_acquire(&execcache_lock);
+	ec = &execcache[0];
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i].ec_vn == v) {
+			ec = &execcache[i];
+			break;
+		}
+		if (execcache[i].ec_lastuse < ec->ec_lastuse) {
+			ec = &execcache[i];
+		}
+	}
+	ec->ec_vn = v;
+	ec->ec_version = version;
+	ec->ec_lastuse = ++execcache_clock;
+	ec->ec_info = *info;
+	spinlock_release(&execcache_lock);
+}
+
+/*
+ * Print the cache's hit and miss counts.
+ */
+void
+execcache_printstats(void)
+{
+	unsigned i, used, hits, total;
+
+	spinlock_acquire(&execcache_lock);
+	used = 0;
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i].ec_vn != NULL) {
+			used++;
+		}
+	}
+	hits = execcache_hits;
+	total = hits + execcache_misses;
+	spinlock_release(&execcache_lock);
+
+	kprintf("exec cache: %u/%u entries, %u hits, %u misses, "
+		"%u%% hit rate\n", used, EXECCACHE_SIZE, hits, total - hits,
+		total == 0 ? 0 : (unsigned)(hits * 100ULL / total));
+}
+
+/*
+ * Read the headers of an ELF executable, check them, and collect the
+ * segments to load.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+load_elf_headers(struct vnode *v, struct execinfo *info)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
 	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
-
-	as = proc_getas();
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -203,12 +316,12 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	}
 
 	/*
-	 * Go through the list of segments and set up the address space.
+	 * Go through the list of segments and pick out the ones to
+	 * load.
 	 *
 	 * Ordinarily there will be one code segment, one read-only
 	 * data segment, and one data/bss segment, but there might
-	 * conceivably be more. You don't need to support such files
-	 * if it's unduly awkward to do so.
+	 * conceivably be more. We allow up to EXEC_MAXSEGS.
 	 *
 	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is
 	 * mandated by the ELF standard - we use sizeof(ph) to load,
@@ -217,6 +330,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * to find where the phdr starts.
 	 */
 
+	info->ei_nsegs = 0;
 	for (i=0; i<eh.e_phnum; i++) {
 		off_t offset = eh.e_phoff + i*eh.e_phentsize;
 		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
@@ -243,11 +357,59 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+		if (info->ei_nsegs == EXEC_MAXSEGS) {
+			kprintf("loadelf: too many segments\n");
+			return ENOEXEC;
+		}
+		info->ei_segs[info->ei_nsegs++] = ph;
+	}
+
+	info->ei_entry = eh.e_entry;
+	return 0;
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct execinfo info;
+	Elf_Phdr *ph;
+	uint64_t version;
+	unsigned i;
+	int result;
+	struct addrspace *as;
+
+	as = proc_getas();
+
+	/*
+	 * Get the headers, from the cache if we can. Fetch the
+	 * version first: if the file gets written while we're
+	 * reading, what we read is filed under the old version.
+	 */
+	version = vnode_getversion(v);
+	if (!execcache_lookup(v, version, &info)) {
+		result = load_elf_headers(v, &info);
+		if (result) {
+			return result;
+		}
+		execcache_insert(v, version, &info);
+	}
+
+	/*
+	 * Set up the address space.
+	 */
+
+	for (i=0; i<info.ei_nsegs; i++) {
+		ph = &info.ei_segs[i];
 		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+					  ph->p_vaddr, ph->p_memsz,
+					  ph->p_flags & PF_R,
+					  ph->p_flags & PF_W,
+					  ph->p_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -262,35 +424,11 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * Now actually load each segment.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
-		if (result) {
-			return result;
-		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
-		}
-
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+	for (i=0; i<info.ei_nsegs; i++) {
+		ph = &info.ei_segs[i];
+		result = load_segment(as, v, ph->p_offset, ph->p_vaddr,
+				      ph->p_memsz, ph->p_filesz,
+				      ph->p_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -301,7 +439,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
-	*entrypoint = eh.e_entry;
+	*entrypoint = info.ei_entry;
 
 	return 0;
 }
@@ -37,6 +37,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
+#include <pipe.h>
 #include <openfile.h>
 
 /*
@@ -116,6 +117,40 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Make a pipe (with pipe_create) and wrap its read end and its write
+ * end each in an openfile object.
+ */
+int
+openfile_pipe(struct openfile **readfile_ret, struct openfile **writefile_ret)
+{
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile;
+	int result;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	readfile = openfile_create(readvn, O_RDONLY);
+	if (readfile == NULL) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+	writefile = openfile_create(writevn, O_WRONLY);
+	if (writefile == NULL) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+
+	*readfile_ret = readfile;
+	*writefile_ret = writefile;
+	return 0;
+}
+
 /*
  * Increment the reference count on an openfile.
  */
@@ -33,10 +33,15 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <kern/schedstat.h>
 #include <kern/wait.h>
+#include <limits.h>
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
+#include <cpu.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -44,6 +49,7 @@
 #include <pid.h>
 #include <syscall.h>
 #include <addrspace.h>
+#include <filetable.h>
 
 /* note that sys_execv is in runprogram.c */
 
@@ -59,6 +65,128 @@ sys_getpid(pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_sched_setaffinity
+ * Restrict the process to the CPUs in MASK. Only the calling process
+ * can be changed; as in Unix, pid 0 means the caller.
+ */
+int
+sys_sched_setaffinity(pid_t pid, unsigned mask)
+{
+	int result;
+
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+
+	result = proc_setaffinity(curproc, mask);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * If we're no longer allowed on this cpu, get off it;
+	 * thread_switch hands us on to a cpu the mask allows.
+	 */
+	if ((curthread->t_affinity & CPUMASK_BIT(curcpu->c_number)) == 0) {
+		thread_yield();
+	}
+	return 0;
+}
+
+/*
+ * sys_sched_getaffinity
+ * Copy out the calling process's CPU mask.
+ */
+int
+sys_sched_getaffinity(pid_t pid, userptr_t mask)
+{
+	cpumask_t kmask;
+
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	kmask = curproc->p_affinity;
+	spinlock_release(&curproc->p_lock);
+
+	return copyout(&kmask, mask, sizeof(kmask));
+}
+
+/*
+ * sys_setpriority
+ * Set the nice value of the calling process, clamped to PRIO_MAX;
+ * lower values get more of the cpu. Negative values are refused
+ * (EACCES, as for an unprivileged process in Unix): with strict
+ * priority run queues they would starve the kernel's own threads,
+ * which run at PRI_DEFAULT. As with the affinity calls only the
+ * caller can be changed, and there are no process groups or users,
+ * so only PRIO_PROCESS is supported.
+ */
+int
+sys_setpriority(int which, pid_t who, int prio)
+{
+	if (which != PRIO_PROCESS) {
+		return EINVAL;
+	}
+	if (who != 0 && who != curproc->p_pid) {
+		return ESRCH;
+	}
+
+	if (prio < 0) {
+		return EACCES;
+	}
+	if (prio > PRIO_MAX) {
+		prio = PRIO_MAX;
+	}
+	proc_setpriority(curproc, PRI_DEFAULT - prio);
+	return 0;
+}
+
+/*
+ * sys_getpriority
+ * Return the nice value of the calling process.
+ */
+int
+sys_getpriority(int which, pid_t who, int *retval)
+{
+	if (which != PRIO_PROCESS) {
+		return EINVAL;
+	}
+	if (who != 0 && who != curproc->p_pid) {
+		return ESRCH;
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	*retval = PRI_DEFAULT - curproc->p_pri;
+	spinlock_release(&curproc->p_lock);
+	return 0;
+}
+
+/*
+ * sys_schedstat
+ * Copy out the scheduler latency histograms of one cpu, or of all of
+ * them together if CPUNUM is -1. Returns the number of cpus.
+ */
+int
+sys_schedstat(int cpunum, userptr_t stats, int *retval)
+{
+	struct schedstat ss;
+	int result;
+
+	result = thread_getschedstat(cpunum, &ss);
+	if (result) {
+		return result;
+	}
+	result = copyout(&ss, stats, sizeof(ss));
+	if (result) {
+		return result;
+	}
+	*retval = cpu_count();
+	return 0;
+}
+
 /*
  * sys__exit()
  *
@@ -138,6 +266,114 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys___threadfork
+ *
+ * Create a new thread in the current process. It starts in user mode
+ * at ENTRYPOINT, with ARG as its argument, on the user stack at
+ * STACKPTR (which the caller allocates). Returns the new thread id.
+ */
+
+struct threadfork_args {
+	struct trapframe tfa_tf;	/* creator's registers */
+	vaddr_t tfa_entrypoint;
+	vaddr_t tfa_arg;
+	vaddr_t tfa_stackptr;
+};
+
+static
+void
+threadfork_newthread(void *vargs, unsigned long tid)
+{
+	struct threadfork_args *args = vargs;
+	struct trapframe mytf;
+	vaddr_t entrypoint, arg, stackptr;
+
+	/* As in fork_newthread, move everything to our stack. */
+	mytf = args->tfa_tf;
+	entrypoint = args->tfa_entrypoint;
+	arg = args->tfa_arg;
+	stackptr = args->tfa_stackptr;
+	kfree(args);
+
+	curthread->t_tid = tid;
+
+	/* Don't start if the process began exiting in the meantime. */
+	proc_exitcheck();
+
+	enter_new_thread(&mytf, entrypoint, arg, stackptr);
+}
+
+int
+sys___threadfork(struct trapframe *tf, userptr_t entrypoint, userptr_t arg,
+		 userptr_t stackptr, int *retval)
+{
+	struct threadfork_args *args;
+	struct uthread *ut;
+	int tid, result;
+
+	args = kmalloc(sizeof(*args));
+	if (args == NULL) {
+		return ENOMEM;
+	}
+	args->tfa_tf = *tf;
+	args->tfa_entrypoint = (vaddr_t)entrypoint;
+	args->tfa_arg = (vaddr_t)arg;
+	/* the MIPS calling convention wants 8-byte stack alignment */
+	args->tfa_stackptr = (vaddr_t)stackptr & ~(vaddr_t)7;
+
+	result = proc_newuthread(curproc, &ut);
+	if (result) {
+		kfree(args);
+		return result;
+	}
+	/* once the thread runs, it might exit and be joined before we return */
+	tid = ut->ut_tid;
+
+	result = thread_fork(curthread->t_name, curproc,
+			     threadfork_newthread, args, tid);
+	if (result) {
+		proc_unnewuthread(curproc, ut);
+		kfree(args);
+		return result;
+	}
+
+	*retval = tid;
+	return 0;
+}
+
+/*
+ * sys_threadexit
+ * Make only the calling thread exit; see proc_threadexit.
+ */
+__DEAD
+void
+sys_threadexit(int status)
+{
+	proc_threadexit(status);
+}
+
+/*
+ * sys___threadjoin
+ * Wait for another thread in the process and collect its status.
+ */
+int
+sys___threadjoin(int tid, userptr_t retstatus)
+{
+	int status;
+	int result;
+
+	result = proc_threadjoin(tid, &status);
+	if (result) {
+		return result;
+	}
+
+	if (retstatus != NULL) {
+		result = copyout(&status, retstatus, sizeof(int));
+	}
+	return result;
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
@@ -148,17 +384,131 @@ sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 	int status;
 	int result;
 
-	result = pid_wait(pid, &status, flags, retval);
+	result = pid_wait(pid, &status, flags, NULL, retval);
+	if (result) {
+		return result;
+	}
+
+	if (retstatus != NULL) {
+		result = copyout(&status, retstatus, sizeof(int));
+	}
+	return result;
+}
+
+/*
+ * sys_wait4
+ * waitpid, plus the resource usage of the child.
+ */
+int
+sys_wait4(pid_t pid, userptr_t retstatus, int flags, userptr_t retru,
+	  pid_t *retval)
+{
+	struct rusage ru;
+	int status;
+	int result;
+
+	result = pid_wait(pid, &status, flags, &ru, retval);
 	if (result) {
 		return result;
 	}
 
+	/* With WNOHANG and nobody exited, there's nothing to return. */
+	if (*retval == 0) {
+		return 0;
+	}
+
 	if (retstatus != NULL) {
 		result = copyout(&status, retstatus, sizeof(int));
+		if (result) {
+			return result;
+		}
+	}
+	if (retru != NULL) {
+		result = copyout(&ru, retru, sizeof(ru));
 	}
 	return result;
 }
 
+/*
+ * sys_getrusage
+ * Resource usage of the current process or of its waited-for children.
+ */
+int
+sys_getrusage(int who, userptr_t retru)
+{
+	struct rusage ru;
+
+	if (who != RUSAGE_SELF && who != RUSAGE_CHILDREN) {
+		return EINVAL;
+	}
+	proc_getrusage(curproc, who, &ru);
+	return copyout(&ru, retru, sizeof(ru));
+}
+
+/*
+ * sys_getrlimit
+ * Only RLIMIT_NOFILE is implemented; everything else is unlimited.
+ */
+int
+sys_getrlimit(int resource, userptr_t retrl)
+{
+	struct rlimit rl;
+	unsigned cur, max;
+
+	if (resource < 0 || resource >= __RLIMIT_NUM) {
+		return EINVAL;
+	}
+	if (resource == RLIMIT_NOFILE) {
+		filetable_getlimit(curproc->p_filetable, &cur, &max);
+		rl.rlim_cur = cur;
+		rl.rlim_max = max;
+	}
+	else {
+		rl.rlim_cur = RLIM_INFINITY;
+		rl.rlim_max = RLIM_INFINITY;
+	}
+	return copyout(&rl, retrl, sizeof(rl));
+}
+
+/*
+ * sys_setrlimit
+ * Only RLIMIT_NOFILE can be set. Values past what the kernel can do
+ * (NOFILE_MAX), including RLIM_INFINITY, mean NOFILE_MAX.
+ */
+int
+sys_setrlimit(int resource, const_userptr_t rlp)
+{
+	struct rlimit rl;
+	int result;
+
+	if (resource < 0 || resource >= __RLIMIT_NUM) {
+		return EINVAL;
+	}
+
+	result = copyin(rlp, &rl, sizeof(rl));
+	if (result) {
+		return result;
+	}
+
+	if (resource != RLIMIT_NOFILE) {
+		/* Can't limit these; only "unlimited" is allowed. */
+		if (rl.rlim_cur != RLIM_INFINITY ||
+		    rl.rlim_max != RLIM_INFINITY) {
+			return EINVAL;
+		}
+		return 0;
+	}
+
+	if (rl.rlim_cur > NOFILE_MAX) {
+		rl.rlim_cur = NOFILE_MAX;
+	}
+	if (rl.rlim_max > NOFILE_MAX) {
+		rl.rlim_max = NOFILE_MAX;
+	}
+	return filetable_setlimit(curproc->p_filetable,
+				  rl.rlim_cur, rl.rlim_max);
+}
+
 /*
  * sys_sbrk
  * Get more heap space using given amount
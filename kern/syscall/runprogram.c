@@ -72,6 +72,13 @@ struct argbuf {
 #define EXEC_BIGBUF_THROTTLE	1
 static struct semaphore *execthrottle;
 
+/*
+ * Number of argv pointers moved per copyin or copyout. Batching them
+ * saves a trip across the user/kernel boundary per argument, which
+ * adds up with thousands of small arguments.
+ */
+#define ARGV_CHUNK		64
+
 /*
  * Set things up.
  */
@@ -161,49 +168,62 @@ argbuf_fromkernel(struct argbuf *buf, const char *progname)
 
 /*
  * Copy an argv array into kernel space, using an argvdata buffer.
+ *
+ * The argv pointers are fetched ARGV_CHUNK at a time rather than one
+ * per copyin. A chunk never reaches past the end of the page the
+ * first pointer in it is on: the array may end (with its NULL) right
+ * before an unmapped page, and reading past the NULL must not fault.
+ * The strings themselves can be anywhere, so each still takes its
+ * own copyinstr.
  */
 static
 int
 argbuf_copyin(struct argbuf *buf, userptr_t uargv)
 {
-	userptr_t thisarg;
+	userptr_t args[ARGV_CHUNK];
+	unsigned i, num;
 	size_t thisarglen;
 	int result;
 
-	/* loop through the argv, grabbing each arg string */
 	buf->nargs = 0;
 	while (1) {
-		/*
-		 * First, grab the pointer at argv.
-		 * (argv is incremented at the end of the loop)
-		 */
-		result = copyin(uargv, &thisarg, sizeof(userptr_t));
-		if (result) {
-			return result;
-		}
-
-		/* If we got NULL, we're at the end of the argv. */
-		if (thisarg == NULL) {
-			break;
+		/* Grab as many pointers as are safe to. */
+		num = (PAGE_SIZE - ((vaddr_t)uargv & ~(vaddr_t)PAGE_FRAME))
+			/ sizeof(userptr_t);
+		if (num == 0) {
+			/* misaligned pointer straddling the page end */
+			num = 1;
 		}
-
-		/* Use the pointer to fetch the argument string. */
-		result = copyinstr(thisarg, buf->data + buf->len,
-				   buf->max - buf->len, &thisarglen);
-		if (result == ENAMETOOLONG) {
-			return E2BIG;
+		if (num > ARGV_CHUNK) {
+			num = ARGV_CHUNK;
 		}
-		else if (result) {
+		result = copyin(uargv, args, num * sizeof(userptr_t));
+		if (result) {
 			return result;
 		}
 
-		/* Move ahead. Note: thisarglen includes the \0. */
-		buf->len += thisarglen;
-		uargv += sizeof(userptr_t);
-		buf->nargs++;
+		for (i=0; i<num; i++) {
+			/* If we got NULL, we're at the end of the argv. */
+			if (args[i] == NULL) {
+				return 0;
+			}
+
+			/* Use the pointer to fetch the argument string. */
+			result = copyinstr(args[i], buf->data + buf->len,
+					   buf->max - buf->len, &thisarglen);
+			if (result == ENAMETOOLONG) {
+				return E2BIG;
+			}
+			else if (result) {
+				return result;
+			}
+
+			/* Move ahead. Note: thisarglen includes the \0. */
+			buf->len += thisarglen;
+			buf->nargs++;
+		}
+		uargv += num * sizeof(userptr_t);
 	}
-
-	return 0;
 }
 
 /*
@@ -259,9 +279,11 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 {
 	vaddr_t ustack;
 	userptr_t ustringbase, uargvbase, uargv_i;
-	userptr_t thisarg;
+	userptr_t args[ARGV_CHUNK];
 	size_t thisarglen;
 	size_t pos;
+	unsigned num;
+	int i;
 	int result;
 
 	/* Begin the stack at the passed in top. */
@@ -282,40 +304,42 @@ argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	ustack -= (buf->nargs + 1) * sizeof(userptr_t);
 	uargvbase = (userptr_t)ustack;
 
-	/* Now copy the data out. */
+	/* The strings are already packed; push them out in one go. */
+	result = copyout(buf->data, ustringbase, buf->len);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Now the argv array, including the ending NULL. Build it
+	 * ARGV_CHUNK pointers at a time and copy each batch out whole.
+	 */
 	pos = 0;
+	num = 0;
 	uargv_i = uargvbase;
-	while (pos < buf->len) {
-		/* The user address of the string will be ustringbase + pos. */
-		thisarg = ustringbase + pos;
-
-		/* Place it in the argv array. */
-		result = copyout(&thisarg, uargv_i, sizeof(thisarg));
-		if (result) {
-			return result;
+	for (i=0; i<=buf->nargs; i++) {
+		if (i < buf->nargs) {
+			/* thisarglen includes the \0 */
+			thisarglen = strlen(buf->data + pos) + 1;
+			args[num++] = ustringbase + pos;
+			pos += thisarglen;
 		}
-
-		/* Push out the string. */
-		result = copyoutstr(buf->data + pos, thisarg,
-				    buf->len - pos, &thisarglen);
-		if (result) {
-			return result;
+		else {
+			args[num++] = NULL;
+		}
+		if (num == ARGV_CHUNK || i == buf->nargs) {
+			result = copyout(args, uargv_i,
+					 num * sizeof(userptr_t));
+			if (result) {
+				return result;
+			}
+			uargv_i += num * sizeof(userptr_t);
+			num = 0;
 		}
-
-		/* thisarglen includes the \0 */
-		pos += thisarglen;
-		uargv_i += sizeof(thisarg);
 	}
 	/* Should have come out even... */
 	KASSERT(pos == buf->len);
 
-	/* Add the NULL. */
-	thisarg = NULL;
-	result = copyout(&thisarg, uargv_i, sizeof(userptr_t));
-	if (result) {
-		return result;
-	}
-
 	*ustackp = ustack;
 	*argc_ret = buf->nargs;
 	*uargv_ret = uargvbase;
@@ -399,8 +423,7 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 	 * Now that we know we're succeeding, change the current thread's
 	 * name to reflect the new process.
 	 */
-	kfree(curthread->t_name);
-	curthread->t_name = newname;
+	thread_rename(curthread, newname);
 
 	return 0;
 }
@@ -431,7 +454,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
@@ -557,9 +584,21 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	char *path;
 	struct argbuf kargv;
 	vaddr_t entrypoint, stackptr;
+	unsigned nthreads;
 	int argc;
 	int result;
 
+	/*
+	 * Replacing the image out from under other threads of the
+	 * process isn't supported; they need to exit first.
+	 */
+	spinlock_acquire(&curproc->p_lock);
+	nthreads = threadarray_num(&curproc->p_threads);
+	spinlock_release(&curproc->p_lock);
+	if (nthreads > 1) {
+		return EBUSY;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
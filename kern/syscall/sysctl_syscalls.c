@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * __sysctl() - reading (and resetting) kernel statistics by name,
+ * and the per-syscall statistics it exports. See <kern/sysctl.h>.
+ *
+ * The syscall statistics are kept per cpu so that counting a call
+ * needs no lock, only interrupts off for the moment it takes to
+ * update the counters of the cpu the call is running on.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/sysctl.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define SYSCTL_MAXNAME	4
+
+static struct syscallstat **syscallstats;	/* [cpu][callno] */
+
+void
+sysctl_bootstrap(void)
+{
+	unsigned i, ncpus;
+
+	ncpus = cpu_count();
+	syscallstats = kmalloc(ncpus * sizeof(*syscallstats));
+	if (syscallstats == NULL) {
+		panic("sysctl_bootstrap: Out of memory\n");
+	}
+	for (i=0; i<ncpus; i++) {
+		syscallstats[i] = kmalloc(SYSCALLSTAT_NCALLS *
+					  sizeof(struct syscallstat));
+		if (syscallstats[i] == NULL) {
+			panic("sysctl_bootstrap: Out of memory\n");
+		}
+		bzero(syscallstats[i],
+		      SYSCALLSTAT_NCALLS * sizeof(struct syscallstat));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// accounting
+
+/*
+ * Called by the syscall dispatcher as a call starts.
+ */
+void
+syscallstat_enter(int callno)
+{
+	int spl;
+
+	if (callno < 0 || callno >= SYSCALLSTAT_NCALLS) {
+		return;
+	}
+	spl = splhigh();
+	syscallstats[curcpu->c_number][callno].ss_calls++;
+	splx(spl);
+}
+
+/*
+ * Called as a call returns, with its error code and how long it
+ * took. The call may have moved to a different cpu since it started;
+ * that's fine, since only the sums over cpus add up anyway.
+ */
+void
+syscallstat_exit(int callno, int err, uint32_t cycles)
+{
+	struct syscallstat *ss;
+	unsigned bucket;
+	int spl;
+
+	if (callno < 0 || callno >= SYSCALLSTAT_NCALLS) {
+		return;
+	}
+
+	bucket = 0;
+	while (cycles >> bucket > 1) {
+		bucket++;
+	}
+
+	spl = splhigh();
+	ss = &syscallstats[curcpu->c_number][callno];
+	if (err) {
+		ss->ss_errors++;
+	}
+	ss->ss_cycles += cycles;
+	ss->ss_hist[bucket]++;
+	splx(spl);
+}
+
+////////////////////////////////////////////////////////////
+// __sysctl
+
+/*
+ * Add up the statistics of cpu CPUNUM, or all cpus if -1, into
+ * STATS. The counters are read without interrupts off on their cpus,
+ * so a call finishing meanwhile may be only partly counted.
+ */
+static
+void
+sysctl_getsyscallstats(int cpunum, struct syscallstat *stats)
+{
+	const struct syscallstat *ss;
+	unsigned i, j, k;
+
+	bzero(stats, SYSCALLSTAT_NCALLS * sizeof(*stats));
+	for (i=0; i<cpu_count(); i++) {
+		if (cpunum != -1 && i != (unsigned)cpunum) {
+			continue;
+		}
+		for (j=0; j<SYSCALLSTAT_NCALLS; j++) {
+			ss = &syscallstats[i][j];
+			stats[j].ss_calls += ss->ss_calls;
+			stats[j].ss_errors += ss->ss_errors;
+			stats[j].ss_cycles += ss->ss_cycles;
+			for (k=0; k<SYSCALLSTAT_BUCKETS; k++) {
+				stats[j].ss_hist[k] += ss->ss_hist[k];
+			}
+		}
+	}
+}
+
+static
+void
+sysctl_resetsyscallstats(void)
+{
+	unsigned i;
+
+	for (i=0; i<cpu_count(); i++) {
+		bzero(syscallstats[i],
+		      SYSCALLSTAT_NCALLS * sizeof(struct syscallstat));
+	}
+}
+
+/*
+ * Copy the value VAL of size LEN out to OLDP/OLDLENP per the
+ * __sysctl rules.
+ */
+static
+int
+sysctl_copyout(const void *val, size_t len, userptr_t oldp, userptr_t oldlenp)
+{
+	size_t oldlen;
+	int result;
+
+	if (oldlenp == NULL) {
+		return oldp == NULL ? 0 : EINVAL;
+	}
+	if (oldp != NULL) {
+		result = copyin((const_userptr_t)oldlenp, &oldlen,
+				sizeof(oldlen));
+		if (result) {
+			return result;
+		}
+		if (oldlen < len) {
+			return ENOMEM;
+		}
+		result = copyout(val, oldp, len);
+		if (result) {
+			return result;
+		}
+	}
+	return copyout(&len, oldlenp, sizeof(len));
+}
+
+int
+sys___sysctl(const_userptr_t uname, unsigned namelen,
+	     userptr_t oldp, userptr_t oldlenp,
+	     const_userptr_t newp, size_t newlen)
+{
+	int name[SYSCTL_MAXNAME];
+	struct syscallstat *stats;
+	int ncpus, cpunum;
+	int result;
+
+	(void)newlen;
+
+	if (namelen < 2 || namelen > SYSCTL_MAXNAME) {
+		return EINVAL;
+	}
+	result = copyin(uname, name, namelen * sizeof(int));
+	if (result) {
+		return result;
+	}
+	if (name[0] != CTL_KERN) {
+		return ENOENT;
+	}
+
+	switch (name[1]) {
+	    case KERN_NCPUS:
+		if (namelen != 2) {
+			return ENOTDIR;
+		}
+		if (newp != NULL) {
+			return EPERM;
+		}
+		ncpus = cpu_count();
+		return sysctl_copyout(&ncpus, sizeof(ncpus), oldp, oldlenp);
+
+	    case KERN_SYSCALLSTATS:
+		if (namelen > 3) {
+			return ENOTDIR;
+		}
+		cpunum = -1;
+		if (namelen == 3) {
+			cpunum = name[2];
+			if (cpunum < 0 || cpunum >= (int)cpu_count()) {
+				return ENOENT;
+			}
+		}
+		stats = kmalloc(SYSCALLSTAT_NCALLS * sizeof(*stats));
+		if (stats == NULL) {
+			return ENOMEM;
+		}
+		sysctl_getsyscallstats(cpunum, stats);
+		result = sysctl_copyout(stats,
+				SYSCALLSTAT_NCALLS * sizeof(*stats),
+				oldp, oldlenp);
+		kfree(stats);
+		if (result) {
+			return result;
+		}
+		if (newp != NULL) {
+			sysctl_resetsyscallstats();
+		}
+		return 0;
+	}
+	return ENOENT;
+}
@@ -28,7 +28,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
+#include <thread.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +58,36 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the given time interval.
+ *
+ * There are no signals to interrupt the sleep, so it always runs to
+ * completion and the remaining time (REM) is never written.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req;
+	unsigned ticks;
+	int result;
+
+	(void)user_rem;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	ticks = timeout_ticks(&req);
+	if (ticks == 0) {
+		thread_yield();
+	}
+	else {
+		clocksleep_ticks(ticks);
+	}
+	return 0;
+}
@@ -39,8 +39,8 @@ bitmaptest(int nargs, char **args)
 {
 	struct bitmap *b;
 	char data[TESTSIZE];
-	uint32_t x;
-	int i;
+	uint32_t x, expect;
+	int i, n;
 
 	(void)nargs;
 	(void)args;
@@ -101,6 +101,26 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	/* Free every seventh bit and get them back round-robin from 400. */
+	n = 0;
+	for (i=3; i<TESTSIZE; i+=7) {
+		bitmap_unmark(b, i);
+		n++;
+	}
+	expect = 402;
+	x = 400;
+	while (bitmap_allocfrom(b, x, &x)==0) {
+		KASSERT(x == expect);
+		KASSERT(bitmap_isset(b, x));
+		n--;
+		expect += 7;
+		if (expect >= TESTSIZE) {
+			expect = 3;
+		}
+		x = (x + 1) % TESTSIZE;
+	}
+	KASSERT(n == 0);
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
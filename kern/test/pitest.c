@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Priority inheritance test.
+ *
+ * First set up a chain: a low-priority thread holds lock B and sits
+ * on a semaphore; a normal-priority thread holds lock A and waits for
+ * B; a high-priority thread waits for A. Check that both holders are
+ * raised to the high priority, and that each drops back to its own
+ * when it lets go.
+ *
+ * Then have low, high, and medium priority threads queue up (in that
+ * order) for a lock we hold, and check that they get it in priority
+ * order when we let go.
+ *
+ * Priorities are read out of other threads' structs without locking;
+ * we only look once they should have settled. We poll by sleeping,
+ * not by yielding, so as not to starve the low-priority threads.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <test.h>
+
+#define PRI_LOW		(PRI_DEFAULT - 5)
+#define PRI_MEDIUM	PRI_DEFAULT
+#define PRI_HIGH	(PRI_DEFAULT + 5)
+
+#define PIT_NWAITERS	3
+
+static struct lock *pit_a, *pit_b;
+static struct semaphore *pit_go, *pit_done;
+static struct thread *volatile pit_low, *volatile pit_mid, *volatile pit_high;
+static struct spinlock pit_lock;
+static int pit_order[PIT_NWAITERS];
+static unsigned pit_norder;
+static volatile unsigned pit_failures;
+
+static
+void
+pit_fail(const char *msg, int num)
+{
+	kprintf("pit: %s (%d)\n", msg, num);
+	pit_failures++;
+}
+
+/*
+ * Sleep until thread *TP exists and is waiting for LK.
+ */
+static
+void
+pit_waitfor(struct thread *volatile *tp, struct lock *lk)
+{
+	while (*tp == NULL || (*tp)->t_blockedon != lk) {
+		clocksleep_ticks(1);
+	}
+}
+
+static
+void
+pit_check(const char *what, struct thread *t, int pri)
+{
+	if (t->t_pri != pri) {
+		kprintf("pit: %s at priority %d, not %d\n", what, t->t_pri,
+			pri);
+		pit_failures++;
+	}
+}
+
+/* Holds B until told to let go. */
+static
+void
+pit_lowthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	lock_setbasepri(curthread, PRI_LOW);
+	lock_acquire(pit_b);
+	pit_low = curthread;
+	P(pit_go);
+	lock_release(pit_b);
+	pit_check("low thread after release", curthread, PRI_LOW);
+	V(pit_done);
+}
+
+/* Holds A and waits for B. */
+static
+void
+pit_midthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	lock_setbasepri(curthread, PRI_MEDIUM);
+	lock_acquire(pit_a);
+	pit_mid = curthread;
+	lock_acquire(pit_b);
+	lock_release(pit_b);
+	pit_check("mid thread holding A", curthread, PRI_HIGH);
+	lock_release(pit_a);
+	pit_check("mid thread after release", curthread, PRI_MEDIUM);
+	V(pit_done);
+}
+
+/* Waits for A. */
+static
+void
+pit_highthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	lock_setbasepri(curthread, PRI_HIGH);
+	pit_high = curthread;
+	lock_acquire(pit_a);
+	lock_release(pit_a);
+	V(pit_done);
+}
+
+/* Queues up for A at priority PRI, and logs when it gets it. */
+static
+void
+pit_waiter(void *junk, unsigned long pri)
+{
+	(void)junk;
+
+	lock_setbasepri(curthread, pri);
+	pit_high = curthread;
+	lock_acquire(pit_a);
+	spinlock_acquire(&pit_lock);
+	pit_order[pit_norder++] = pri;
+	spinlock_release(&pit_lock);
+	lock_release(pit_a);
+	V(pit_done);
+}
+
+static
+void
+pit_fork(const char *name, void (*func)(void *, unsigned long),
+	 unsigned long arg)
+{
+	int result;
+
+	result = thread_fork(name, NULL, func, NULL, arg);
+	if (result) {
+		panic("pit: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+int
+pitest(int nargs, char **args)
+{
+	static const int pris[PIT_NWAITERS] = {
+		PRI_LOW, PRI_HIGH, PRI_MEDIUM,
+	};
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	pit_a = lock_create("pit_a");
+	pit_b = lock_create("pit_b");
+	pit_go = sem_create("pit_go", 0);
+	pit_done = sem_create("pit_done", 0);
+	if (pit_a == NULL || pit_b == NULL || pit_go == NULL ||
+	    pit_done == NULL) {
+		panic("pit: out of memory\n");
+	}
+	spinlock_init(&pit_lock);
+	pit_low = pit_mid = pit_high = NULL;
+	pit_norder = 0;
+	pit_failures = 0;
+
+	kprintf("Starting priority inheritance test...\n");
+
+	/* The chain. */
+	pit_fork("pit_low", pit_lowthread, 0);
+	while (pit_low == NULL) {
+		clocksleep_ticks(1);
+	}
+	pit_fork("pit_mid", pit_midthread, 0);
+	pit_waitfor(&pit_mid, pit_b);
+	pit_check("low thread with mid waiting", pit_low, PRI_MEDIUM);
+	pit_fork("pit_high", pit_highthread, 0);
+	pit_waitfor(&pit_high, pit_a);
+	pit_check("mid thread with high waiting", pit_mid, PRI_HIGH);
+	pit_check("low thread with high waiting", pit_low, PRI_HIGH);
+	V(pit_go);
+	for (i=0; i<3; i++) {
+		P(pit_done);
+	}
+
+	/* Wakeup order. */
+	lock_acquire(pit_a);
+	for (i=0; i<PIT_NWAITERS; i++) {
+		pit_high = NULL;
+		pit_fork("pit_waiter", pit_waiter, pris[i]);
+		pit_waitfor(&pit_high, pit_a);
+	}
+	pit_check("lock holder", curthread, PRI_HIGH);
+	lock_release(pit_a);
+	pit_check("lock holder after release", curthread, PRI_DEFAULT);
+	for (i=0; i<PIT_NWAITERS; i++) {
+		P(pit_done);
+	}
+	for (i=1; i<PIT_NWAITERS; i++) {
+		if (pit_order[i] > pit_order[i-1]) {
+			pit_fail("waiter got the lock out of order", i);
+		}
+	}
+
+	spinlock_cleanup(&pit_lock);
+	sem_destroy(pit_done);
+	sem_destroy(pit_go);
+	lock_destroy(pit_b);
+	lock_destroy(pit_a);
+
+	if (pit_failures > 0) {
+		kprintf("Priority inheritance test failed (%u errors)\n",
+			pit_failures);
+	}
+	else {
+		kprintf("Priority inheritance test done.\n");
+	}
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Spinlock contention benchmark.
+ *
+ * One thread per cpu, each pinned with its affinity mask, takes the
+ * same lock over and over with a trivial critical section. This is
+ * done for each of three lock algorithms:
+ *
+ *    tas     plain test-and-set on the lock word
+ *    ttas    test-and-test-and-set (the old spinlock_acquire)
+ *    ticket  the real spinlock_acquire
+ *
+ * and for 2, 4, 8, ... cpus up to however many are online (at most
+ * 32). For each run we print the time per acquisition and the gap
+ * between the first and last thread to finish as a percentage of the
+ * run. Since every thread does the same number of acquisitions, a
+ * fair lock keeps that gap small; an unfair one lets some cpus finish
+ * well ahead of the others.
+ *
+ * All three variants disable interrupts while spinning and holding
+ * the lock, as spinlock_acquire does.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <test.h>
+
+#define SLT_DEFAULT_ITERS	2000
+
+enum slt_variant {
+	SLT_TAS,
+	SLT_TTAS,
+	SLT_TICKET,
+};
+
+static const char *const slt_names[] = {
+	"tas",
+	"ttas",
+	"ticket",
+};
+
+static enum slt_variant slt_variant;
+static unsigned slt_iters;
+static volatile spinlock_data_t slt_word;
+static struct spinlock slt_spinlock;
+static volatile unsigned slt_counter;
+static struct timespec slt_finish[32];
+static struct semaphore *slt_go;
+static struct semaphore *slt_done;
+
+static
+void
+slt_acquire(void)
+{
+	switch (slt_variant) {
+	    case SLT_TAS:
+		splraise(IPL_NONE, IPL_HIGH);
+		while (spinlock_data_testandset(&slt_word) != 0) {
+			/* spin */
+		}
+		membar_store_any();
+		break;
+	    case SLT_TTAS:
+		splraise(IPL_NONE, IPL_HIGH);
+		while (1) {
+			if (spinlock_data_get(&slt_word) != 0) {
+				continue;
+			}
+			if (spinlock_data_testandset(&slt_word) != 0) {
+				continue;
+			}
+			break;
+		}
+		membar_store_any();
+		break;
+	    case SLT_TICKET:
+		spinlock_acquire(&slt_spinlock);
+		break;
+	}
+}
+
+static
+void
+slt_release(void)
+{
+	switch (slt_variant) {
+	    case SLT_TAS:
+	    case SLT_TTAS:
+		membar_any_store();
+		spinlock_data_set(&slt_word, 0);
+		spllower(IPL_HIGH, IPL_NONE);
+		break;
+	    case SLT_TICKET:
+		spinlock_release(&slt_spinlock);
+		break;
+	}
+}
+
+static
+void
+slt_thread(void *junk, unsigned long num)
+{
+	unsigned i;
+
+	(void)junk;
+
+	/* get onto our own cpu before starting */
+	if (thread_setaffinity(CPUMASK_BIT(num))) {
+		panic("slt: cpu %lu not online\n", num);
+	}
+
+	P(slt_go);
+	for (i=0; i<slt_iters; i++) {
+		slt_acquire();
+		slt_counter++;
+		slt_release();
+	}
+	gettime(&slt_finish[num]);
+	V(slt_done);
+}
+
+/*
+ * Return the time from T1 to T2 in nanoseconds.
+ */
+static
+uint64_t
+slt_nsecs(const struct timespec *t1, const struct timespec *t2)
+{
+	struct timespec diff;
+
+	timespec_sub(t2, t1, &diff);
+	return (uint64_t)diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+}
+
+/*
+ * Check if T1 is earlier than T2.
+ */
+static
+bool
+slt_before(const struct timespec *t1, const struct timespec *t2)
+{
+	if (t1->tv_sec != t2->tv_sec) {
+		return t1->tv_sec < t2->tv_sec;
+	}
+	return t1->tv_nsec < t2->tv_nsec;
+}
+
+/*
+ * Run one variant on NCPUS cpus (cpus 0 through NCPUS-1).
+ */
+static
+void
+slt_run(enum slt_variant variant, unsigned ncpus)
+{
+	struct timespec start, first, last;
+	uint64_t total, spread;
+	char name[16];
+	unsigned i;
+	int result;
+
+	slt_variant = variant;
+	slt_counter = 0;
+
+	/* each thread moves itself to its own cpu; see slt_thread */
+	for (i=0; i<ncpus; i++) {
+		snprintf(name, sizeof(name), "slt%u", i);
+		result = thread_fork(name, NULL, slt_thread, NULL, i);
+		if (result) {
+			panic("slt: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	gettime(&start);
+	for (i=0; i<ncpus; i++) {
+		V(slt_go);
+	}
+	for (i=0; i<ncpus; i++) {
+		P(slt_done);
+	}
+
+	KASSERT(slt_counter == ncpus * slt_iters);
+
+	first = last = slt_finish[0];
+	for (i=1; i<ncpus; i++) {
+		if (slt_before(&slt_finish[i], &first)) {
+			first = slt_finish[i];
+		}
+		if (slt_before(&last, &slt_finish[i])) {
+			last = slt_finish[i];
+		}
+	}
+
+	total = slt_nsecs(&start, &last);
+	spread = slt_nsecs(&first, &last);
+	kprintf("%2u cpus %-6s: %8llu ns/acquire, finish spread %3llu%%\n",
+		ncpus, slt_names[variant],
+		(unsigned long long)(total / (ncpus * slt_iters)),
+		(unsigned long long)(total ? spread * 100 / total : 0));
+}
+
+/*
+ * Usage: slt [iterations]
+ */
+int
+spinlocktest(int nargs, char **args)
+{
+	cpumask_t online;
+	unsigned numcpus, ncpus;
+
+	if (nargs > 2) {
+		kprintf("Usage: slt [iterations]\n");
+		return EINVAL;
+	}
+	slt_iters = (nargs == 2) ? (unsigned)atoi(args[1]) :
+		SLT_DEFAULT_ITERS;
+	if (slt_iters == 0) {
+		kprintf("slt: iteration count must be positive\n");
+		return EINVAL;
+	}
+
+	online = thread_onlinecpus();
+	for (numcpus = 0; numcpus < 32; numcpus++) {
+		if ((online & CPUMASK_BIT(numcpus)) == 0) {
+			break;
+		}
+	}
+	if (numcpus < 2) {
+		kprintf("slt: need at least 2 cpus\n");
+		return 0;
+	}
+
+	slt_go = sem_create("slt_go", 0);
+	slt_done = sem_create("slt_done", 0);
+	if (slt_go == NULL || slt_done == NULL) {
+		panic("slt: sem_create failed\n");
+	}
+	spinlock_data_set(&slt_word, 0);
+	spinlock_init(&slt_spinlock);
+
+	kprintf("Spinlock contention test, %u acquisitions per cpu\n",
+		slt_iters);
+	for (ncpus = 2; ncpus <= numcpus; ncpus *= 2) {
+		slt_run(SLT_TAS, ncpus);
+		slt_run(SLT_TTAS, ncpus);
+		slt_run(SLT_TICKET, ncpus);
+	}
+	if ((numcpus & (numcpus - 1)) != 0) {
+		/* not a power of two; also do all of them */
+		slt_run(SLT_TAS, numcpus);
+		slt_run(SLT_TTAS, numcpus);
+		slt_run(SLT_TICKET, numcpus);
+	}
+
+	spinlock_cleanup(&slt_spinlock);
+	sem_destroy(slt_go);
+	sem_destroy(slt_done);
+	kprintf("Spinlock contention test done.\n");
+
+	return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Timeout test.
+ *
+ * First fork some threads that each sleep for a different number of
+ * ticks with clocksleep_ticks, all at once, and check that none of
+ * them comes back early; print how late the latest one was. Then
+ * check that wchan_sleep_timeout returns 0 if the thread is woken
+ * before the time runs out and ETIMEDOUT if not, and that cancelling
+ * a pending timeout keeps it from going off.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define TMT_NTHREADS	16
+#define NSECS_PER_TICK	(1000000000 / HZ)
+
+static struct semaphore *tmt_done;
+static struct wchan *tmt_wchan;
+static struct spinlock tmt_lock;
+static volatile unsigned tmt_failures;
+static volatile uint64_t tmt_maxlate;
+
+static
+uint64_t
+tmt_elapsed(const struct timespec *t1, const struct timespec *t2)
+{
+	struct timespec diff;
+
+	timespec_sub(t2, t1, &diff);
+	return (uint64_t)diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+}
+
+static
+void
+tmt_fail(const char *msg, unsigned long num)
+{
+	kprintf("tmt: %s (%lu)\n", msg, num);
+	tmt_failures++;
+}
+
+static
+void
+tmt_sleeper(void *junk, unsigned long ticks)
+{
+	struct timespec start, end;
+	uint64_t ns, min;
+
+	(void)junk;
+
+	gettime(&start);
+	clocksleep_ticks(ticks);
+	gettime(&end);
+
+	/* the first tick may have been partly over already */
+	ns = tmt_elapsed(&start, &end);
+	min = (uint64_t)(ticks - 1) * NSECS_PER_TICK;
+	if (ns < min) {
+		tmt_fail("clocksleep_ticks woke early", ticks);
+	}
+	else {
+		spinlock_acquire(&tmt_lock);
+		if (ns - min > tmt_maxlate) {
+			tmt_maxlate = ns - min;
+		}
+		spinlock_release(&tmt_lock);
+	}
+	V(tmt_done);
+}
+
+/*
+ * Sleep on tmt_wchan for TICKS and check the result.
+ */
+static
+void
+tmt_waiter(void *junk, unsigned long ticks)
+{
+	int result;
+
+	(void)junk;
+
+	spinlock_acquire(&tmt_lock);
+	result = wchan_sleep_timeout(tmt_wchan, &tmt_lock, ticks);
+	spinlock_release(&tmt_lock);
+
+	if (ticks > 10*HZ && result != 0) {
+		tmt_fail("wchan_sleep_timeout timed out when woken", ticks);
+	}
+	if (ticks <= 10*HZ && result != ETIMEDOUT) {
+		tmt_fail("wchan_sleep_timeout did not time out", ticks);
+	}
+	V(tmt_done);
+}
+
+static
+void
+tmt_func(void *data)
+{
+	volatile bool *fired = data;
+
+	*fired = true;
+}
+
+static
+void
+tmt_fork(const char *name, void (*func)(void *, unsigned long),
+	 unsigned long arg)
+{
+	int result;
+
+	result = thread_fork(name, NULL, func, NULL, arg);
+	if (result) {
+		panic("tmt: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+int
+timeouttest(int nargs, char **args)
+{
+	struct timeout to;
+	volatile bool fired;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	tmt_done = sem_create("tmt_done", 0);
+	if (tmt_done == NULL) {
+		panic("tmt: sem_create failed\n");
+	}
+	tmt_wchan = wchan_create("tmt");
+	if (tmt_wchan == NULL) {
+		panic("tmt: wchan_create failed\n");
+	}
+	spinlock_init(&tmt_lock);
+	tmt_failures = 0;
+	tmt_maxlate = 0;
+
+	kprintf("Starting timeout test...\n");
+
+	/* Overlapping sleeps, some longer than a lap of the wheel. */
+	for (i=0; i<TMT_NTHREADS; i++) {
+		tmt_fork("tmt_sleeper", tmt_sleeper,
+			 1 + i * (2 * TIMEOUT_WHEELSIZE / TMT_NTHREADS + 1));
+	}
+	for (i=0; i<TMT_NTHREADS; i++) {
+		P(tmt_done);
+	}
+	kprintf("tmt: clocksleep_ticks at most %llu us late\n",
+		tmt_maxlate / 1000);
+
+	/* Woken up before and after the timeout. */
+	tmt_fork("tmt_waiter", tmt_waiter, 60*HZ);
+	tmt_fork("tmt_waiter", tmt_waiter, 2);
+	clocksleep_ticks(HZ/2);
+	spinlock_acquire(&tmt_lock);
+	wchan_wakeall(tmt_wchan, &tmt_lock);
+	spinlock_release(&tmt_lock);
+	P(tmt_done);
+	P(tmt_done);
+
+	/* Cancelled before it goes off. */
+	fired = false;
+	timeout_init(&to, tmt_func, (void *)&fired);
+	timeout_add(&to, 5);
+	if (!timeout_cancel(&to)) {
+		tmt_fail("timeout_cancel of pending timeout failed", 5);
+	}
+	clocksleep_ticks(10);
+	if (fired) {
+		tmt_fail("cancelled timeout went off", 5);
+	}
+
+	/* Not cancelled. */
+	timeout_add(&to, 2);
+	clocksleep_ticks(10);
+	if (!fired) {
+		tmt_fail("timeout did not go off", 2);
+	}
+	if (timeout_cancel(&to)) {
+		tmt_fail("timeout_cancel of expired timeout succeeded", 2);
+	}
+
+	spinlock_cleanup(&tmt_lock);
+	wchan_destroy(tmt_wchan);
+	sem_destroy(tmt_done);
+
+	if (tmt_failures > 0) {
+		kprintf("Timeout test failed (%u errors)\n", tmt_failures);
+	}
+	else {
+		kprintf("Timeout test done.\n");
+	}
+	return 0;
+}
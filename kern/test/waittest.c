@@ -31,6 +31,7 @@
  * Wait test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <stdarg.h>
@@ -181,7 +182,7 @@ waittest(int nargs, char **args)
 		kid = kids2[kids2_head];
 		kids2_head = (kids2_head+1) % NTHREADS;
 		kprintf("Waiting on pid %d...\n", kid);
-		err = pid_wait(kid, &status, 0, NULL);
+		err = pid_wait(kid, &status, 0, NULL, NULL);
 		printstatus(kid, err, status);
 	}
 
@@ -216,7 +217,7 @@ waittest(int nargs, char **args)
 		P(exitsems[i]);
 		kprintf("Appears that pid %d P()'d\n", kid);
 		kprintf("Waiting on pid %d...\n", kid);
-		err = pid_wait(kid, &status, 0, NULL);
+		err = pid_wait(kid, &status, 0, NULL, NULL);
 		printstatus(kid, err, status);
 	}
 
@@ -253,10 +254,40 @@ waittest(int nargs, char **args)
 		P(exitsems[i]);
 		kprintf("Appears that pid %d P()'d\n", kid);
 		kprintf("Waiting on pid %d...\n", kid);
-		err = pid_wait(kid, &status, 0, NULL);
+		err = pid_wait(kid, &status, 0, NULL, NULL);
 		printstatus(kid, err, status);
 	}
 
+	/*
+	 * This fourth set waits for any child, so should get each of
+	 * them once, in roughly the order they exit, and then find
+	 * there are none left.
+	 */
+
+	kprintf("\n");
+	kprintf("Set 4 (wait for any child should get each once)\n");
+	kprintf("-----------------------------------------------\n");
+
+	for (i = 0; i < NTHREADS; i++) {
+		err = dofork("wait test thread", waitfirstthread, NULL, i,
+			     &kid);
+		if (err) {
+			panic("waittest: dofork failed (%d)\n", err);
+		}
+		kprintf("Spawned pid %d\n", kid);
+	}
+
+	for (i = 0; i < NTHREADS; i++) {
+		kprintf("Waiting on any child...\n");
+		err = pid_wait(-1, &status, 0, NULL, &kid);
+		printstatus(kid, err, status);
+	}
+	err = pid_wait(-1, &status, 0, NULL, &kid);
+	if (err != ECHILD) {
+		panic("waittest: wait with no children gave %d\n", err);
+	}
+	kprintf("No children left\n");
+
 	kprintf("\nWait test done.\n");
 
 	return 0;
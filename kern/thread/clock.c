@@ -28,9 +28,12 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spl.h>
 #include <wchan.h>
+#include <mainbus.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
@@ -38,9 +41,8 @@
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Callbacks can be scheduled for some number of ticks (hardclocks)
+ * in the future with timeouts; see <clock.h>.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -54,10 +56,17 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Tickless idle: an idle cpu turns its clock tick off until the next
+ * timeout on its wheel is due, or for at most this many ticks.
  */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
+#define TICKLESS_MAXTICKS	MAINBUS_TIMER_MAXTICKS
+
+/*
+ * clocksleep() sleeps on this channel, which nobody ever wakes; it
+ * relies on the timeout.
+ */
+static struct wchan *sleep_wchan;
+static struct spinlock sleep_lock;
 
 /*
  * Setup.
@@ -65,10 +74,308 @@ static struct spinlock lbolt_lock;
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	spinlock_init(&sleep_lock);
+	sleep_wchan = wchan_create("clocksleep");
+	if (sleep_wchan == NULL) {
+		panic("Couldn't create clocksleep wchan\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+// timeouts
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *arg)
+{
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_cpu = NULL;
+	to->to_expire = 0;
+	to->to_pending = false;
+	to->to_func = func;
+	to->to_arg = arg;
+}
+
+/*
+ * Take a timeout off its wheel. Timeout lock must be held.
+ */
+static
+void
+timeout_unlink(struct timeout *to)
+{
+	KASSERT(to->to_pending);
+	KASSERT(spinlock_do_i_hold(&to->to_cpu->c_timeout_lock));
+
+	*to->to_pprev = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = to->to_pprev;
+	}
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_pending = false;
+	to->to_cpu->c_ntimeouts--;
+}
+
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	struct cpu *c;
+	struct timeout **bucket;
+	int spl;
+
+	KASSERT(ticks > 0 && ticks <= TIMEOUT_MAXTICKS);
+	KASSERT(!to->to_pending);
+
+	/* Stay on this cpu while we look at its hardclock count. */
+	spl = splhigh();
+	c = curcpu->c_self;
+
+	/*
+	 * If the clock tick is off, c_hardclocks is behind; bring it
+	 * up to date first.
+	 */
+	hardclock_unidle();
+
+	spinlock_acquire(&c->c_timeout_lock);
+	to->to_cpu = c;
+	to->to_expire = c->c_hardclocks + ticks;
+	bucket = &c->c_timeouts[to->to_expire & (TIMEOUT_WHEELSIZE - 1)];
+	to->to_next = *bucket;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = &to->to_next;
+	}
+	to->to_pprev = bucket;
+	*bucket = to;
+	to->to_pending = true;
+	c->c_ntimeouts++;
+	spinlock_release(&c->c_timeout_lock);
+
+	splx(spl);
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	struct cpu *c;
+
+	c = to->to_cpu;
+	if (c == NULL) {
+		/* never added */
+		return false;
+	}
+
+	spinlock_acquire(&c->c_timeout_lock);
+	if (to->to_pending) {
+		timeout_unlink(to);
+		spinlock_release(&c->c_timeout_lock);
+		return true;
+	}
+
+	/*
+	 * Already fired. If the function is still running (which can
+	 * only be on another cpu) wait for it; the caller is probably
+	 * about to free the timeout or what its argument points to.
+	 */
+	while (c->c_timeout_running == to) {
+		spinlock_release(&c->c_timeout_lock);
+		spinlock_acquire(&c->c_timeout_lock);
+	}
+	spinlock_release(&c->c_timeout_lock);
+	return false;
+}
+
+/*
+ * Fire whatever has expired in the wheel bucket for tick NOW. The
+ * bucket also holds timeouts for later laps of the wheel; those are
+ * skipped.
+ *
+ * The functions are called without the timeout lock, one at a time,
+ * with c_timeout_running set so timeout_cancel knows to wait. Since
+ * the bucket may change while the lock is dropped, go back to its
+ * head after each one. Nothing a function adds can expire this tick,
+ * so this terminates.
+ */
+static
+void
+timeout_run(struct cpu *c, unsigned now)
+{
+	struct timeout **bucket, *to;
+	void (*func)(void *);
+	void *arg;
+
+	bucket = &c->c_timeouts[now & (TIMEOUT_WHEELSIZE - 1)];
+
+	spinlock_acquire(&c->c_timeout_lock);
+	to = *bucket;
+	while (to != NULL) {
+		if ((int)(to->to_expire - now) > 0) {
+			to = to->to_next;
+			continue;
+		}
+		timeout_unlink(to);
+		func = to->to_func;
+		arg = to->to_arg;
+		c->c_timeout_running = to;
+		spinlock_release(&c->c_timeout_lock);
+
+		func(arg);
+
+		spinlock_acquire(&c->c_timeout_lock);
+		c->c_timeout_running = NULL;
+		to = *bucket;
+	}
+	spinlock_release(&c->c_timeout_lock);
+}
+
+unsigned
+timeout_ticks(const struct timespec *ts)
+{
+	const uint32_t nsecs_per_tick = 1000000000 / HZ;
+	uint64_t ticks;
+
+	if (ts->tv_sec < 0 || ts->tv_nsec < 0) {
+		return 0;
+	}
+	if (ts->tv_sec >= TIMEOUT_MAXTICKS / HZ) {
+		return TIMEOUT_MAXTICKS;
+	}
+
+	ticks = (uint64_t)ts->tv_sec * HZ +
+		((uint32_t)ts->tv_nsec + nsecs_per_tick - 1) / nsecs_per_tick;
+	if (ticks == 0) {
+		return 0;
+	}
+
+	/* The current tick may be nearly over; don't count it. */
+	ticks++;
+
+	if (ticks > TIMEOUT_MAXTICKS) {
+		ticks = TIMEOUT_MAXTICKS;
+	}
+	return ticks;
+}
+
+/*
+ * Return the number of ticks until the next timeout on cpu C is due,
+ * or LIMIT if that's sooner.
+ */
+static
+unsigned
+timeout_nextdue(struct cpu *c, unsigned limit)
+{
+	struct timeout *to;
+	unsigned i, due;
+	int ticks;
+
+	due = limit;
+	spinlock_acquire(&c->c_timeout_lock);
+	for (i=0; i<TIMEOUT_WHEELSIZE && c->c_ntimeouts > 0; i++) {
+		for (to = c->c_timeouts[i]; to != NULL; to = to->to_next) {
+			ticks = to->to_expire - c->c_hardclocks;
+			if (ticks <= 0) {
+				due = 0;
+			}
+			else if ((unsigned)ticks < due) {
+				due = ticks;
+			}
+		}
+	}
+	spinlock_release(&c->c_timeout_lock);
+	return due;
+}
+
+////////////////////////////////////////////////////////////
+// clock interrupts
+
+/*
+ * Account for TICKS ticks that went by without a call to hardclock(),
+ * running any timeouts that came due in them. (Normally there aren't
+ * any, since the tick is only deferred up to the next one due.)
+ */
+static
+void
+hardclock_skip(struct cpu *c, unsigned ticks)
+{
+	c->c_ticks_skipped += ticks;
+	if (c->c_ntimeouts == 0) {
+		c->c_hardclocks += ticks;
+		return;
+	}
+	while (ticks-- > 0) {
+		c->c_hardclocks++;
+		timeout_run(c, c->c_hardclocks);
+	}
+}
+
+/*
+ * Tickless idle.
+ *
+ * hardclock_idle is called by thread_switch, with interrupts off,
+ * when the cpu is about to idle. An idle cpu has nothing to schedule,
+ * so the only use of its clock tick is to run timeouts; so turn the
+ * tick off until the next one is due.
+ *
+ * The cpu comes back out of idle either when that timer interrupt
+ * goes off (see hardclock below) or on some other interrupt, such as
+ * an IPI saying there are threads to run. In the latter case
+ * thread_switch calls hardclock_unidle, which turns the tick back on
+ * and catches up c_hardclocks.
+ */
+void
+hardclock_idle(void)
+{
+	struct cpu *c;
+	unsigned ticks;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	c = curcpu->c_self;
+	KASSERT(c->c_tickless == 0);
+
+	ticks = timeout_nextdue(c, TICKLESS_MAXTICKS);
+	if (ticks <= 1) {
+		return;
+	}
+	c->c_tickless = ticks;
+	c->c_tickless_idles++;
+	mainbus_timer_defer(ticks);
+}
+
+void
+hardclock_unidle(void)
+{
+	struct cpu *c;
+	unsigned ticks;
+	int spl;
+
+	spl = splhigh();
+	c = curcpu->c_self;
+	if (c->c_tickless > 0) {
+		ticks = mainbus_timer_resume();
+		if (ticks > c->c_tickless) {
+			ticks = c->c_tickless;
+		}
+		c->c_tickless = 0;
+		hardclock_skip(c, ticks);
+	}
+	splx(spl);
+}
+
+/*
+ * Print the per-cpu clock statistics.
+ */
+void
+hardclock_printstats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	kprintf("cpu  hardclocks     skipped  deferrals\n");
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		kprintf("%3u  %10u  %10u  %9u\n", c->c_number,
+			c->c_hardclocks, c->c_ticks_skipped,
+			c->c_tickless_idles);
 	}
 }
 
@@ -79,10 +386,7 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
+	/* Nothing to do; timed sleeps are done with timeouts. */
 }
 
 /*
@@ -92,11 +396,35 @@ timerclock(void)
 void
 hardclock(void)
 {
+	unsigned skip;
+
 	/*
 	 * Collect statistics here as desired.
+	 *
+	 * Charge the tick to whoever it interrupted, in user or
+	 * kernel mode. The idle loop isn't charged to anyone.
 	 */
+	if (!curcpu->c_isidle) {
+		if (curthread->t_intr_user) {
+			curthread->t_usage.tu_uticks++;
+		}
+		else {
+			curthread->t_usage.tu_sticks++;
+		}
+	}
+
+	/*
+	 * If the tick was turned off while idle, this is the end of
+	 * the deferred period; catch up on the ticks before it.
+	 */
+	if (curcpu->c_tickless > 0) {
+		skip = curcpu->c_tickless - 1;
+		curcpu->c_tickless = 0;
+		hardclock_skip(curcpu->c_self, skip);
+	}
 
 	curcpu->c_hardclocks++;
+	timeout_run(curcpu->c_self, curcpu->c_hardclocks);
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -106,16 +434,34 @@ hardclock(void)
 	thread_yield();
 }
 
+/*
+ * Suspend execution for n ticks.
+ */
+void
+clocksleep_ticks(unsigned ticks)
+{
+	int result;
+
+	if (ticks == 0) {
+		return;
+	}
+
+	spinlock_acquire(&sleep_lock);
+	result = wchan_sleep_timeout(sleep_wchan, &sleep_lock, ticks);
+	KASSERT(result == ETIMEDOUT);
+	spinlock_release(&sleep_lock);
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > (int)(TIMEOUT_MAXTICKS / HZ)) {
+		num_secs = TIMEOUT_MAXTICKS / HZ;
+	}
+	if (num_secs > 0) {
+		clocksleep_ticks(num_secs * HZ);
 	}
-	spinlock_release(&lbolt_lock);
 }
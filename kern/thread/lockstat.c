@@ -0,0 +1,544 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock statistics. See <lockstat.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <current.h>
+#include <synch.h>
+#include <lockstat.h>
+#include <platform/maxcpus.h>
+
+/*
+ * The records live in a fixed open-addressed hash table. Nothing in
+ * here may use a spinlock or kmalloc, since both of those call back
+ * into us; the table's own lock is a bare test-and-set word.
+ *
+ * Entries are only ever added, never removed. A new entry has its key
+ * filled in before ls_kind is set, so lookups can scan the table
+ * without the lock and only need it to insert. Keys are call sites
+ * and lock names, not lock addresses, so locks that come and go (in
+ * kmalloc'd objects) don't use up the table.
+ *
+ * A record is shared by all the locks acquired at that call site or
+ * with that name, on every cpu, so the counters are not kept in it.
+ * Each cpu has its own array of counters, indexed like the table,
+ * which only that cpu updates (the hooks all run with interrupts
+ * off); lockstat_dump adds them up. The hot path thus takes no lock
+ * of ours at all once a record exists.
+ */
+
+#define LOCKSTAT_SIZE		512	/* must be a power of 2 */
+#define LOCKSTAT_NAMELEN	24
+
+#define LS_FREE		0
+#define LS_SPIN		1
+#define LS_SLEEP	2
+
+struct lockstat {
+	volatile unsigned ls_kind;	/* LS_* */
+	const void *ls_caller;		/* LS_SPIN: the call site */
+	char ls_name[LOCKSTAT_NAMELEN];	/* LS_SLEEP: lk_name (truncated) */
+};
+
+struct lockstat_counts {
+	uint32_t lc_acquires;		/* Number of acquisitions */
+	uint32_t lc_contended;		/* Number that had to wait */
+	uint64_t lc_waitcycles;		/* Total cycles spent waiting */
+	uint32_t lc_maxhold;		/* Longest hold, in cycles */
+};
+
+struct lockstat_cpu {
+	struct lockstat_counts lsc_counts[LOCKSTAT_SIZE];
+	unsigned lsc_overflow;		/* Acquisitions with no record */
+};
+
+volatile bool lockstat_enabled;
+
+static struct lockstat lockstat_table[LOCKSTAT_SIZE];
+static volatile spinlock_data_t lockstat_tablelock = SPINLOCK_DATA_INITIALIZER;
+
+/* Per-cpu counters; allocated by lockstat_start and kept thereafter. */
+static struct lockstat_cpu *lockstat_cpus[MAXCPUS];
+
+////////////////////////////////////////////////////////////
+// table lock
+
+/*
+ * The caller must have interrupts off: all the hooks are called with
+ * a spinlock held.
+ */
+static
+void
+lockstat_tablelock_acquire(void)
+{
+	while (spinlock_data_get(&lockstat_tablelock) != 0 ||
+	       spinlock_data_testandset(&lockstat_tablelock) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+}
+
+static
+void
+lockstat_tablelock_release(void)
+{
+	membar_any_store();
+	spinlock_data_set(&lockstat_tablelock, 0);
+}
+
+////////////////////////////////////////////////////////////
+// lookup
+
+static
+unsigned
+lockstat_hashptr(const void *caller)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)caller;
+	h ^= h >> 11;
+	h *= 0x9e3779b1;
+	return h >> 16;
+}
+
+static
+unsigned
+lockstat_hashname(const char *name)
+{
+	uint32_t h;
+	unsigned i;
+
+	h = 0;
+	for (i=0; i<LOCKSTAT_NAMELEN-1 && name[i] != 0; i++) {
+		h = h*33 + (unsigned char)name[i];
+	}
+	return h;
+}
+
+/*
+ * Compare a (truncated) record name with a lock name.
+ */
+static
+bool
+lockstat_namematch(const char *lsname, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN-1; i++) {
+		if (lsname[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			return true;
+		}
+	}
+	return true;
+}
+
+static
+bool
+lockstat_match(struct lockstat *ls, unsigned kind, const void *caller,
+	       const char *name)
+{
+	if (ls->ls_kind != kind) {
+		return false;
+	}
+	if (kind == LS_SPIN) {
+		return ls->ls_caller == caller;
+	}
+	return lockstat_namematch(ls->ls_name, name);
+}
+
+/*
+ * Find the record for a lock, adding it if necessary. Returns NULL
+ * if the table is full.
+ */
+static
+struct lockstat *
+lockstat_get(unsigned kind, const void *caller, const char *name,
+	     unsigned hash)
+{
+	struct lockstat *ls;
+	unsigned i, n;
+
+	/* Lockless scan first; this is the common case. */
+	for (n=0; n<LOCKSTAT_SIZE; n++) {
+		ls = &lockstat_table[(hash + n) & (LOCKSTAT_SIZE - 1)];
+		if (ls->ls_kind == LS_FREE) {
+			break;
+		}
+		if (lockstat_match(ls, kind, caller, name)) {
+			return ls;
+		}
+	}
+
+	/*
+	 * Not there; lock and scan again, since someone else may have
+	 * added it (or taken our free slot) in the meantime.
+	 */
+	lockstat_tablelock_acquire();
+	for (n=0; n<LOCKSTAT_SIZE; n++) {
+		ls = &lockstat_table[(hash + n) & (LOCKSTAT_SIZE - 1)];
+		if (ls->ls_kind == LS_FREE) {
+			ls->ls_caller = caller;
+			if (name != NULL) {
+				for (i=0; i<LOCKSTAT_NAMELEN-1 && name[i]; i++) {
+					ls->ls_name[i] = name[i];
+				}
+				ls->ls_name[i] = 0;
+			}
+			membar_store_store();
+			ls->ls_kind = kind;
+			lockstat_tablelock_release();
+			return ls;
+		}
+		if (lockstat_match(ls, kind, caller, name)) {
+			lockstat_tablelock_release();
+			return ls;
+		}
+	}
+	lockstat_tablelock_release();
+	return NULL;
+}
+
+/*
+ * Get this cpu's counters for a record.
+ */
+static
+struct lockstat_counts *
+lockstat_mycounts(struct lockstat_cpu *lsc, struct lockstat *ls)
+{
+	return &lsc->lsc_counts[ls - lockstat_table];
+}
+
+////////////////////////////////////////////////////////////
+// hooks
+
+/*
+ * Count one acquisition in this cpu's counters.
+ */
+static
+void
+lockstat_count(struct lockstat_cpu *lsc, struct lockstat *ls,
+	       bool contended, uint32_t cycles)
+{
+	struct lockstat_counts *lc;
+
+	lc = lockstat_mycounts(lsc, ls);
+	lc->lc_acquires++;
+	if (contended) {
+		lc->lc_contended++;
+		lc->lc_waitcycles += cycles;
+	}
+}
+
+/*
+ * Account a hold time in this cpu's counters. A sleep lock may be
+ * released on a different cpu than it was acquired on; that's fine,
+ * since the maximum is taken across cpus at dump time.
+ */
+static
+void
+lockstat_hold(struct lockstat *ls, uint32_t held)
+{
+	struct lockstat_cpu *lsc;
+	struct lockstat_counts *lc;
+
+	lsc = lockstat_cpus[curcpu->c_number];
+	if (lsc == NULL) {
+		return;
+	}
+	lc = lockstat_mycounts(lsc, ls);
+	if (held > lc->lc_maxhold) {
+		lc->lc_maxhold = held;
+	}
+}
+
+void
+lockstat_spinlock_acquired(struct spinlock *lk, const void *caller,
+			   bool contended, uint32_t cycles)
+{
+	struct lockstat_cpu *lsc;
+	struct lockstat *ls;
+
+	if (!CURCPU_EXISTS()) {
+		return;
+	}
+	lsc = lockstat_cpus[curcpu->c_number];
+	if (lsc == NULL) {
+		return;
+	}
+
+	ls = lockstat_get(LS_SPIN, caller, NULL, lockstat_hashptr(caller));
+	if (ls == NULL) {
+		lsc->lsc_overflow++;
+		return;
+	}
+	lockstat_count(lsc, ls, contended, cycles);
+
+	lk->splk_stat = ls;
+	lk->splk_stamp = cpu_getcycles();
+}
+
+void
+lockstat_spinlock_released(struct spinlock *lk)
+{
+	lockstat_hold(lk->splk_stat, cpu_getcycles() - lk->splk_stamp);
+	lk->splk_stat = NULL;
+}
+
+void
+lockstat_lock_acquired(struct lock *lk, bool contended, uint32_t cycles)
+{
+	struct lockstat_cpu *lsc;
+	struct lockstat *ls;
+
+	lsc = lockstat_cpus[curcpu->c_number];
+	if (lsc == NULL) {
+		return;
+	}
+
+	ls = lk->lk_stat;
+	if (ls == NULL) {
+		ls = lockstat_get(LS_SLEEP, NULL, lk->lk_name,
+				  lockstat_hashname(lk->lk_name));
+		if (ls == NULL) {
+			lsc->lsc_overflow++;
+			return;
+		}
+		lk->lk_stat = ls;
+	}
+	lockstat_count(lsc, ls, contended, cycles);
+
+	lk->lk_stamped = true;
+	lk->lk_stamp = cpu_getcycles();
+}
+
+void
+lockstat_lock_released(struct lock *lk)
+{
+	lockstat_hold(lk->lk_stat, cpu_getcycles() - lk->lk_stamp);
+	lk->lk_stamped = false;
+}
+
+////////////////////////////////////////////////////////////
+// control and reporting
+
+int
+lockstat_start(void)
+{
+	struct lockstat_cpu *lsc;
+	unsigned i;
+
+	for (i=0; i<cpu_count(); i++) {
+		if (lockstat_cpus[i] != NULL) {
+			continue;
+		}
+		lsc = kmalloc(sizeof(*lsc));
+		if (lsc == NULL) {
+			return ENOMEM;
+		}
+		bzero(lsc, sizeof(*lsc));
+		membar_store_store();
+		lockstat_cpus[i] = lsc;
+	}
+	lockstat_enabled = true;
+	membar_any_any();
+	return 0;
+}
+
+void
+lockstat_stop(void)
+{
+	lockstat_enabled = false;
+	membar_any_any();
+}
+
+/*
+ * Zero the counters. The keys stay, because locks may be holding
+ * pointers to their records; since they're call sites and names, the
+ * same ones come up again in the next run.
+ *
+ * The other cpus' counters are zeroed out from under them, so if
+ * lockstat is running an acquisition or two may survive the reset.
+ */
+void
+lockstat_reset(void)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		if (lockstat_cpus[i] != NULL) {
+			bzero(lockstat_cpus[i], sizeof(*lockstat_cpus[i]));
+		}
+	}
+}
+
+/*
+ * One line of the report: a record's key with the counters of all
+ * the cpus added up.
+ */
+struct lockstat_line {
+	unsigned ll_kind;
+	const void *ll_caller;
+	const char *ll_name;
+	struct lockstat_counts ll_counts;
+};
+
+/*
+ * Add up the per-cpu counters for each record into LINES, and return
+ * the number of acquisitions that had no record.
+ */
+static
+unsigned
+lockstat_collect(struct lockstat_line *lines)
+{
+	struct lockstat_counts *lc, *tot;
+	struct lockstat_cpu *lsc;
+	unsigned i, j, overflow;
+
+	for (i=0; i<LOCKSTAT_SIZE; i++) {
+		lines[i].ll_kind = lockstat_table[i].ls_kind;
+		membar_load_load();
+		lines[i].ll_caller = lockstat_table[i].ls_caller;
+		lines[i].ll_name = lockstat_table[i].ls_name;
+		bzero(&lines[i].ll_counts, sizeof(lines[i].ll_counts));
+	}
+
+	overflow = 0;
+	for (j=0; j<MAXCPUS; j++) {
+		lsc = lockstat_cpus[j];
+		if (lsc == NULL) {
+			continue;
+		}
+		for (i=0; i<LOCKSTAT_SIZE; i++) {
+			lc = &lsc->lsc_counts[i];
+			tot = &lines[i].ll_counts;
+			tot->lc_acquires += lc->lc_acquires;
+			tot->lc_contended += lc->lc_contended;
+			tot->lc_waitcycles += lc->lc_waitcycles;
+			if (lc->lc_maxhold > tot->lc_maxhold) {
+				tot->lc_maxhold = lc->lc_maxhold;
+			}
+		}
+		overflow += lsc->lsc_overflow;
+	}
+	return overflow;
+}
+
+/*
+ * Print the lines of one kind, most total waiting first. LINES is a
+ * private copy, which we sort in place.
+ */
+static
+void
+lockstat_print(struct lockstat_line *lines, unsigned num, unsigned kind)
+{
+	struct lockstat_line tmp;
+	struct lockstat_counts *lc;
+	unsigned i, j, shown;
+
+	/* Insertion sort; the table is not large. */
+	for (i=1; i<num; i++) {
+		tmp = lines[i];
+		for (j=i; j>0 && lines[j-1].ll_counts.lc_waitcycles <
+			     tmp.ll_counts.lc_waitcycles; j--) {
+			lines[j] = lines[j-1];
+		}
+		lines[j] = tmp;
+	}
+
+	shown = 0;
+	for (i=0; i<num; i++) {
+		lc = &lines[i].ll_counts;
+		if (lines[i].ll_kind != kind || lc->lc_acquires == 0) {
+			continue;
+		}
+		if (kind == LS_SPIN) {
+			kprintf("  %-21p", lines[i].ll_caller);
+		}
+		else {
+			kprintf("  %-21s", lines[i].ll_name);
+		}
+		kprintf(" %10u %10u %14llu %10u\n",
+			lc->lc_acquires, lc->lc_contended,
+			lc->lc_waitcycles, lc->lc_maxhold);
+		shown++;
+	}
+	if (shown == 0) {
+		kprintf("  (none)\n");
+	}
+}
+
+void
+lockstat_dump(void)
+{
+	struct lockstat_line *lines;
+	unsigned overflow;
+
+	/*
+	 * Add everything up first; printing takes locks of its own,
+	 * and would otherwise be changing the numbers as we go. The
+	 * other cpus keep counting while we read, so the totals from
+	 * a running lockstat are only a snapshot to within a few
+	 * acquisitions.
+	 */
+	lines = kmalloc(LOCKSTAT_SIZE * sizeof(*lines));
+	if (lines == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+	overflow = lockstat_collect(lines);
+
+	kprintf("lockstat: %s; times in cycles\n",
+		lockstat_enabled ? "running" : "stopped");
+	kprintf("Spinlocks, by call site:\n");
+	kprintf("  %-21s %10s %10s %14s %10s\n", "caller",
+		"acquires", "contended", "spin", "max hold");
+	lockstat_print(lines, LOCKSTAT_SIZE, LS_SPIN);
+	kprintf("Sleep locks, by name:\n");
+	kprintf("  %-21s %10s %10s %14s %10s\n", "name",
+		"acquires", "contended", "wait", "max hold");
+	lockstat_print(lines, LOCKSTAT_SIZE, LS_SLEEP);
+	if (overflow > 0) {
+		kprintf("Table full: %u acquisitions not recorded\n",
+			overflow);
+	}
+
+	kfree(lines);
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Sampling profiler. See <prof.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <proc.h>
+#include <current.h>
+#include <vfs.h>
+#include <prof.h>
+#include <platform/maxcpus.h>
+
+/*
+ * Each cpu writes only its own buffer, from its timer interrupt, so
+ * no locking is needed. pb_next counts all samples taken; the ones
+ * past PROF_NSAMPLES were dropped.
+ *
+ * As with the trace rings, the buffers are allocated the first time
+ * profiling is turned on and never freed.
+ */
+struct profbuf {
+	unsigned pb_next;
+	struct prof_sample pb_samples[PROF_NSAMPLES];
+};
+
+volatile bool prof_enabled;
+
+static struct profbuf *prof_bufs[MAXCPUS];
+
+void
+prof_sample(uint32_t pc, uint32_t ra, bool user)
+{
+	struct profbuf *pb;
+	struct prof_sample *ps;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	pb = prof_bufs[curcpu->c_number];
+	if (pb == NULL) {
+		return;
+	}
+	if (pb->pb_next < PROF_NSAMPLES) {
+		ps = &pb->pb_samples[pb->pb_next];
+		ps->ps_pc = pc;
+		ps->ps_ra = ra;
+		ps->ps_pid = curproc != NULL ? curproc->p_pid : 0;
+		ps->ps_flags = user ? PS_USER : 0;
+	}
+	pb->pb_next++;
+}
+
+int
+prof_start(void)
+{
+	struct profbuf *pb;
+	unsigned i;
+
+	for (i=0; i<cpu_count(); i++) {
+		if (prof_bufs[i] != NULL) {
+			continue;
+		}
+		pb = kmalloc(sizeof(*pb));
+		if (pb == NULL) {
+			return ENOMEM;
+		}
+		pb->pb_next = 0;
+		prof_bufs[i] = pb;
+	}
+	prof_enabled = true;
+	return 0;
+}
+
+void
+prof_stop(void)
+{
+	prof_enabled = false;
+}
+
+void
+prof_clear(void)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		if (prof_bufs[i] != NULL) {
+			prof_bufs[i]->pb_next = 0;
+		}
+	}
+}
+
+void
+prof_printstats(void)
+{
+	struct profbuf *pb;
+	unsigned i;
+
+	kprintf("prof: %s, %u samples/sec per cpu\n",
+		prof_enabled ? "running" : "stopped", HZ * PROF_TICKDIV);
+	kprintf("cpu     samples        lost\n");
+	for (i=0; i<MAXCPUS; i++) {
+		pb = prof_bufs[i];
+		if (pb == NULL) {
+			continue;
+		}
+		kprintf("%3u  %10u  %10u\n", i,
+			pb->pb_next < PROF_NSAMPLES ?
+			pb->pb_next : PROF_NSAMPLES,
+			pb->pb_next < PROF_NSAMPLES ? 0 :
+			pb->pb_next - PROF_NSAMPLES);
+	}
+}
+
+int
+prof_dump(const char *path)
+{
+	struct prof_header ph;
+	struct prof_cpuheader pc;
+	struct profbuf *pb;
+	struct vnode *vn;
+	unsigned i;
+	off_t pos;
+	int result;
+
+	prof_stop();
+
+	result = vfs_dumpopen(path, &vn);
+	if (result) {
+		return result;
+	}
+
+	ph.ph_magic = PROF_MAGIC;
+	ph.ph_version = PROF_VERSION;
+	ph.ph_ncpus = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		if (prof_bufs[i] != NULL) {
+			ph.ph_ncpus++;
+		}
+	}
+	ph.ph_samplesize = sizeof(struct prof_sample);
+	ph.ph_rate = HZ * PROF_TICKDIV;
+	pos = 0;
+	result = vfs_dumpwrite(vn, &pos, &ph, sizeof(ph));
+
+	for (i=0; i<MAXCPUS && result == 0; i++) {
+		pb = prof_bufs[i];
+		if (pb == NULL) {
+			continue;
+		}
+		pc.pc_cpu = i;
+		pc.pc_count = pb->pb_next < PROF_NSAMPLES ?
+			pb->pb_next : PROF_NSAMPLES;
+		pc.pc_lost = pb->pb_next - pc.pc_count;
+		result = vfs_dumpwrite(vn, &pos, &pc, sizeof(pc));
+		if (result) {
+			break;
+		}
+		result = vfs_dumpwrite(vn, &pos, pb->pb_samples,
+			pc.pc_count * sizeof(struct prof_sample));
+	}
+
+	vfs_close(vn);
+	return result;
+}
@@ -37,6 +37,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <membar.h>
+#include <lockstat.h>
 #include <current.h>	/* for curcpu */
 
 /*
@@ -50,8 +51,11 @@
 void
 spinlock_init(struct spinlock *splk)
 {
-	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_next, 0);
+	spinlock_data_set(&splk->splk_serving, 0);
 	splk->splk_holder = NULL;
+	splk->splk_stat = NULL;
+	splk->splk_stamp = 0;
 }
 
 /*
@@ -61,7 +65,8 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	KASSERT(spinlock_data_get(&splk->splk_next) ==
+		spinlock_data_get(&splk->splk_serving));
 }
 
 /*
@@ -69,12 +74,15 @@ spinlock_cleanup(struct spinlock *splk)
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
  * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * atomic operation to take a ticket and wait for our turn.
  */
 void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket;
+	bool contended;
+	uint32_t start;
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,28 +98,38 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
+	/*
+	 * Fetch-and-increment is a machine-level atomic operation, so
+	 * every acquirer gets a distinct ticket. Then just read
+	 * splk_serving until it comes around to ours. Unlike
+	 * test-and-set, the waiting loop does no writes, and the lock
+	 * is handed out in the order the tickets were taken.
+	 *
+	 * The counters are allowed to wrap.
+	 *
+	 * The cycle counter is only read if we have to wait and
+	 * lockstat wants to know for how long.
+	 */
+	ticket = spinlock_data_fetchinc(&splk->splk_next);
+	contended = false;
+	start = 0;
+	if (spinlock_data_get(&splk->splk_serving) != ticket) {
+		contended = true;
+		if (lockstat_enabled) {
+			start = cpu_getcycles();
 		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
+		while (spinlock_data_get(&splk->splk_serving) != ticket) {
+			/* spin */
 		}
-		break;
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+
+	if (lockstat_enabled) {
+		lockstat_spinlock_acquired(splk, __builtin_return_address(0),
+			contended, contended ? cpu_getcycles() - start : 0);
+	}
 }
 
 /*
@@ -127,9 +145,18 @@ spinlock_release(struct spinlock *splk)
 		curcpu->c_spinlocks--;
 	}
 
+	if (splk->splk_stat != NULL) {
+		lockstat_spinlock_released(splk);
+	}
+
+	/*
+	 * Only the holder writes splk_serving, so a plain increment
+	 * is enough to pass the lock to the next ticket.
+	 */
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_serving,
+			  spinlock_data_get(&splk->splk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
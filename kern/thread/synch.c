@@ -33,12 +33,16 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <cpu.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <synch.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -120,6 +124,33 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+int
+P_intr(struct semaphore *sem)
+{
+	int result;
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	result = proc_intr_begin(sem->sem_wchan, &sem->sem_lock);
+	if (result) {
+		return result;
+	}
+	spinlock_acquire(&sem->sem_lock);
+	while (sem->sem_count == 0 && !curproc->p_exiting) {
+		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+	}
+	if (sem->sem_count > 0) {
+		sem->sem_count--;
+	}
+	else {
+		result = EINTR;
+	}
+	spinlock_release(&sem->sem_lock);
+	proc_intr_end();
+	return result;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -138,6 +169,126 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Priority inheritance.
+ *
+ * Each lock keeps a list of the threads waiting for it (lk_waiters,
+ * linked through t_lknext), and each thread a list of the locks it
+ * holds that have waiters (t_heldlocks, linked through lk_heldnext).
+ * A thread's effective priority is the highest of its own and those
+ * of the waiters for its locks; lock_pi_propagate recomputes it and
+ * follows t_blockedon to pass a change on to the next holder.
+ *
+ * All of that is protected by lock_pilock, which is taken after the
+ * lock's own spinlock and before the run queue locks. Walking a
+ * chain means reading the lk_holder of locks whose spinlocks we
+ * don't hold, so lk_holder is also only changed under lock_pilock
+ * while the lock has waiters. Otherwise -- the common case -- locks
+ * are taken and given up without touching lock_pilock at all.
+ */
+static struct spinlock lock_pilock = SPINLOCK_INITIALIZER;
+
+/*
+ * The priority thread T should have, counting what it inherits.
+ */
+static
+int
+lock_pi_compute(struct thread *t)
+{
+	struct lock *lk;
+	struct thread *w;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(&lock_pilock));
+
+	pri = t->t_basepri;
+	for (lk = t->t_heldlocks; lk != NULL; lk = lk->lk_heldnext) {
+		for (w = lk->lk_waiters; w != NULL; w = w->t_lknext) {
+			if (w->t_pri > pri) {
+				pri = w->t_pri;
+			}
+		}
+	}
+	return pri;
+}
+
+/*
+ * The waiters for LK have changed; update its holder's priority, and
+ * if that changes, that of the holder of the lock the holder is
+ * waiting for, and so on. A deadlock cycle stops once the priorities
+ * stop changing.
+ */
+static
+void
+lock_pi_propagate(struct lock *lk)
+{
+	struct thread *t;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(&lock_pilock));
+
+	while (lk != NULL && (t = lk->lk_holder) != NULL) {
+		pri = lock_pi_compute(t);
+		if (pri == t->t_pri) {
+			break;
+		}
+		thread_setpri(t, pri);
+		lk = t->t_blockedon;
+	}
+}
+
+/*
+ * Take LK off the list of held locks of thread T.
+ */
+static
+void
+lock_pi_unhold(struct thread *t, struct lock *lk)
+{
+	struct lock **lkp;
+
+	KASSERT(spinlock_do_i_hold(&lock_pilock));
+
+	for (lkp = &t->t_heldlocks; *lkp != lk; lkp = &(*lkp)->lk_heldnext) {
+		KASSERT(*lkp != NULL);
+	}
+	*lkp = lk->lk_heldnext;
+	lk->lk_heldnext = NULL;
+}
+
+/*
+ * Take thread T off the waiters for LK.
+ */
+static
+void
+lock_pi_unwait(struct lock *lk, struct thread *t)
+{
+	struct thread **tp;
+
+	KASSERT(spinlock_do_i_hold(&lock_pilock));
+
+	for (tp = &lk->lk_waiters; *tp != t; tp = &(*tp)->t_lknext) {
+		KASSERT(*tp != NULL);
+	}
+	*tp = t->t_lknext;
+	t->t_lknext = NULL;
+	t->t_blockedon = NULL;
+}
+
+void
+lock_setbasepri(struct thread *t, int pri)
+{
+	KASSERT(pri >= PRI_MIN && pri <= PRI_MAX);
+
+	spinlock_acquire(&lock_pilock);
+	t->t_basepri = pri;
+	pri = lock_pi_compute(t);
+	if (pri != t->t_pri) {
+		thread_setpri(t, pri);
+		lock_pi_propagate(t->t_blockedon);
+	}
+	spinlock_release(&lock_pilock);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -154,7 +305,20 @@ lock_create(const char *name)
                 return NULL;
         }
 
-        // add stuff here as needed
+	lock->lk_wchan = wchan_create(lock->lk_name);
+	if (lock->lk_wchan == NULL) {
+		kfree(lock->lk_name);
+		kfree(lock);
+		return NULL;
+	}
+
+	spinlock_init(&lock->lk_lock);
+	lock->lk_holder = NULL;
+	lock->lk_stat = NULL;
+	lock->lk_stamped = false;
+	lock->lk_stamp = 0;
+	lock->lk_waiters = NULL;
+	lock->lk_heldnext = NULL;
 
         return lock;
 }
@@ -163,9 +327,12 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
+	KASSERT(lock->lk_holder == NULL);
+	KASSERT(lock->lk_waiters == NULL);
 
-        // add stuff here as needed
-
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&lock->lk_lock);
+	wchan_destroy(lock->lk_wchan);
         kfree(lock->lk_name);
         kfree(lock);
 }
@@ -173,27 +340,145 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
-        // Write this
+	bool contended;
+	uint32_t start;
+
+	KASSERT(lock != NULL);
+
+	/* May not block in an interrupt handler. */
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&lock->lk_lock);
+	if (lock->lk_holder == curthread) {
+		panic("Deadlock on lock %s\n", lock->lk_name);
+	}
+
+	contended = false;
+	start = 0;
+	if (lock->lk_holder != NULL) {
+		contended = true;
+		if (lockstat_enabled) {
+			start = cpu_getcycles();
+		}
+
+		/* Wait in line, and lend the holder our priority. */
+		spinlock_acquire(&lock_pilock);
+		if (lock->lk_waiters == NULL) {
+			lock->lk_heldnext = lock->lk_holder->t_heldlocks;
+			lock->lk_holder->t_heldlocks = lock;
+		}
+		curthread->t_blockedon = lock;
+		curthread->t_lknext = lock->lk_waiters;
+		lock->lk_waiters = curthread;
+		lock_pi_propagate(lock);
+		spinlock_release(&lock_pilock);
 
-        (void)lock;  // suppress warning until code gets written
+		/*
+		 * lock_release wakes the highest-priority waiter, but
+		 * as with semaphores we don't promise it gets the
+		 * lock: another thread can take it first.
+		 */
+		while (lock->lk_holder != NULL) {
+			wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		}
+
+		spinlock_acquire(&lock_pilock);
+		lock_pi_unwait(lock, curthread);
+		spinlock_release(&lock_pilock);
+	}
+
+	if (lock->lk_waiters != NULL) {
+		/* Inherit from the ones still waiting. */
+		spinlock_acquire(&lock_pilock);
+		lock->lk_holder = curthread;
+		lock->lk_heldnext = curthread->t_heldlocks;
+		curthread->t_heldlocks = lock;
+		lock_pi_propagate(lock);
+		spinlock_release(&lock_pilock);
+	}
+	else {
+		lock->lk_holder = curthread;
+	}
+
+	if (lockstat_enabled) {
+		lockstat_lock_acquired(lock, contended,
+				       contended ? cpu_getcycles() - start : 0);
+	}
+	spinlock_release(&lock->lk_lock);
 }
 
 void
 lock_release(struct lock *lock)
 {
-        // Write this
+	struct thread *t, *next;
+	int pri;
+	bool lowered;
+
+	KASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(lock->lk_holder == curthread);
+	if (lock->lk_stamped) {
+		lockstat_lock_released(lock);
+	}
 
-        (void)lock;  // suppress warning until code gets written
+	/* Nobody can be asleep on the wchan if there are no waiters. */
+	if (lock->lk_waiters == NULL) {
+		lock->lk_holder = NULL;
+		spinlock_release(&lock->lk_lock);
+		return;
+	}
+
+	/*
+	 * Give back what we inherited through this lock, and pick the
+	 * waiter to wake: the one with the highest priority that is
+	 * still asleep, the longest-waiting one in case of a tie. (A
+	 * waiter already woken but not yet running is about to try
+	 * for the lock anyway.)
+	 */
+	spinlock_acquire(&lock_pilock);
+	lock_pi_unhold(curthread, lock);
+	lock->lk_holder = NULL;
+	pri = lock_pi_compute(curthread);
+	lowered = pri < curthread->t_pri;
+	if (pri != curthread->t_pri) {
+		thread_setpri(curthread, pri);
+	}
+	next = NULL;
+	for (t = lock->lk_waiters; t != NULL; t = t->t_lknext) {
+		if (t->t_wchan == lock->lk_wchan &&
+		    (next == NULL || t->t_pri >= next->t_pri)) {
+			next = t;
+		}
+	}
+	spinlock_release(&lock_pilock);
+
+	if (next != NULL) {
+		wchan_wakethread(lock->lk_wchan, &lock->lk_lock, next);
+	}
+	spinlock_release(&lock->lk_lock);
+
+	/*
+	 * If we were only running at the priority we had borrowed,
+	 * let the waiter (or whoever else is ahead of us now) run;
+	 * unless we can't, because the caller holds a spinlock (as
+	 * cv_wait does).
+	 */
+	if (lowered && curthread->t_curspl == 0) {
+		thread_yield();
+	}
 }
 
 bool
 lock_do_i_hold(struct lock *lock)
 {
-        // Write this
-
-        (void)lock;  // suppress warning until code gets written
+	KASSERT(lock != NULL);
 
-        return true; // dummy until code gets written
+	/*
+	 * Only the current thread can make this true or make it
+	 * false, so no need to lock.
+	 */
+	return lock->lk_holder == curthread;
 }
 
 ////////////////////////////////////////////////////////////
@@ -216,7 +501,14 @@ cv_create(const char *name)
                 return NULL;
         }
 
-        // add stuff here as needed
+	cv->cv_wchan = wchan_create(cv->cv_name);
+	if (cv->cv_wchan == NULL) {
+		kfree(cv->cv_name);
+		kfree(cv);
+		return NULL;
+	}
+
+	spinlock_init(&cv->cv_lock);
 
         return cv;
 }
@@ -226,8 +518,9 @@ cv_destroy(struct cv *cv)
 {
         KASSERT(cv != NULL);
 
-        // add stuff here as needed
-
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&cv->cv_lock);
+	wchan_destroy(cv->cv_wchan);
         kfree(cv->cv_name);
         kfree(cv);
 }
@@ -235,23 +528,65 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-        // Write this
-        (void)cv;    // suppress warning until code gets written
-        (void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	/*
+	 * Take the CV's spinlock before dropping the lock. Anyone
+	 * signalling must hold the lock and then take the spinlock,
+	 * so no wakeup can get in between the release and the sleep.
+	 */
+	spinlock_acquire(&cv->cv_lock);
+	lock_release(lock);
+	wchan_sleep(cv->cv_wchan, &cv->cv_lock);
+	spinlock_release(&cv->cv_lock);
+	lock_acquire(lock);
+}
+
+int
+cv_wait_intr(struct cv *cv, struct lock *lock)
+{
+	int result;
+
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	result = proc_intr_begin(cv->cv_wchan, &cv->cv_lock);
+	if (result) {
+		return result;
+	}
+
+	/* As in cv_wait; proc_exit sets p_exiting before it wakes us. */
+	spinlock_acquire(&cv->cv_lock);
+	lock_release(lock);
+	if (!curproc->p_exiting) {
+		wchan_sleep(cv->cv_wchan, &cv->cv_lock);
+	}
+	spinlock_release(&cv->cv_lock);
+	proc_intr_end();
+	lock_acquire(lock);
+
+	return curproc->p_exiting ? EINTR : 0;
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-        // Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_lock);
+	wchan_wakeone(cv->cv_wchan, &cv->cv_lock);
+	spinlock_release(&cv->cv_lock);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	// Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_lock);
+	wchan_wakeall(cv->cv_wchan, &cv->cv_lock);
+	spinlock_release(&cv->cv_lock);
 }
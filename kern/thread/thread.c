@@ -42,6 +42,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <clock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <threadlist.h>
@@ -53,6 +54,7 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <trace.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
@@ -63,6 +65,13 @@ struct wchan {
 	const char *wc_name;		/* name for this channel */
 	struct threadlist wc_threads;	/* list of waiting threads */
 	unsigned wc_index;		/* index into allwchans[] */
+
+	/* Statistics, also protected by the associated spinlock */
+	unsigned wc_sleeps;		/* calls to wchan_sleep* */
+	unsigned wc_resleeps;		/* sleeps right after a wakeup here */
+	unsigned wc_wakeups;		/* threads woken */
+	uint64_t wc_sleepcycles;	/* total time asleep */
+	uint32_t wc_maxcycles;		/* longest single sleep */
 };
 
 /* Master array of CPUs. */
@@ -76,6 +85,10 @@ DEFARRAY(wchan, static __UNUSED inline);
 static struct spinlock allwchans_lock;
 static struct wchanarray allwchans;
 
+/* Array of all threads, including cached ones (also for debugging) */
+static struct spinlock allthreads_lock;
+static struct threadarray allthreads;
+
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
@@ -119,34 +132,101 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Install a new name: NAME copied into t_namebuf if COPY is NULL,
+ * otherwise COPY itself, which must be kmalloc'd. thread_printall
+ * reads t_name of threads on allthreads[] under allthreads_lock, so
+ * the change is made under it, and the old name is freed afterwards.
  */
 static
-struct thread *
-thread_create(const char *name)
+void
+thread_putname(struct thread *thread, const char *name, char *copy)
 {
-	struct thread *thread;
+	char *old;
 
-	DEBUGASSERT(name != NULL);
+	spinlock_acquire(&allthreads_lock);
+	old = thread->t_name;
+	if (copy == NULL) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
+	}
+	else {
+		thread->t_name = copy;
+	}
+	spinlock_release(&allthreads_lock);
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	if (old != NULL && old != thread->t_namebuf) {
+		kfree(old);
 	}
+}
 
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+/*
+ * Set a thread's name. Short names are stored in t_namebuf, so that
+ * naming a thread usually needn't allocate memory. On failure the
+ * thread keeps its old name.
+ */
+static
+int
+thread_setname(struct thread *thread, const char *name)
+{
+	char *copy;
+
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		copy = NULL;
 	}
+	else {
+		copy = kstrdup(name);
+		if (copy == NULL) {
+			return ENOMEM;
+		}
+	}
+	thread_putname(thread, name, copy);
+	return 0;
+}
+
+/*
+ * Release whatever thread_setname allocated. The thread must already
+ * be off allthreads[].
+ */
+static
+void
+thread_freename(struct thread *thread)
+{
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
+	}
+	thread->t_name = NULL;
+}
+
+void
+thread_rename(struct thread *thread, char *name)
+{
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		thread_putname(thread, name, NULL);
+		kfree(name);
+	}
+	else {
+		thread_putname(thread, name, name);
+	}
+}
+
+/*
+ * Set up all the fields of a thread except for the name and the
+ * stack. Used on new threads and on ones recycled from the cache.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
+	thread->t_wchan = NULL;
 	thread->t_state = S_READY;
+	/* stamped when made runnable; cpu_getcycles needs curcpu */
+	thread->t_statestamp = 0;
+	thread->t_lastwchan = NULL;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
@@ -155,8 +235,60 @@ thread_create(const char *name)
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+	thread->t_intr_user = false;
+
+	/* Public fields */
+	thread->t_affinity = CPUMASK_ALL;
+	thread->t_tid = 0;
+	thread->t_basepri = PRI_DEFAULT;
+	thread->t_pri = PRI_DEFAULT;
+	thread->t_agebonus = 0;
+	thread->t_blockedon = NULL;
+	thread->t_lknext = NULL;
+	thread->t_heldlocks = NULL;
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_intrwchan = NULL;
+	thread->t_intrlock = NULL;
 
 	/* If you add to struct thread, be sure to initialize here */
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+	int result;
+
+	DEBUGASSERT(name != NULL);
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->t_name = NULL;
+	if (thread_setname(thread, name)) {
+		kfree(thread);
+		return NULL;
+	}
+	thread->t_stack = NULL;
+	thread_init(thread);
+
+	/* add to allthreads[] */
+	spinlock_acquire(&allthreads_lock);
+	result = threadarray_add(&allthreads, thread, &thread->t_allindex);
+	spinlock_release(&allthreads_lock);
+	if (result) {
+		KASSERT(result == ENOMEM);
+		thread_freename(thread);
+		kfree(thread);
+		return NULL;
+	}
 
 	return thread;
 }
@@ -174,6 +306,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -186,6 +319,11 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	c->c_idlethread = NULL;
+	c->c_migrant = NULL;
+	threadlist_init(&c->c_threadcache);
+	c->c_threadcache_hits = 0;
+	c->c_threadcache_misses = 0;
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
 
@@ -193,6 +331,17 @@ cpu_create(unsigned hardware_number)
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
 
+	for (i=0; i<TIMEOUT_WHEELSIZE; i++) {
+		c->c_timeouts[i] = NULL;
+	}
+	c->c_ntimeouts = 0;
+	c->c_timeout_running = NULL;
+	spinlock_init(&c->c_timeout_lock);
+	c->c_tickless = 0;
+	c->c_ticks_skipped = 0;
+	c->c_tickless_idles = 0;
+	bzero(&c->c_schedstat, sizeof(c->c_schedstat));
+
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
@@ -247,9 +396,25 @@ static
 void
 thread_destroy(struct thread *thread)
 {
+	unsigned num;
+	struct thread *t2;
+
 	KASSERT(thread != curthread);
 	KASSERT(thread->t_state != S_RUN);
 
+	/* remove from allthreads[] */
+	spinlock_acquire(&allthreads_lock);
+	num = threadarray_num(&allthreads);
+	KASSERT(threadarray_get(&allthreads, thread->t_allindex) == thread);
+	if (thread->t_allindex < num - 1) {
+		/* move the last entry into our slot */
+		t2 = threadarray_get(&allthreads, num - 1);
+		threadarray_set(&allthreads, thread->t_allindex, t2);
+		t2->t_allindex = thread->t_allindex;
+	}
+	threadarray_setsize(&allthreads, num - 1);
+	spinlock_release(&allthreads_lock);
+
 	/*
 	 * If you add things to struct thread, be sure to clean them up
 	 * either here or in thread_exit(). (And not both...)
@@ -266,10 +431,297 @@ thread_destroy(struct thread *thread)
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	thread_freename(thread);
 	kfree(thread);
 }
 
+/*
+ * Put an exited thread in the current cpu's thread cache, keeping its
+ * struct and stack for thread_fork to reuse. The rest of it is set up
+ * again when it comes out. Interrupts must be off.
+ *
+ * The thread stays on allthreads[], so it gets a placeholder name
+ * rather than none; thread_printall shows it as such.
+ */
+static
+void
+thread_recycle(struct thread *thread)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_state == S_ZOMBIE);
+	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_stack != NULL);
+
+	thread_checkstack(thread);
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread_putname(thread, "<cached>", NULL);
+	thread->t_wchan_name = "CACHED";
+
+	threadlistnode_init(&thread->t_listnode, thread);
+	threadlist_addhead(&curcpu->c_threadcache, thread);
+}
+
+/*
+ * Get a thread with a stack for thread_fork, from the current cpu's
+ * thread cache if possible and otherwise from kmalloc.
+ */
+static
+struct thread *
+thread_alloc(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	if (thread != NULL) {
+		curcpu->c_threadcache_hits++;
+	}
+	else {
+		curcpu->c_threadcache_misses++;
+	}
+	splx(spl);
+
+	if (thread != NULL) {
+		thread_init(thread);
+		if (thread_setname(thread, name)) {
+			thread_destroy(thread);
+			return NULL;
+		}
+		return thread;
+	}
+
+	thread = thread_create(name);
+	if (thread == NULL) {
+		return NULL;
+	}
+	thread->t_stack = kmalloc(STACK_SIZE);
+	if (thread->t_stack == NULL) {
+		thread_destroy(thread);
+		return NULL;
+	}
+	thread_checkstack_init(thread);
+	return thread;
+}
+
+void
+thread_printcachestats(void)
+{
+	struct cpu *c;
+	unsigned i, hits, total;
+
+	kprintf("cpu  cached        hits      misses  hit rate\n");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		hits = c->c_threadcache_hits;
+		total = hits + c->c_threadcache_misses;
+		kprintf("%3u  %6u  %10u  %10u  %7u%%\n", c->c_number,
+			c->c_threadcache.tl_count, hits,
+			c->c_threadcache_misses,
+			total == 0 ? 0 : (unsigned)(hits * 100ULL / total));
+	}
+}
+
+/*
+ * Scheduler latency histograms. Each cpu's are updated only by
+ * itself, in thread_switch with interrupts off; the other functions
+ * here read (or zero) them without locking.
+ */
+
+/* Count a time of CYCLES in a histogram. */
+static
+void
+schedstat_add(unsigned *hist, uint32_t cycles)
+{
+	unsigned bucket;
+
+	bucket = 0;
+	while (cycles > 1) {
+		cycles >>= 1;
+		bucket++;
+	}
+	hist[bucket]++;
+}
+
+/*
+ * Get the histograms of cpu CPUNUM, or the sum over all cpus if
+ * CPUNUM is -1.
+ */
+int
+thread_getschedstat(int cpunum, struct schedstat *ss)
+{
+	struct cpu *c;
+	unsigned i, j;
+
+	if (cpunum < -1 || cpunum >= (int)cpuarray_num(&allcpus)) {
+		return EINVAL;
+	}
+
+	bzero(ss, sizeof(*ss));
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		if (cpunum != -1 && i != (unsigned)cpunum) {
+			continue;
+		}
+		c = cpuarray_get(&allcpus, i);
+		for (j=0; j<SCHEDSTAT_BUCKETS; j++) {
+			ss->ss_runqueue[j] += c->c_schedstat.ss_runqueue[j];
+			ss->ss_timeslice[j] += c->c_schedstat.ss_timeslice[j];
+		}
+	}
+	return 0;
+}
+
+void
+thread_resetschedstats(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		bzero(&c->c_schedstat, sizeof(c->c_schedstat));
+	}
+}
+
+/*
+ * Return the run queue histogram of cpu N if RUNQUEUE is true, and
+ * its time slice histogram otherwise.
+ */
+static
+const unsigned *
+schedstat_hist(unsigned n, bool runqueue)
+{
+	struct schedstat *ss;
+
+	ss = &cpuarray_get(&allcpus, n)->c_schedstat;
+	return runqueue ? ss->ss_runqueue : ss->ss_timeslice;
+}
+
+/*
+ * Print one kind of histogram for every cpu, one column per cpu,
+ * leaving out the empty buckets at either end.
+ */
+static
+void
+schedstat_print(const char *title, bool runqueue)
+{
+	const unsigned *hist;
+	unsigned i, b, lo, hi, ncpus;
+	char name[16];
+
+	ncpus = cpuarray_num(&allcpus);
+	lo = SCHEDSTAT_BUCKETS;
+	hi = 0;
+	for (i=0; i<ncpus; i++) {
+		hist = schedstat_hist(i, runqueue);
+		for (b=0; b<SCHEDSTAT_BUCKETS; b++) {
+			if (hist[b] != 0) {
+				lo = b < lo ? b : lo;
+				hi = b > hi ? b : hi;
+			}
+		}
+	}
+
+	kprintf("%s, cycles:\n", title);
+	if (lo > hi) {
+		kprintf("  (none)\n");
+		return;
+	}
+	kprintf("  %10s", ">=");
+	for (i=0; i<ncpus; i++) {
+		snprintf(name, sizeof(name), "cpu%u", i);
+		kprintf(" %9s", name);
+	}
+	kprintf("\n");
+	for (b=lo; b<=hi; b++) {
+		kprintf("  %10u", b == 0 ? 0 : 1U << b);
+		for (i=0; i<ncpus; i++) {
+			kprintf(" %9u", schedstat_hist(i, runqueue)[b]);
+		}
+		kprintf("\n");
+	}
+}
+
+void
+thread_printschedstats(void)
+{
+	schedstat_print("Run queue latency", true);
+	schedstat_print("Time slice", false);
+}
+
+/*
+ * What thread_printall keeps of each thread. The strings are copied
+ * because the thread may rename itself or exit once we let go of
+ * allthreads_lock.
+ */
+struct threadsnap {
+	char ts_name[THREAD_NAMELEN];
+	char ts_wchan[16];
+	threadstate_t ts_state;
+	int ts_cpu;
+	int ts_tid;
+	uint32_t ts_cycles;
+};
+
+void
+thread_printall(void)
+{
+	static const char *const statenames[] = {
+		"run", "ready", "sleep", "zombie",
+	};
+	struct threadsnap *snap, *ts;
+	struct thread *t;
+	unsigned i, num, max;
+
+	/* Leave room for a few threads forked while we allocate. */
+	spinlock_acquire(&allthreads_lock);
+	max = threadarray_num(&allthreads) + 16;
+	spinlock_release(&allthreads_lock);
+
+	snap = kmalloc(max * sizeof(*snap));
+	if (snap == NULL) {
+		kprintf("ps: Out of memory\n");
+		return;
+	}
+
+	/*
+	 * Holding allthreads_lock keeps the threads from being
+	 * destroyed, but not from changing state under us; the fields
+	 * are read without their own locks and may be a little stale.
+	 */
+	spinlock_acquire(&allthreads_lock);
+	num = threadarray_num(&allthreads);
+	if (num > max) {
+		num = max;
+	}
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&allthreads, i);
+		ts = &snap[i];
+		snprintf(ts->ts_name, sizeof(ts->ts_name), "%s", t->t_name);
+		snprintf(ts->ts_wchan, sizeof(ts->ts_wchan), "%s",
+			 t->t_wchan_name != NULL ? t->t_wchan_name : "-");
+		ts->ts_state = t->t_state;
+		ts->ts_cpu = t->t_cpu != NULL ? (int)t->t_cpu->c_number : -1;
+		ts->ts_tid = t->t_tid;
+		ts->ts_cycles = cpu_getcycles() - t->t_statestamp;
+	}
+	spinlock_release(&allthreads_lock);
+
+	kprintf("%-23s %-6s %-15s %3s %5s %12s\n", "name", "state",
+		"wchan", "cpu", "tid", "cycles");
+	for (i=0; i<num; i++) {
+		ts = &snap[i];
+		kprintf("%-23s %-6s %-15s %3d %5d %12u\n", ts->ts_name,
+			statenames[ts->ts_state], ts->ts_wchan, ts->ts_cpu,
+			ts->ts_tid, ts->ts_cycles);
+	}
+	kprintf("%u threads\n", num);
+
+	kfree(snap);
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
@@ -285,7 +737,13 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (z->t_stack != NULL &&
+		    curcpu->c_threadcache.tl_count < THREADCACHE_MAX) {
+			thread_recycle(z);
+		}
+		else {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -359,6 +817,10 @@ thread_bootstrap(void)
 
 	cpuarray_init(&allcpus);
 
+	/* Initialize allthreads; the boot thread goes on it */
+	spinlock_init(&allthreads_lock);
+	threadarray_init(&allthreads);
+
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
 	 * currently running on. Assume the hardware number is 0; that
@@ -385,6 +847,9 @@ thread_bootstrap(void)
 	curthread->t_cpu = curcpu;
 	curcpu->c_curthread = curthread;
 
+	/* Now the cycle counter can be read; we've been running all along. */
+	curthread->t_statestamp = cpu_getcycles();
+
 	/* cpu_create() should have set t_proc. */
 	KASSERT(curthread->t_proc != NULL);
 
@@ -412,6 +877,7 @@ cpu_hatch(unsigned software_number)
 	KASSERT(curthread != NULL);
 	KASSERT(curcpu->c_number == software_number);
 
+	curthread->t_statestamp = cpu_getcycles();
 	spl0();
 	cpu_identify(buf, sizeof(buf));
 
@@ -421,14 +887,23 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+static int thread_fork_cpu(const char *name, struct proc *proc,
+			   struct cpu *cpu,
+			   void (*entrypoint)(void *, unsigned long),
+			   void *data1, unsigned long data2);
+static void thread_idlethread(void *data1, unsigned long data2);
+
 /*
- * Start up secondary cpus. Called from boot().
+ * Start up secondary cpus, and give every cpu its idle thread.
+ * Called from boot().
  */
 void
 thread_start_cpus(void)
 {
 	char buf[64];
 	unsigned i;
+	struct cpu *c;
+	int result;
 
 	cpu_identify(buf, sizeof(buf));
 	kprintf("cpu0: %s\n", buf);
@@ -441,12 +916,134 @@ thread_start_cpus(void)
 	}
 	sem_destroy(cpu_startup_sem);
 	cpu_startup_sem = NULL;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		snprintf(buf, sizeof(buf), "idle/%u", c->c_number);
+		result = thread_fork_cpu(buf, NULL, c, thread_idlethread,
+					 c, 0);
+		if (result) {
+			panic("thread_start_cpus: idle thread: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
+/*
+ * Return the mask of CPUs that are online.
+ */
+cpumask_t
+thread_onlinecpus(void)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	KASSERT(numcpus <= 32);
+	if (numcpus == 32) {
+		return CPUMASK_ALL;
+	}
+	return CPUMASK_BIT(numcpus) - 1;
+}
+
+/*
+ * Return the number of CPUs, and the CPU numbered N. The set of CPUs
+ * doesn't change once they've been started.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned n)
+{
+	return cpuarray_get(&allcpus, n);
+}
+
+/*
+ * Check if thread T is allowed to run on cpu C.
+ */
+static
+bool
+thread_cpu_allowed(struct thread *t, struct cpu *c)
+{
+	return (t->t_affinity & CPUMASK_BIT(c->c_number)) != 0;
+}
+
+/*
+ * Choose a cpu for thread T among those its affinity mask allows:
+ * the one with the shortest run queue. The counts are read without
+ * locking, which is fine for a placement heuristic. If the mask
+ * doesn't allow any cpu that's online, stay on the current one.
+ */
+static
+struct cpu *
+thread_choosecpu(struct thread *t)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus;
+
+	best = NULL;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!thread_cpu_allowed(t, c)) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	return best != NULL ? best : curcpu->c_self;
+}
+
+/*
+ * The priority a ready thread is queued at: its effective priority
+ * plus whatever it has gained by aging (see schedule()).
+ */
+static
+int
+thread_queuepri(const struct thread *t)
+{
+	return t->t_pri + t->t_agebonus;
+}
+
+/*
+ * Put thread T on run queue RQ behind all the threads of the same or
+ * higher priority. Since most threads have the same priority, start
+ * looking from the end.
+ */
+static
+void
+thread_runqueue_insert(struct threadlist *rq, struct thread *t)
+{
+	struct thread *prev;
+
+	THREADLIST_FORALL_REV(prev, *rq) {
+		if (thread_queuepri(prev) >= thread_queuepri(t)) {
+			threadlist_insertafter(rq, prev, t);
+			return;
+		}
+	}
+	threadlist_addhead(rq, t);
 }
 
 /*
  * Make a thread runnable.
  *
  * targetcpu might be curcpu; it might not be, too.
+ *
+ * If the target's affinity mask no longer allows its cpu, move it
+ * elsewhere -- but only if it has finished switching out. A thread
+ * that is still some cpu's c_curthread may be in the middle of
+ * thread_switch (or idling in its own context) on that cpu, and
+ * letting another cpu pick it up would run it on two stacks at once.
+ * Because thread_switch holds the run queue lock from changing
+ * c_curthread until the switch is complete, checking c_curthread
+ * under that lock is sufficient. Threads left in place are moved
+ * off when their cpu next picks them from its run queue.
  */
 static
 void
@@ -463,11 +1060,19 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 	else {
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		if (!thread_cpu_allowed(target, targetcpu) &&
+		    targetcpu->c_curthread != target) {
+			spinlock_release(&targetcpu->c_runqueue_lock);
+			targetcpu = thread_choosecpu(target);
+			target->t_cpu = targetcpu;
+			spinlock_acquire(&targetcpu->c_runqueue_lock);
+		}
 	}
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	target->t_statestamp = cpu_getcycles();
+	thread_runqueue_insert(&targetcpu->c_runqueue, target);
 
 	if (targetcpu->c_isidle) {
 		/*
@@ -481,46 +1086,32 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_release(&targetcpu->c_runqueue_lock);
 	}
 }
-
-/*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+
+/*
+ * Common code for thread_fork and for creating idle threads. If CPU
+ * isn't null, the new thread is tied to that cpu.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_cpu(const char *name,
+		struct proc *proc,
+		struct cpu *cpu,
+		void (*entrypoint)(void *data1, unsigned long data2),
+		void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Get a thread and stack, preferably recycled */
+	newthread = thread_alloc(name);
 	if (newthread == NULL) {
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
-	}
-	thread_checkstack_init(newthread);
-
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
-	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
-
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
 		proc = curthread->t_proc;
@@ -532,6 +1123,37 @@ thread_fork(const char *name,
 		return result;
 	}
 
+	/*
+	 * Inherit the affinity mask from the process, and the priority
+	 * from the caller if the new thread is in the same process,
+	 * otherwise from the process. (Not any priority the caller has
+	 * inherited.)
+	 */
+	spinlock_acquire(&proc->p_lock);
+	newthread->t_affinity = proc->p_affinity;
+	newthread->t_basepri = (proc == curthread->t_proc) ?
+		curthread->t_basepri : proc->p_pri;
+	spinlock_release(&proc->p_lock);
+	newthread->t_pri = newthread->t_basepri;
+
+	/*
+	 * Thread subsystem fields. A new thread normally starts on
+	 * the current cpu, but another thread in the same user
+	 * process is going to run alongside us, so put it wherever
+	 * it will get to run soonest.
+	 */
+	if (cpu != NULL) {
+		newthread->t_affinity = CPUMASK_BIT(cpu->c_number);
+		newthread->t_cpu = cpu;
+	}
+	else {
+		newthread->t_cpu = curthread->t_cpu;
+		if (!thread_cpu_allowed(newthread, newthread->t_cpu) ||
+		    (proc == curthread->t_proc && proc != kproc)) {
+			newthread->t_cpu = thread_choosecpu(newthread);
+		}
+	}
+
 	/*
 	 * Because new threads come out holding the cpu runqueue lock
 	 * (see notes at bottom of thread_switch), we need to account
@@ -548,6 +1170,67 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_cpu(name, proc, NULL, entrypoint, data1, data2);
+}
+
+/*
+ * Mark thread CUR, just switched to from a run queue, as running,
+ * and count the time it spent waiting. Shared by the tail of
+ * thread_switch and thread_startup.
+ */
+static
+void
+thread_switchedin(struct thread *cur)
+{
+	uint32_t now;
+
+	KASSERT(cur->t_state == S_READY);
+
+	now = cpu_getcycles();
+	schedstat_add(curcpu->c_schedstat.ss_runqueue,
+		      now - cur->t_statestamp);
+
+	cur->t_wchan_name = NULL;
+	cur->t_state = S_RUN;
+	cur->t_statestamp = now;
+	cur->t_agebonus = 0;
+}
+
+/*
+ * Send on the thread that thread_switch left in c_migrant, now that
+ * we're off its stack. thread_make_runnable finds it a cpu its
+ * affinity mask allows. Shared by the tail of thread_switch and
+ * thread_startup.
+ */
+static
+void
+thread_sendmigrant(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_migrant;
+	if (t != NULL) {
+		curcpu->c_migrant = NULL;
+		thread_make_runnable(t, false);
+	}
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -563,6 +1246,8 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	struct cpu *dest;
+	bool migrate;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -588,22 +1273,60 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
+	/*
+	 * If our affinity mask no longer allows this cpu, we have to
+	 * leave it -- but no other cpu can be given us while we're
+	 * still on our own stack. So instead of going on the run
+	 * queue, wait in c_migrant, and have whatever runs next (the
+	 * idle thread, if nothing else) send us on. Don't bother if
+	 * there's nowhere to go, or before the idle thread exists.
+	 */
+	migrate = newstate == S_READY &&
+		!thread_cpu_allowed(cur, curcpu->c_self) &&
+		curcpu->c_idlethread != NULL &&
+		thread_choosecpu(cur) != curcpu->c_self;
+
 	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	if (newstate == S_READY && !migrate &&
+	    threadlist_isempty(&curcpu->c_runqueue)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
 	}
 
+	/* Our time slice ends here. */
+	schedstat_add(curcpu->c_schedstat.ss_timeslice,
+		      cpu_getcycles() - cur->t_statestamp);
+	if (newstate == S_SLEEP) {
+		cur->t_usage.tu_nvcsw++;
+	}
+	else if (newstate == S_READY) {
+		cur->t_usage.tu_nivcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		KASSERT(cur != curcpu->c_idlethread);
+		if (migrate) {
+			KASSERT(curcpu->c_migrant == NULL);
+			curcpu->c_migrant = cur;
+		}
+		else {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
 		break;
 	    case S_SLEEP:
+		if (wc == NULL) {
+			/* the idle thread parking; see thread_idlethread */
+			KASSERT(cur == curcpu->c_idlethread);
+			cur->t_wchan_name = "idle";
+			break;
+		}
 		cur->t_wchan_name = wc->wc_name;
+		cur->t_wchan = wc;
 		/*
 		 * Add the thread to the list in the wait channel, and
 		 * unlock same. To avoid a race with someone else
@@ -621,6 +1344,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	}
 	cur->t_state = newstate;
+	cur->t_statestamp = cpu_getcycles();
 
 	/*
 	 * Get the next thread. While there isn't one, call md_idle().
@@ -639,13 +1363,38 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
+	/*
+	 * Threads whose affinity mask excludes this cpu are passed on
+	 * to one that it allows instead of being run. (Not cur, which
+	 * is still on its own stack here; see c_migrant above.) If
+	 * there's nothing to run but cur is waiting to be sent away,
+	 * run the idle thread so as to get off cur's stack.
+	 */
+
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
+		if (next != NULL && next != cur &&
+		    !thread_cpu_allowed(next, curcpu->c_self) &&
+		    (dest = thread_choosecpu(next)) != curcpu->c_self) {
+			spinlock_release(&curcpu->c_runqueue_lock);
+			next->t_cpu = dest;
+			thread_make_runnable(next, false);
+			spinlock_acquire(&curcpu->c_runqueue_lock);
+			next = NULL;
+			continue;
+		}
+		if (next == NULL && curcpu->c_migrant != NULL) {
+			next = curcpu->c_idlethread;
+			next->t_state = S_READY;
+			next->t_statestamp = cpu_getcycles();
+		}
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+			hardclock_idle();
 			cpu_idle();
+			hardclock_unidle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -658,6 +1407,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * assume the compiler will optimize one away if they're the
 	 * same.
 	 */
+	TRACE(TR_SWITCH, next, newstate, 0);
 	curcpu->c_curthread = next;
 	curthread = next;
 
@@ -712,12 +1462,14 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 
 
 	/* Clear the wait channel and set the thread state. */
-	cur->t_wchan_name = NULL;
-	cur->t_state = S_RUN;
+	thread_switchedin(cur);
 
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on the previous thread if it's leaving this cpu. */
+	thread_sendmigrant();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -745,12 +1497,14 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	cur = curthread;
 
 	/* Clear the wait channel and set the thread state. */
-	cur->t_wchan_name = NULL;
-	cur->t_state = S_RUN;
+	thread_switchedin(cur);
 
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on the previous thread if it's leaving this cpu. */
+	thread_sendmigrant();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -814,22 +1568,137 @@ thread_yield(void)
 	thread_switch(S_READY, NULL, NULL);
 }
 
+/*
+ * Restrict the current thread to the cpus in MASK, and if that rules
+ * out the one it's on, move it now.
+ */
+int
+thread_setaffinity(cpumask_t mask)
+{
+	struct proc *proc = curthread->t_proc;
+
+	mask &= thread_onlinecpus();
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	/* proc_setaffinity sets t_affinity under p_lock */
+	spinlock_acquire(&proc->p_lock);
+	curthread->t_affinity = mask;
+	spinlock_release(&proc->p_lock);
+
+	if (!thread_cpu_allowed(curthread, curcpu->c_self)) {
+		thread_yield();
+	}
+	return 0;
+}
+
+/*
+ * Body of each cpu's idle thread. It stays parked, on no list at all,
+ * until thread_switch needs somewhere to go so it can get off the
+ * stack of a thread that has to leave the cpu (see c_migrant); then
+ * it parks again, and the cpu idles on its stack instead.
+ */
+static
+void
+thread_idlethread(void *data1, unsigned long data2)
+{
+	struct cpu *c = data1;
+
+	(void)data2;
+
+	KASSERT(curcpu->c_self == c);
+	KASSERT(c->c_idlethread == NULL);
+	c->c_idlethread = curthread;
+
+	/*
+	 * Keep interrupts off, so hardclock can't try to make us
+	 * yield; the cpu takes them while idling in thread_switch.
+	 */
+	splhigh();
+	while (1) {
+		thread_switch(S_SLEEP, NULL, NULL);
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is called periodically from hardclock(). The run queues are
+ * in strict priority order, so on their own a busy thread would keep
+ * every lower-priority (e.g. niced) thread off its cpu for good. To
+ * prevent that, age the waiting threads: each call gives every thread
+ * on the current cpu's run queue one more level of t_agebonus, up to
+ * PRI_MAX, and the bonus is dropped when the thread gets to run. A
+ * thread PRI_MAX-PRI_MIN levels down thus waits at most that many
+ * calls behind anything, rather than forever.
+ *
+ * Adding one to everything (capped at the same limit) doesn't change
+ * the order of the queue, so there is no need to re-sort it.
  */
-
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct cpu *c = curcpu->c_self;
+	struct thread *t;
+
+	spinlock_acquire(&c->c_runqueue_lock);
+	THREADLIST_FORALL(t, c->c_runqueue) {
+		if (thread_queuepri(t) < PRI_MAX) {
+			t->t_agebonus++;
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+/*
+ * Set the effective priority of thread T. The run queue lock of T's
+ * cpu is what keeps t_pri and the run queue order in step.
+ *
+ * If T is on the run queue, the queue is put back in order by taking
+ * everything off it and inserting it again. (A ready thread isn't
+ * always on its cpu's run queue -- it may be between queues being
+ * migrated -- so we can't just pull T itself out.) This is quadratic
+ * in the worst case but the queues are short, and it is only done for
+ * priority inheritance, when a waiter lends its priority to a lock
+ * holder that is not running.
+ */
+void
+thread_setpri(struct thread *t, int pri)
+{
+	struct cpu *c;
+	struct threadlist tmp;
+	struct thread *t2;
+
+	while (1) {
+		c = t->t_cpu;
+		if (c == NULL) {
+			/* Still in thread_fork; not on any queue yet */
+			t->t_pri = pri;
+			return;
+		}
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (t->t_cpu == c) {
+			break;
+		}
+		/* migrated meanwhile */
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	t->t_pri = pri;
+	if (t->t_state == S_READY) {
+		threadlist_init(&tmp);
+		while ((t2 = threadlist_remhead(&c->c_runqueue)) != NULL) {
+			threadlist_addtail(&tmp, t2);
+		}
+		while ((t2 = threadlist_remhead(&tmp)) != NULL) {
+			thread_runqueue_insert(&c->c_runqueue, t2);
+		}
+		threadlist_cleanup(&tmp);
+	}
+	spinlock_release(&c->c_runqueue_lock);
 }
 
 /*
@@ -848,12 +1717,15 @@ schedule(void)
  * For here and now, because we know we're running on System/161 and
  * System/161 does not (yet) model such cache effects, we'll be very
  * aggressive.
+ *
+ * Threads are only sent to cpus their affinity mask allows; ones
+ * that can't go anywhere stay put.
  */
 void
 thread_consider_migration(void)
 {
 	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
+	unsigned i, numcpus, tries;
 	struct cpu *c;
 	struct threadlist victims;
 	struct thread *t;
@@ -890,7 +1762,10 @@ thread_consider_migration(void)
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
+		tries = victims.tl_count;
+		while (c->c_runqueue.tl_count < one_share && to_send > 0 &&
+		       tries > 0) {
+			tries--;
 			t = threadlist_remhead(&victims);
 			/*
 			 * Ordinarily, curthread will not appear on
@@ -920,8 +1795,14 @@ thread_consider_migration(void)
 				continue;
 			}
 
+			/* Leave it for a later cpu if it can't go here. */
+			if (!thread_cpu_allowed(t, c)) {
+				threadlist_addtail(&victims, t);
+				continue;
+			}
+
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_runqueue_insert(&c->c_runqueue, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -945,7 +1826,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_runqueue_insert(&curcpu->c_runqueue, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -980,6 +1861,11 @@ wchan_create(const char *name)
 	}
 	threadlist_init(&wc->wc_threads);
 	wc->wc_name = name;
+	wc->wc_sleeps = 0;
+	wc->wc_resleeps = 0;
+	wc->wc_wakeups = 0;
+	wc->wc_sleepcycles = 0;
+	wc->wc_maxcycles = 0;
 
 	/* add to allwchans[] */
 	spinlock_acquire(&allwchans_lock);
@@ -1022,6 +1908,37 @@ wchan_destroy(struct wchan *wc)
 	kfree(wc);
 }
 
+/*
+ * Statistics for wchan_sleep and wchan_sleep_timeout: count a sleep
+ * on WC and return the time it starts, and once woken (with the
+ * spinlock again held), count the time slept. WOKEN is false if the
+ * sleep ended by timing out.
+ */
+static
+uint32_t
+wchan_sleepstart(struct wchan *wc)
+{
+	wc->wc_sleeps++;
+	if (curthread->t_lastwchan == wc) {
+		wc->wc_resleeps++;
+	}
+	return cpu_getcycles();
+}
+
+static
+void
+wchan_sleepdone(struct wchan *wc, uint32_t start, bool woken)
+{
+	uint32_t cycles;
+
+	cycles = cpu_getcycles() - start;
+	wc->wc_sleepcycles += cycles;
+	if (cycles > wc->wc_maxcycles) {
+		wc->wc_maxcycles = cycles;
+	}
+	curthread->t_lastwchan = woken ? wc : NULL;
+}
+
 /*
  * Yield the cpu to another process, and go to sleep, on the specified
  * wait channel WC, whose associated spinlock is LK. Calling wakeup on
@@ -1032,6 +1949,63 @@ wchan_destroy(struct wchan *wc)
 void
 wchan_sleep(struct wchan *wc, struct spinlock *lk)
 {
+	uint32_t start;
+
+	/* may not sleep in an interrupt handler */
+	KASSERT(!curthread->t_in_interrupt);
+
+	/* must hold the spinlock */
+	KASSERT(spinlock_do_i_hold(lk));
+
+	/* must not hold other spinlocks */
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	start = wchan_sleepstart(wc);
+	thread_switch(S_SLEEP, wc, lk);
+	spinlock_acquire(lk);
+	wchan_sleepdone(wc, start, true);
+}
+
+/*
+ * State shared between wchan_sleep_timeout and its timeout function.
+ */
+struct wchan_timeout {
+	struct wchan *wt_wchan;
+	struct spinlock *wt_lock;
+	struct thread *wt_thread;
+	bool wt_expired;
+};
+
+/*
+ * Timeout function for wchan_sleep_timeout: if the thread is still
+ * asleep on the channel, take it off and wake it.
+ */
+static
+void
+wchan_timeout_expire(void *data)
+{
+	struct wchan_timeout *wt = data;
+	struct thread *target = wt->wt_thread;
+
+	spinlock_acquire(wt->wt_lock);
+	if (wchan_wakethread(wt->wt_wchan, wt->wt_lock, target)) {
+		wt->wt_expired = true;
+	}
+	spinlock_release(wt->wt_lock);
+}
+
+/*
+ * Go to sleep on a wait channel with a time limit. The timeout lives
+ * on our stack; timeout_cancel makes sure it is finished with before
+ * we return.
+ */
+int
+wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct wchan_timeout wt;
+	struct timeout to;
+	uint32_t start;
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
@@ -1041,8 +2015,27 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	/* must not hold other spinlocks */
 	KASSERT(curcpu->c_spinlocks == 1);
 
+	if (ticks == 0) {
+		return ETIMEDOUT;
+	}
+	if (ticks > TIMEOUT_MAXTICKS) {
+		ticks = TIMEOUT_MAXTICKS;
+	}
+
+	wt.wt_wchan = wc;
+	wt.wt_lock = lk;
+	wt.wt_thread = curthread;
+	wt.wt_expired = false;
+	timeout_init(&to, wchan_timeout_expire, &wt);
+	timeout_add(&to, ticks);
+
+	start = wchan_sleepstart(wc);
 	thread_switch(S_SLEEP, wc, lk);
+
+	timeout_cancel(&to);
 	spinlock_acquire(lk);
+	wchan_sleepdone(wc, start, !wt.wt_expired);
+	return wt.wt_expired ? ETIMEDOUT : 0;
 }
 
 /*
@@ -1062,6 +2055,8 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 		/* Nobody was sleeping. */
 		return;
 	}
+	target->t_wchan = NULL;
+	wc->wc_wakeups++;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1092,7 +2087,9 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
+		wc->wc_wakeups++;
 	}
 
 	/*
@@ -1107,6 +2104,24 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up a particular thread, if it's sleeping on the wait channel.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct spinlock *lk, struct thread *target)
+{
+	KASSERT(spinlock_do_i_hold(lk));
+
+	if (target->t_wchan != wc) {
+		return false;
+	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+	wc->wc_wakeups++;
+	thread_make_runnable(target, false);
+	return true;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1122,6 +2137,135 @@ wchan_isempty(struct wchan *wc, struct spinlock *lk)
 	return ret;
 }
 
+/*
+ * What wchan_printstats keeps of each channel.
+ */
+struct wchansnap {
+	char ws_name[24];
+	unsigned ws_count;		/* channels merged into this one */
+	unsigned ws_waiting;
+	unsigned ws_sleeps;
+	unsigned ws_resleeps;
+	unsigned ws_wakeups;
+	uint64_t ws_sleepcycles;
+	uint32_t ws_maxcycles;
+};
+
+/*
+ * Print the wait channel statistics. Like thread_printall this reads
+ * each channel's counters without its spinlock (we don't know which
+ * one it is), so they may be slightly off while things are running.
+ */
+void
+wchan_printstats(void)
+{
+	struct wchansnap *snap, *ws, tmp;
+	struct wchan *wc;
+	unsigned i, j, num, max, shown;
+
+	/* Leave room for a few channels created while we allocate. */
+	spinlock_acquire(&allwchans_lock);
+	max = wchanarray_num(&allwchans) + 16;
+	spinlock_release(&allwchans_lock);
+
+	snap = kmalloc(max * sizeof(*snap));
+	if (snap == NULL) {
+		kprintf("wchans: Out of memory\n");
+		return;
+	}
+
+	/*
+	 * Copy the channels, merging the ones with the same name
+	 * (each vnode lock has its own channel, for instance). This
+	 * is quadratic in the number of names, which is small.
+	 */
+	num = 0;
+	spinlock_acquire(&allwchans_lock);
+	for (i=0; i<wchanarray_num(&allwchans); i++) {
+		wc = wchanarray_get(&allwchans, i);
+		for (j=0; j<num; j++) {
+			if (!strcmp(snap[j].ws_name, wc->wc_name)) {
+				break;
+			}
+		}
+		if (j == num) {
+			if (num == max) {
+				continue;
+			}
+			ws = &snap[num++];
+			bzero(ws, sizeof(*ws));
+			snprintf(ws->ws_name, sizeof(ws->ws_name), "%s",
+				 wc->wc_name);
+		}
+		else {
+			ws = &snap[j];
+		}
+		ws->ws_count++;
+		ws->ws_waiting += wc->wc_threads.tl_count;
+		ws->ws_sleeps += wc->wc_sleeps;
+		ws->ws_resleeps += wc->wc_resleeps;
+		ws->ws_wakeups += wc->wc_wakeups;
+		ws->ws_sleepcycles += wc->wc_sleepcycles;
+		if (wc->wc_maxcycles > ws->ws_maxcycles) {
+			ws->ws_maxcycles = wc->wc_maxcycles;
+		}
+	}
+	spinlock_release(&allwchans_lock);
+
+	/* Insertion sort by time slept, as in lockstat. */
+	for (i=1; i<num; i++) {
+		tmp = snap[i];
+		for (j=i; j>0 && snap[j-1].ws_sleepcycles < tmp.ws_sleepcycles;
+		     j--) {
+			snap[j] = snap[j-1];
+		}
+		snap[j] = tmp;
+	}
+
+	kprintf("Wait channels, by name; times in cycles\n");
+	kprintf("  %-23s %5s %4s %9s %9s %9s %14s %10s\n", "name", "chans",
+		"wait", "sleeps", "resleeps", "wakeups", "asleep", "max");
+	shown = 0;
+	for (i=0; i<num; i++) {
+		ws = &snap[i];
+		if (ws->ws_sleeps == 0 && ws->ws_waiting == 0) {
+			continue;
+		}
+		kprintf("  %-23s %5u %4u %9u %9u %9u %14llu %10u\n",
+			ws->ws_name, ws->ws_count, ws->ws_waiting,
+			ws->ws_sleeps, ws->ws_resleeps, ws->ws_wakeups,
+			ws->ws_sleepcycles, ws->ws_maxcycles);
+		shown++;
+	}
+	if (shown == 0) {
+		kprintf("  (none)\n");
+	}
+
+	kfree(snap);
+}
+
+/*
+ * Zero the wait channel statistics. This too is done without the
+ * channels' own locks, so a sleep or wakeup in progress may survive.
+ */
+void
+wchan_resetstats(void)
+{
+	struct wchan *wc;
+	unsigned i;
+
+	spinlock_acquire(&allwchans_lock);
+	for (i=0; i<wchanarray_num(&allwchans); i++) {
+		wc = wchanarray_get(&allwchans, i);
+		wc->wc_sleeps = 0;
+		wc->wc_resleeps = 0;
+		wc->wc_wakeups = 0;
+		wc->wc_sleepcycles = 0;
+		wc->wc_maxcycles = 0;
+	}
+	spinlock_release(&allwchans_lock);
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel event trace. See <trace.h>.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <vfs.h>
+#include <trace.h>
+#include <platform/maxcpus.h>
+
+/*
+ * Each cpu writes only its own ring, with interrupts off so an
+ * interrupt handler's events can't land in the middle of one being
+ * recorded. tr_next counts all events ever recorded; the slot for
+ * the next one is tr_next modulo TRACE_NEVENTS.
+ *
+ * The rings are allocated the first time tracing is turned on and
+ * never freed, so trace_log only needs to check for NULL on a cpu
+ * that came up since.
+ */
+struct tracering {
+	unsigned tr_next;
+	struct trace_event tr_events[TRACE_NEVENTS];
+};
+
+volatile bool trace_enabled;
+
+static struct tracering *trace_rings[MAXCPUS];
+
+void
+trace_log(unsigned event, uint32_t a, uint32_t b, uint32_t c)
+{
+	struct tracering *tr;
+	struct trace_event *te;
+	int spl;
+
+	spl = splhigh();
+	tr = trace_rings[curcpu->c_number];
+	if (tr != NULL) {
+		te = &tr->tr_events[tr->tr_next++ & (TRACE_NEVENTS - 1)];
+		te->te_cycles = cpu_getcycles();
+		te->te_cpu = curcpu->c_number;
+		te->te_event = event;
+		te->te_thread = (uint32_t)(uintptr_t)curthread;
+		te->te_args[0] = a;
+		te->te_args[1] = b;
+		te->te_args[2] = c;
+	}
+	splx(spl);
+}
+
+int
+trace_start(void)
+{
+	struct tracering *tr;
+	unsigned i;
+
+	for (i=0; i<cpu_count(); i++) {
+		if (trace_rings[i] != NULL) {
+			continue;
+		}
+		tr = kmalloc(sizeof(*tr));
+		if (tr == NULL) {
+			return ENOMEM;
+		}
+		tr->tr_next = 0;
+		trace_rings[i] = tr;
+	}
+	trace_enabled = true;
+	return 0;
+}
+
+void
+trace_stop(void)
+{
+	trace_enabled = false;
+}
+
+/*
+ * This doesn't stop tracing, so an event being recorded on another
+ * cpu at the same moment may survive.
+ */
+void
+trace_clear(void)
+{
+	unsigned i;
+
+	for (i=0; i<MAXCPUS; i++) {
+		if (trace_rings[i] != NULL) {
+			trace_rings[i]->tr_next = 0;
+		}
+	}
+}
+
+void
+trace_printstats(void)
+{
+	unsigned i;
+
+	kprintf("trace: %s\n", trace_enabled ? "running" : "stopped");
+	kprintf("cpu      events        lost\n");
+	for (i=0; i<MAXCPUS; i++) {
+		if (trace_rings[i] == NULL) {
+			continue;
+		}
+		kprintf("%3u  %10u  %10u\n", i,
+			trace_rings[i]->tr_next < TRACE_NEVENTS ?
+			trace_rings[i]->tr_next : TRACE_NEVENTS,
+			trace_rings[i]->tr_next < TRACE_NEVENTS ? 0 :
+			trace_rings[i]->tr_next - TRACE_NEVENTS);
+	}
+}
+
+int
+trace_dump(const char *path)
+{
+	struct trace_header th;
+	struct trace_cpuheader tc;
+	struct tracering *tr;
+	struct vnode *vn;
+	unsigned i, first, count;
+	off_t pos;
+	int result;
+
+	trace_stop();
+
+	result = vfs_dumpopen(path, &vn);
+	if (result) {
+		return result;
+	}
+
+	th.th_magic = TRACE_MAGIC;
+	th.th_version = TRACE_VERSION;
+	th.th_ncpus = 0;
+	for (i=0; i<MAXCPUS; i++) {
+		if (trace_rings[i] != NULL) {
+			th.th_ncpus++;
+		}
+	}
+	th.th_eventsize = sizeof(struct trace_event);
+	pos = 0;
+	result = vfs_dumpwrite(vn, &pos, &th, sizeof(th));
+
+	for (i=0; i<MAXCPUS && result == 0; i++) {
+		tr = trace_rings[i];
+		if (tr == NULL) {
+			continue;
+		}
+		count = tr->tr_next < TRACE_NEVENTS ?
+			tr->tr_next : TRACE_NEVENTS;
+		tc.tc_cpu = i;
+		tc.tc_count = count;
+		tc.tc_lost = tr->tr_next - count;
+		result = vfs_dumpwrite(vn, &pos, &tc, sizeof(tc));
+		if (result) {
+			break;
+		}
+
+		/* The oldest event is at tr_next once the ring is full. */
+		first = (tr->tr_next - count) & (TRACE_NEVENTS - 1);
+		if (first + count > TRACE_NEVENTS) {
+			result = vfs_dumpwrite(vn, &pos, &tr->tr_events[first],
+				(TRACE_NEVENTS - first) *
+				sizeof(struct trace_event));
+			count -= TRACE_NEVENTS - first;
+			first = 0;
+			if (result) {
+				break;
+			}
+		}
+		result = vfs_dumpwrite(vn, &pos, &tr->tr_events[first],
+				       count * sizeof(struct trace_event));
+	}
+
+	vfs_close(vn);
+	return result;
+}
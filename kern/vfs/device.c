@@ -144,9 +144,11 @@ dev_write(struct vnode *v, struct uio *uio)
  */
 static
 int
-dev_ioctl(struct vnode *v, int op, userptr_t data)
+dev_ioctl(struct vnode *v, int op, userptr_t data, int accmode)
 {
 	struct device *d = v->vn_data;
+
+	(void)accmode;
 	return DEVOP_IOCTL(d, op, data);
 }
 
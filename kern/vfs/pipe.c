@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Anonymous pipes: a ring buffer with a vnode for each end.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <stat.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pipe.h>
+
+/* Size of the ring buffer. */
+#define PIPE_SIZE	PAGE_SIZE
+
+/*
+ * A pipe. Both vnodes point here with vn_data; which end a vnode is
+ * is told by which of the two it is.
+ *
+ * Readers wait on p_readcv for data or for the write end to close;
+ * writers wait on p_writecv for space or for the read end to close.
+ */
+struct pipe {
+	struct vnode p_readvn;		/* vnode for the read end */
+	struct vnode p_writevn;		/* vnode for the write end */
+
+	struct lock *p_lock;		/* lock for the following */
+	struct cv *p_readcv;		/* wait here for data */
+	struct cv *p_writecv;		/* wait here for space */
+	char *p_buf;			/* the ring buffer */
+	size_t p_head;			/* where the next read comes from */
+	size_t p_count;			/* bytes in the buffer */
+	bool p_readopen;		/* the read end is open */
+	bool p_writeopen;		/* the write end is open */
+};
+
+////////////////////////////////////////////////////////////
+// destructor
+
+/*
+ * Free a pipe. Private; happens when the second end is reclaimed.
+ */
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	kfree(p->p_buf);
+	cv_destroy(p->p_writecv);
+	cv_destroy(p->p_readcv);
+	lock_destroy(p->p_lock);
+	kfree(p);
+}
+
+////////////////////////////////////////////////////////////
+// I/O
+
+/*
+ * Move LEN bytes between the uio and the ring buffer, starting POS
+ * bytes into the buffer and wrapping around at the end. Returns the
+ * number of bytes moved in *MOVED, which is LEN unless uiomove fails
+ * partway.
+ */
+static
+int
+pipe_uiomove(struct pipe *p, size_t pos, size_t len, struct uio *uio,
+	     size_t *moved)
+{
+	size_t resid, first;
+	int result;
+
+	KASSERT(pos < PIPE_SIZE);
+	KASSERT(len <= PIPE_SIZE);
+
+	resid = uio->uio_resid;
+	first = len;
+	if (first > PIPE_SIZE - pos) {
+		first = PIPE_SIZE - pos;
+	}
+	result = uiomove(p->p_buf + pos, first, uio);
+	if (result == 0 && len > first) {
+		result = uiomove(p->p_buf, len - first, uio);
+	}
+	*moved = resid - uio->uio_resid;
+	return result;
+}
+
+/*
+ * Read. Wait until there's some data or no writer, then take as much
+ * as there is, up to what was asked for. The wait gives up with EINTR
+ * if our process is exiting, since the writer may be one of its own
+ * threads.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	size_t len, moved;
+	int result;
+
+	if (vn != &p->p_readvn) {
+		return EBADF;
+	}
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->p_lock);
+	while (p->p_count == 0 && p->p_writeopen) {
+		result = cv_wait_intr(p->p_readcv, p->p_lock);
+		if (result) {
+			lock_release(p->p_lock);
+			return result;
+		}
+	}
+
+	/* if the buffer is still empty, it's EOF */
+	len = p->p_count;
+	if (len > uio->uio_resid) {
+		len = uio->uio_resid;
+	}
+	result = pipe_uiomove(p, p->p_head, len, uio, &moved);
+	p->p_head = (p->p_head + moved) % PIPE_SIZE;
+	p->p_count -= moved;
+	if (moved > 0) {
+		cv_broadcast(p->p_writecv, p->p_lock);
+	}
+	lock_release(p->p_lock);
+
+	return result;
+}
+
+/*
+ * Write. A write of PIPE_BUF bytes or less waits until there's room
+ * for all of it, so it goes in as one piece; a bigger one puts in
+ * whatever fits each time around. If the read end gets closed, fail
+ * with EPIPE, or stop short if some of the data already went in; the
+ * same with EINTR if our process starts exiting while we wait.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	size_t startresid, space, need, len, moved;
+	int result;
+
+	if (vn != &p->p_writevn) {
+		return EBADF;
+	}
+
+	startresid = uio->uio_resid;
+	result = 0;
+
+	lock_acquire(p->p_lock);
+	while (uio->uio_resid > 0) {
+		if (!p->p_readopen) {
+			if (uio->uio_resid == startresid) {
+				result = EPIPE;
+			}
+			break;
+		}
+
+		space = PIPE_SIZE - p->p_count;
+		need = uio->uio_resid <= PIPE_BUF ? uio->uio_resid : 1;
+		if (space < need) {
+			result = cv_wait_intr(p->p_writecv, p->p_lock);
+			if (result) {
+				if (uio->uio_resid < startresid) {
+					result = 0;
+				}
+				break;
+			}
+			continue;
+		}
+
+		len = space;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = pipe_uiomove(p, (p->p_head + p->p_count) % PIPE_SIZE,
+				      len, uio, &moved);
+		p->p_count += moved;
+		if (moved > 0) {
+			cv_broadcast(p->p_readcv, p->p_lock);
+		}
+		if (result) {
+			break;
+		}
+	}
+	lock_release(p->p_lock);
+
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// other ops
+
+/*
+ * Reclaim: the last reference to one end is gone. Wake up anyone
+ * waiting on the other end, so readers see EOF and writers EPIPE,
+ * and free the pipe once both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *p = vn->vn_data;
+	bool destroy;
+
+	lock_acquire(p->p_lock);
+	if (vn == &p->p_readvn) {
+		KASSERT(p->p_readopen);
+		p->p_readopen = false;
+		cv_broadcast(p->p_writecv, p->p_lock);
+	}
+	else {
+		KASSERT(vn == &p->p_writevn);
+		KASSERT(p->p_writeopen);
+		p->p_writeopen = false;
+		cv_broadcast(p->p_readcv, p->p_lock);
+	}
+	destroy = !p->p_readopen && !p->p_writeopen;
+	lock_release(p->p_lock);
+
+	vnode_cleanup(vn);
+	if (destroy) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * eachopen: pipes can't be opened by name, so this shouldn't happen.
+ */
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	return EINVAL;
+}
+
+/*
+ * ioctl, fsync, and truncate: none of these mean anything for a pipe.
+ */
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data, int accmode)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	(void)accmode;
+	return EINVAL;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * stat. The size is the number of bytes waiting to be read.
+ */
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe *p = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+
+	lock_acquire(p->p_lock);
+	buf->st_size = p->p_count;
+	lock_release(p->p_lock);
+
+	buf->st_mode = S_IFIFO | 0600;
+	buf->st_nlink = 0;
+	buf->st_blocks = 0;
+	buf->st_blksize = PIPE_BUF;
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+/*
+ * Function table for both ends of a pipe.
+ */
+static const struct vnode_ops pipe_vnops = {
+	.vop_magic = VOP_MAGIC,	/* mark this a valid vnode ops table */
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// constructor
+
+/*
+ * Make a pipe, and hand back its two ends.
+ */
+int
+pipe_create(struct vnode **readvn_ret, struct vnode **writevn_ret)
+{
+	struct pipe *p;
+	int result;
+
+	COMPILE_ASSERT(PIPE_BUF <= PIPE_SIZE);
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_lock = lock_create("pipe");
+	if (p->p_lock == NULL) {
+		goto fail_p;
+	}
+	p->p_readcv = cv_create("piperead");
+	if (p->p_readcv == NULL) {
+		goto fail_lock;
+	}
+	p->p_writecv = cv_create("pipewrite");
+	if (p->p_writecv == NULL) {
+		goto fail_readcv;
+	}
+	p->p_buf = kmalloc(PIPE_SIZE);
+	if (p->p_buf == NULL) {
+		goto fail_writecv;
+	}
+	p->p_head = 0;
+	p->p_count = 0;
+	p->p_readopen = true;
+	p->p_writeopen = true;
+
+	result = vnode_init(&p->p_readvn, &pipe_vnops, NULL, p);
+	if (result) {
+		goto fail_buf;
+	}
+	result = vnode_init(&p->p_writevn, &pipe_vnops, NULL, p);
+	if (result) {
+		vnode_cleanup(&p->p_readvn);
+		goto fail_buf;
+	}
+
+	*readvn_ret = &p->p_readvn;
+	*writevn_ret = &p->p_writevn;
+	return 0;
+
+fail_buf:
+	kfree(p->p_buf);
+fail_writecv:
+	cv_destroy(p->p_writecv);
+fail_readcv:
+	cv_destroy(p->p_readcv);
+fail_lock:
+	lock_destroy(p->p_lock);
+fail_p:
+	kfree(p);
+	return ENOMEM;
+}
@@ -36,6 +36,7 @@
 #include <kern/fcntl.h>
 #include <limits.h>
 #include <lib.h>
+#include <uio.h>
 #include <vfs.h>
 #include <vnode.h>
 
@@ -314,3 +315,44 @@ vfs_rmdir(char *path)
 	return result;
 }
 
+
+/*
+ * Open a file to dump kernel data into.
+ */
+int
+vfs_dumpopen(const char *path, struct vnode **ret)
+{
+	char *pathcopy;
+	int result;
+
+	/* vfs_open destroys the string it's passed */
+	pathcopy = kstrdup(path);
+	if (pathcopy == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(pathcopy, O_WRONLY|O_CREAT|O_TRUNC, 0664, ret);
+	kfree(pathcopy);
+	return result;
+}
+
+/*
+ * Write part of a dump.
+ */
+int
+vfs_dumpwrite(struct vnode *vn, off_t *pos, const void *buf, size_t len)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, (void *)buf, len, *pos, UIO_WRITE);
+	result = VOP_WRITE(vn, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		return ENOSPC;
+	}
+	*pos = ku.uio_offset;
+	return 0;
+}
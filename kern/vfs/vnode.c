@@ -37,6 +37,17 @@
 #include <vfs.h>
 #include <vnode.h>
 
+/*
+ * Source of vnode version numbers. Each vnode gets a block of
+ * VNODE_VERSIONSPAN of them when it's set up; writes and truncates
+ * then count up within the block under the vnode's own lock, so the
+ * global lock is only taken in vnode_init.
+ */
+#define VNODE_VERSIONSPAN	((uint64_t)1 << 32)
+
+static struct spinlock vnode_versionlock = SPINLOCK_INITIALIZER;
+static uint64_t vnode_nextversion = VNODE_VERSIONSPAN;
+
 /*
  * Initialize an abstract vnode.
  */
@@ -52,6 +63,11 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	spinlock_init(&vn->vn_countlock);
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
+
+	spinlock_acquire(&vnode_versionlock);
+	vn->vn_version = vnode_nextversion;
+	vnode_nextversion += VNODE_VERSIONSPAN;
+	spinlock_release(&vnode_versionlock);
 	return 0;
 }
 
@@ -72,6 +88,59 @@ vnode_cleanup(struct vnode *vn)
 }
 
 
+/*
+ * Give a vnode a new version number.
+ */
+void
+vnode_newversion(struct vnode *vn)
+{
+	spinlock_acquire(&vn->vn_countlock);
+	vn->vn_version++;
+	spinlock_release(&vn->vn_countlock);
+}
+
+/*
+ * Get a vnode's current version number.
+ */
+uint64_t
+vnode_getversion(struct vnode *vn)
+{
+	uint64_t version;
+
+	spinlock_acquire(&vn->vn_countlock);
+	version = vn->vn_version;
+	spinlock_release(&vn->vn_countlock);
+	return version;
+}
+
+/*
+ * VOP_WRITE: write, with a new version before and after.
+ */
+int
+vnode_write(struct vnode *vn, struct uio *uio)
+{
+	int result;
+
+	vnode_newversion(vn);
+	result = __VOP(vn, write)(vn, uio);
+	vnode_newversion(vn);
+	return result;
+}
+
+/*
+ * VOP_TRUNCATE: likewise.
+ */
+int
+vnode_truncate(struct vnode *vn, off_t pos)
+{
+	int result;
+
+	vnode_newversion(vn);
+	result = __VOP(vn, truncate)(vn, pos);
+	vnode_newversion(vn);
+	return result;
+}
+
 /*
  * Increment refcount.
  * Called by VOP_INCREF.
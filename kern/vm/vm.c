@@ -32,6 +32,7 @@
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <thread.h>
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
@@ -39,6 +40,7 @@
 #include <vm.h>
 #include <machine/vm.h>
 #include <mips/vm.h>
+#include <trace.h>
 
 
 /*
@@ -248,6 +250,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	struct region region;
 	size_t nreg;
 
+	TRACE(TR_VMFAULT, faulttype, faultaddress, 0);
+
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "dumbvm: fault: 0x%x\n", faultaddress);
@@ -366,6 +370,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
+		curthread->t_usage.tu_minflt++;
 		return 0;
 	}
 
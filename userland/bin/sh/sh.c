@@ -47,6 +47,7 @@
 #include <err.h>
 
 #ifdef HOST
+#include <sys/resource.h>
 #include "hostcompat.h"
 #endif
 
@@ -73,6 +74,9 @@ static int timing = 0;
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
 
+/* most commands in one pipeline */
+#define MAXPIPE 32
+
 /*
  * can_bg
  * just checks for an open slot.
@@ -212,41 +216,46 @@ dowait(pid_t pid)
 #ifdef WNOHANG
 /*
  * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * like dowait, but for any child and with WNOHANG. returns the pid
+ * we got, or 0 if none.
  */
 static
-int
-dowaitpoll(pid_t pid)
+pid_t
+dowaitpoll(void)
 {
 	struct exitinfo ei;
 	pid_t foundpid;
 	int status;
 
-	foundpid = waitpid(pid, &status, WNOHANG);
+	foundpid = waitpid(-1, &status, WNOHANG);
 	if (foundpid < 0) {
-		warn("pid %d", pid);
+		if (errno != ECHILD) {
+			warn("waitpid");
+		}
+		return 0;
 	}
 	else if (foundpid != 0) {
-		printf("pid %d: ", pid);
+		printf("pid %d: ", foundpid);
 		readstatus(status, &ei);
 		printstatus(&ei, 1);
-		return 1;
 	}
-	return 0;
+	return foundpid;
 }
 
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * collect all background jobs that have exited.
  */
 static
 void
 waitpoll(void)
 {
+	pid_t pid;
 	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
+
+	while ((pid = dowaitpoll()) != 0) {
+		for (i=0; i < MAXBG; i++) {
+			if (bgpids[i] == pid) {
 				bgpids[i] = 0;
 			}
 		}
@@ -340,6 +349,61 @@ cmd_exit(int ac, char *av[], struct exitinfo *ei)
 	exit(code);
 }
 
+/*
+ * printtime
+ * report on a command run with the "time" prefix: elapsed time (if
+ * we have a clock), then the user and system time and other resource
+ * usage the kernel charged to it and its children.
+ */
+static
+void
+printtime(time_t secs, unsigned long nsecs, const struct rusage *ru)
+{
+	if (timing) {
+		printf("%llu.%02lu real  ", (unsigned long long) secs,
+		       nsecs / 10000000);
+	}
+	printf("%llu.%02lu user  %llu.%02lu sys\n",
+	       (unsigned long long) ru->ru_utime.tv_sec,
+	       (unsigned long) ru->ru_utime.tv_usec / 10000,
+	       (unsigned long long) ru->ru_stime.tv_sec,
+	       (unsigned long) ru->ru_stime.tv_usec / 10000);
+	printf("%llu faults  %llu reads  %llu writes  "
+	       "%llu+%llu context switches\n",
+	       (unsigned long long) ru->ru_minflt,
+	       (unsigned long long) ru->ru_inblock,
+	       (unsigned long long) ru->ru_oublock,
+	       (unsigned long long) ru->ru_nvcsw,
+	       (unsigned long long) ru->ru_nivcsw);
+}
+
+/*
+ * addrusage
+ * add the resource usage of one command of a pipeline to the total.
+ */
+static
+void
+addrusage(struct rusage *sum, const struct rusage *ru)
+{
+	sum->ru_utime.tv_sec += ru->ru_utime.tv_sec;
+	sum->ru_utime.tv_usec += ru->ru_utime.tv_usec;
+	if (sum->ru_utime.tv_usec >= 1000000) {
+		sum->ru_utime.tv_usec -= 1000000;
+		sum->ru_utime.tv_sec++;
+	}
+	sum->ru_stime.tv_sec += ru->ru_stime.tv_sec;
+	sum->ru_stime.tv_usec += ru->ru_stime.tv_usec;
+	if (sum->ru_stime.tv_usec >= 1000000) {
+		sum->ru_stime.tv_usec -= 1000000;
+		sum->ru_stime.tv_sec++;
+	}
+	sum->ru_minflt += ru->ru_minflt;
+	sum->ru_inblock += ru->ru_inblock;
+	sum->ru_oublock += ru->ru_oublock;
+	sum->ru_nvcsw += ru->ru_nvcsw;
+	sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
 /*
  * a struct of the builtins associates the builtin name with the function that
  * executes it.  they must all take an argc and argv.
@@ -355,25 +419,88 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * runcmd
+ * forks and execs one command, with its standard input and output
+ * hooked up to INFD and OUTFD if those aren't -1, and CLOSEFD (the
+ * other end of its output pipe) closed. returns the pid, or -1.
+ */
+static
+pid_t
+runcmd(char **argv, int infd, int outfd, int closefd)
+{
+	pid_t pid;
+
+	pid = fork();
+	switch (pid) {
+		case -1:
+			/* error */
+			warn("fork");
+			return -1;
+		case 0:
+			/* child */
+			if (infd >= 0) {
+				if (dup2(infd, STDIN_FILENO) < 0) {
+					warn("dup2");
+					_exit(1);
+				}
+				close(infd);
+			}
+			if (outfd >= 0) {
+				if (dup2(outfd, STDOUT_FILENO) < 0) {
+					warn("dup2");
+					_exit(1);
+				}
+				close(outfd);
+			}
+			if (closefd >= 0) {
+				close(closefd);
+			}
+			execvp(argv[0], argv);
+			warn("%s", argv[0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		default:
+			break;
+	}
+	return pid;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
  * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * the job if possible, otherwise just run it and wait on it.  a leading
+ * "time" runs the rest of the line as a command and reports its
+ * resource usage when it finishes.  commands separated by "|" are run
+ * as a pipeline, each one's output going to the next one's input; the
+ * exit status is that of the last one.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **stages[MAXPIPE];
+	pid_t pids[MAXPIPE];
+	int nargs, nstages, i;
 	char *s;
-	pid_t pid;
-	int status;
+	int fds[2], infd;
+	int status, result;
 	int bg=0;
-	time_t startsecs, endsecs;
-	unsigned long startnsecs, endnsecs;
+	int timecmd=0;
+	int pipeline=0;
+	int failed=0;
+	struct rusage ru, stageru;
+	time_t startsecs, endsecs = 0;
+	unsigned long startnsecs, endnsecs = 0;
 
 	nargs = 0;
 	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
@@ -388,14 +515,29 @@ docommand(char *buf, struct exitinfo *ei)
 	}
 	args[nargs] = NULL;
 
+	if (nargs > 0 && !strcmp(args[0], "time")) {
+		for (i=0; i<nargs; i++) {
+			args[i] = args[i+1];
+		}
+		nargs--;
+		timecmd = 1;
+	}
+
 	if (nargs==0) {
 		/* empty line */
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			pipeline = 1;
+		}
+	}
+
 	for (i=0; builtins[i].name; i++) {
-		if (!strcmp(builtins[i].name, args[0])) {
+		if (!timecmd && !pipeline &&
+		    !strcmp(builtins[i].name, args[0])) {
 			builtins[i].func(nargs, args, ei);
 			return;
 		}
@@ -405,6 +547,11 @@ docommand(char *buf, struct exitinfo *ei)
 
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
+		if (timecmd) {
+			printf("time: Cannot time background jobs\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
 		if (!can_bg()) {
 			printf("%s: Too many background jobs; wait for "
 			       "some to finish before starting more\n",
@@ -417,48 +564,109 @@ docommand(char *buf, struct exitinfo *ei)
 		bg = 1;
 	}
 
+	/* split a pipeline into its commands at the "|"s */
+	nstages = 0;
+	stages[nstages++] = args;
+	for (i=0; i<nargs; i++) {
+		if (strcmp(args[i], "|")) {
+			continue;
+		}
+		if (nstages >= MAXPIPE) {
+			printf("sh: Too many commands in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+		args[i] = NULL;
+		stages[nstages++] = &args[i+1];
+	}
+	for (i=0; i<nstages; i++) {
+		if (stages[i][0] == NULL) {
+			printf("sh: Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/* start each command reading the output of the one before */
+	infd = -1;
+	for (i=0; i<nstages; i++) {
+		if (i < nstages-1) {
+			if (pipe(fds) < 0) {
+				warn("pipe");
+				break;
+			}
+		}
+		else {
+			fds[0] = fds[1] = -1;
+		}
+		pids[i] = runcmd(stages[i], infd, fds[1], fds[0]);
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (fds[1] >= 0) {
+			close(fds[1]);
+		}
+		infd = fds[0];
+		if (pids[i] < 0) {
 			break;
+		}
+	}
+	if (i < nstages) {
+		/* couldn't start them all; clean up the ones we did */
+		if (infd >= 0) {
+			close(infd);
+		}
+		while (i-- > 0) {
+			waitpid(pids[i], &status, 0);
+		}
+		exitinfo_exit(ei, 255);
+		return;
 	}
 
 	/* parent */
 	if (bg) {
-		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		/* background this command (the last one, if a pipeline) */
+		remember_bg(pids[nstages-1]);
+		printf("[%d] %s ... &\n", pids[nstages-1], args[0]);
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
+	if (timecmd) {
+		memset(&ru, 0, sizeof(ru));
 	}
-	else {
-		readstatus(status, ei);
+	for (i=0; i<nstages; i++) {
+		if (timecmd) {
+			result = wait4(pids[i], &status, 0, &stageru);
+			if (result < 0) {
+				warn("wait4");
+			}
+			else {
+				addrusage(&ru, &stageru);
+			}
+		}
+		else {
+			result = waitpid(pids[i], &status, 0);
+			if (result < 0) {
+				warn("waitpid");
+			}
+		}
+		if (result < 0) {
+			failed = 1;
+		}
+		else if (i == nstages-1) {
+			readstatus(status, ei);
+		}
+	}
+	if (failed) {
+		exitinfo_exit(ei, 255);
+		if (timecmd) {
+			return;
+		}
 	}
 
 	if (timing) {
@@ -469,8 +677,14 @@ docommand(char *buf, struct exitinfo *ei)
 		}
 		endnsecs -= startnsecs;
 		endsecs -= startsecs;
-		warnx("subprocess time: %lu.%09lu seconds",
-		      (unsigned long) endsecs, (unsigned long) endnsecs);
+		if (!timecmd) {
+			warnx("subprocess time: %lu.%09lu seconds",
+			      (unsigned long) endsecs,
+			      (unsigned long) endnsecs);
+		}
+	}
+	if (timecmd) {
+		printtime(endsecs, endnsecs, &ru);
 	}
 }
 
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * systop.c
+ *
+ * Print the kernel's per-syscall statistics, busiest calls first.
+ *
+ *    systop [-c cpu] [-r]                  totals since boot (or reset)
+ *    systop [-c cpu] interval [count]      what each INTERVAL seconds added
+ *
+ * -r zeroes the counts after printing them. Percentiles are read off
+ * the kernel's log2 histograms, so they are only good to a factor of
+ * two: each is the lower bound of the bucket it falls in.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <kern/syscall.h>
+
+static const char *const callnames[SYSCALLSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_getppid] = "getppid",
+	[SYS_sbrk] = "sbrk",
+	[SYS_mmap] = "mmap",
+	[SYS_munmap] = "munmap",
+	[SYS_mprotect] = "mprotect",
+	[SYS_umask] = "umask",
+	[SYS_issetugid] = "issetugid",
+	[SYS_getresuid] = "getresuid",
+	[SYS_setresuid] = "setresuid",
+	[SYS_getresgid] = "getresgid",
+	[SYS_setresgid] = "setresgid",
+	[SYS_getgroups] = "getgroups",
+	[SYS_setgroups] = "setgroups",
+	[SYS___getlogin] = "__getlogin",
+	[SYS___setlogin] = "__setlogin",
+	[SYS_kill] = "kill",
+	[SYS_sigaction] = "sigaction",
+	[SYS_sigpending] = "sigpending",
+	[SYS_sigprocmask] = "sigprocmask",
+	[SYS_sigsuspend] = "sigsuspend",
+	[SYS_sigreturn] = "sigreturn",
+	[SYS_getpriority] = "getpriority",
+	[SYS_setpriority] = "setpriority",
+	[SYS_open] = "open",
+	[SYS_pipe] = "pipe",
+	[SYS_dup] = "dup",
+	[SYS_dup2] = "dup2",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_getdirentry] = "getdirentry",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_lseek] = "lseek",
+	[SYS_flock] = "flock",
+	[SYS_ftruncate] = "ftruncate",
+	[SYS_fsync] = "fsync",
+	[SYS_fcntl] = "fcntl",
+	[SYS_ioctl] = "ioctl",
+	[SYS_select] = "select",
+	[SYS_poll] = "poll",
+	[SYS_link] = "link",
+	[SYS_remove] = "remove",
+	[SYS_mkdir] = "mkdir",
+	[SYS_rmdir] = "rmdir",
+	[SYS_mkfifo] = "mkfifo",
+	[SYS_rename] = "rename",
+	[SYS_access] = "access",
+	[SYS_chdir] = "chdir",
+	[SYS_fchdir] = "fchdir",
+	[SYS___getcwd] = "__getcwd",
+	[SYS_symlink] = "symlink",
+	[SYS_readlink] = "readlink",
+	[SYS_mount] = "mount",
+	[SYS_unmount] = "unmount",
+	[SYS_stat] = "stat",
+	[SYS_fstat] = "fstat",
+	[SYS_lstat] = "lstat",
+	[SYS_utimes] = "utimes",
+	[SYS_futimes] = "futimes",
+	[SYS_lutimes] = "lutimes",
+	[SYS_chmod] = "chmod",
+	[SYS_chown] = "chown",
+	[SYS_fchmod] = "fchmod",
+	[SYS_fchown] = "fchown",
+	[SYS_lchmod] = "lchmod",
+	[SYS_lchown] = "lchown",
+	[SYS_socket] = "socket",
+	[SYS_bind] = "bind",
+	[SYS_connect] = "connect",
+	[SYS_listen] = "listen",
+	[SYS_accept] = "accept",
+	[SYS_shutdown] = "shutdown",
+	[SYS_getsockname] = "getsockname",
+	[SYS_getpeername] = "getpeername",
+	[SYS_getsockopt] = "getsockopt",
+	[SYS_setsockopt] = "setsockopt",
+	[SYS___time] = "__time",
+	[SYS___settime] = "__settime",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_sync] = "sync",
+	[SYS_reboot] = "reboot",
+	[SYS___sysctl] = "__sysctl",
+	[SYS_sched_setaffinity] = "sched_setaffinity",
+	[SYS_sched_getaffinity] = "sched_getaffinity",
+	[SYS_futex] = "futex",
+	[SYS___threadfork] = "__threadfork",
+	[SYS_threadexit] = "threadexit",
+	[SYS___threadjoin] = "__threadjoin",
+	[SYS_schedstat] = "schedstat",
+};
+
+static struct syscallstat before[SYSCALLSTAT_NCALLS];
+static struct syscallstat after[SYSCALLSTAT_NCALLS];
+static struct syscallstat diff[SYSCALLSTAT_NCALLS];
+static int order[SYSCALLSTAT_NCALLS];
+
+/* for sorting */
+static const struct syscallstat *sortstats;
+
+static
+void
+getstats(int cpu, struct syscallstat *stats, int reset)
+{
+	int name[3];
+	unsigned namelen;
+	size_t len;
+
+	name[0] = CTL_KERN;
+	name[1] = KERN_SYSCALLSTATS;
+	name[2] = cpu;
+	namelen = cpu < 0 ? 2 : 3;
+	len = SYSCALLSTAT_NCALLS * sizeof(*stats);
+
+	if (__sysctl(name, namelen, stats, &len,
+		     reset ? "" : NULL, 0) < 0) {
+		err(1, "__sysctl");
+	}
+}
+
+/*
+ * Return the lower bound of the bucket holding percentile PCT.
+ */
+static
+unsigned
+percentile(const struct syscallstat *ss, unsigned pct)
+{
+	unsigned b, total, sum, want;
+
+	total = 0;
+	for (b=0; b<SYSCALLSTAT_BUCKETS; b++) {
+		total += ss->ss_hist[b];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	want = (total * pct + 99) / 100;
+	sum = 0;
+	for (b=0; b<SYSCALLSTAT_BUCKETS; b++) {
+		sum += ss->ss_hist[b];
+		if (sum >= want) {
+			break;
+		}
+	}
+	return b == 0 ? 0 : 1U << b;
+}
+
+static
+int
+bytime(const void *av, const void *bv)
+{
+	const struct syscallstat *a, *b;
+
+	a = &sortstats[*(const int *)av];
+	b = &sortstats[*(const int *)bv];
+	if (a->ss_cycles != b->ss_cycles) {
+		return a->ss_cycles > b->ss_cycles ? -1 : 1;
+	}
+	if (a->ss_calls != b->ss_calls) {
+		return a->ss_calls > b->ss_calls ? -1 : 1;
+	}
+	return *(const int *)av - *(const int *)bv;
+}
+
+static
+void
+print(const struct syscallstat *stats)
+{
+	const struct syscallstat *ss;
+	unsigned i, nret, b;
+	unsigned long long avg;
+	int n;
+
+	sortstats = stats;
+	for (i=0; i<SYSCALLSTAT_NCALLS; i++) {
+		order[i] = i;
+	}
+	qsort(order, SYSCALLSTAT_NCALLS, sizeof(order[0]), bytime);
+
+	printf("%-18s %8s %7s %12s %10s %10s\n",
+	       "syscall", "calls", "errors", "avg cycles", "p50", "p99");
+	n = 0;
+	for (i=0; i<SYSCALLSTAT_NCALLS; i++) {
+		ss = &stats[order[i]];
+		if (ss->ss_calls == 0) {
+			continue;
+		}
+		nret = 0;
+		for (b=0; b<SYSCALLSTAT_BUCKETS; b++) {
+			nret += ss->ss_hist[b];
+		}
+		avg = nret == 0 ? 0 : ss->ss_cycles / nret;
+		if (callnames[order[i]] != NULL) {
+			printf("%-18s", callnames[order[i]]);
+		}
+		else {
+			printf("%-18d", order[i]);
+		}
+		printf(" %8u %7u %12llu %10u %10u\n", ss->ss_calls,
+		       ss->ss_errors, avg, percentile(ss, 50),
+		       percentile(ss, 99));
+		n++;
+	}
+	if (n == 0) {
+		printf("No system calls.\n");
+	}
+}
+
+/*
+ * Subtract OLD from NEW, counter by counter.
+ */
+static
+void
+delta(struct syscallstat *new, const struct syscallstat *old)
+{
+	unsigned i, b;
+
+	for (i=0; i<SYSCALLSTAT_NCALLS; i++) {
+		new[i].ss_calls -= old[i].ss_calls;
+		new[i].ss_errors -= old[i].ss_errors;
+		new[i].ss_cycles -= old[i].ss_cycles;
+		for (b=0; b<SYSCALLSTAT_BUCKETS; b++) {
+			new[i].ss_hist[b] -= old[i].ss_hist[b];
+		}
+	}
+}
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: systop [-c cpu] [-r] [interval [count]]");
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timespec ts;
+	int cpu = -1, reset = 0;
+	int interval, count;
+	int i;
+
+	for (i=1; i<argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "-c") && i+1 < argc) {
+			cpu = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-r")) {
+			reset = 1;
+		}
+		else {
+			usage();
+		}
+	}
+
+	if (i == argc) {
+		getstats(cpu, before, reset);
+		print(before);
+		return 0;
+	}
+	if (reset || argc - i > 2) {
+		usage();
+	}
+
+	interval = atoi(argv[i]);
+	count = i+1 < argc ? atoi(argv[i+1]) : -1;
+	if (interval <= 0) {
+		usage();
+	}
+
+	getstats(cpu, before, 0);
+	while (count != 0) {
+		ts.tv_sec = interval;
+		ts.tv_nsec = 0;
+		if (nanosleep(&ts, NULL) < 0) {
+			err(1, "nanosleep");
+		}
+		getstats(cpu, after, 0);
+		memcpy(diff, after, sizeof(after));
+		delta(diff, before);
+		print(diff);
+		memcpy(before, after, sizeof(after));
+		printf("\n");
+		if (count > 0) {
+			count--;
+		}
+	}
+	return 0;
+}
@@ -39,6 +39,11 @@
  */
 int atoi(const char *);
 
+/*
+ * Same, but in any base, and report where the number ends.
+ */
+unsigned long strtoul(const char *, char **, int);
+
 /*
  * Standard routine to bail out of a program in a severe error condition.
  */
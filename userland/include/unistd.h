@@ -39,10 +39,15 @@
  * about the kern/ headers.
  */
 #include <kern/fcntl.h>
+#include <kern/futex.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
 #include <kern/reboot.h>
+#include <kern/schedstat.h>
 #include <kern/seek.h>
+#include <kern/sysctl.h>
 #include <kern/time.h>
+#include <kern/resource.h>	/* uses struct timeval */
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -121,6 +126,14 @@ pid_t waitpid(pid_t pid, int *returncode, int flags);
 int open(const char *filename, int flags, ...);
 ssize_t read(int filehandle, void *buf, size_t size);
 ssize_t write(int filehandle, const void *buf, size_t size);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t preadv(int filehandle, const struct iovec *iov, int iovcnt,
+	       off_t pos);
+ssize_t pwritev(int filehandle, const struct iovec *iov, int iovcnt,
+		off_t pos);
 int close(int filehandle);
 int reboot(int code);
 int sync(void);
@@ -147,10 +160,28 @@ ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+pid_t wait4(pid_t pid, int *returncode, int flags, struct rusage *ru);
+int getrusage(int who, struct rusage *usage);
+int getrlimit(int resource, struct rlimit *rlp);
+int setrlimit(int resource, const struct rlimit *rlp);
+int getpriority(int which, pid_t who);
+int setpriority(int which, pid_t who, int prio);
+int __sysctl(const int *name, unsigned namelen, void *oldp, size_t *oldlenp,
+	     const void *newp, size_t newlen);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
+/* OS/161 extensions. */
+int sched_setaffinity(pid_t pid, unsigned mask);
+int sched_getaffinity(pid_t pid, unsigned *mask);
+int futex(int *uaddr, int op, int val, const struct timespec *timeout);
+int __threadfork(void (*entry)(void *), void *arg, void *stack);
+__DEAD void threadexit(int status);
+int __threadjoin(int tid, int *status);
+int schedstat(int cpu, struct schedstat *stats);
+
 /*
  * These are not themselves system calls, but wrapper routines in libc.
  */
@@ -158,5 +189,8 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int threadfork(void (*func)(void));		/* calls threadspawn */
+int threadspawn(int (*func)(void *), void *arg); /* calls __threadfork */
+int threadjoin(int tid, int *status);		/* calls __threadjoin */
 
 #endif /* _UNISTD_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _USYNC_H_
+#define _USYNC_H_
+
+/*
+ * User-level mutexes and semaphores.
+ *
+ * These keep their state in user memory and only make a system call
+ * (futex) when a thread has to wait or another thread is waiting.
+ * Because futex waiters are keyed on the address space, they
+ * synchronize threads within one process, not separate processes.
+ */
+
+struct umutex {
+	volatile int um_state;		/* 0 free, 1 held, 2 held+waiters */
+};
+
+#define UMUTEX_INITIALIZER	{ 0 }
+
+void umutex_init(struct umutex *mx);
+void umutex_lock(struct umutex *mx);
+int umutex_trylock(struct umutex *mx);	/* 0 on success, else EBUSY */
+void umutex_unlock(struct umutex *mx);
+
+struct usema {
+	volatile int us_count;
+	volatile int us_waiters;
+};
+
+void usema_init(struct usema *sem, int count);
+void usema_P(struct usema *sem);
+int usema_tryP(struct usema *sem);	/* 0 on success, else EAGAIN */
+void usema_V(struct usema *sem);
+
+#endif /* _USYNC_H_ */
@@ -34,6 +34,9 @@
  * easy to follow. It performs abysmally if the heap becomes larger than
  * physical memory. To get (much) better out-of-core performance, port
  * the kernel's malloc. :-)
+ *
+ * One mutex covers the whole heap so that threads in a process can
+ * call malloc and free concurrently.
  */
 
 #include <stdlib.h>
@@ -41,6 +44,7 @@
 #include <unistd.h>
 #include <err.h>
 #include <assert.h>
+#include <usync.h>
 
 #undef MALLOCDEBUG
 
@@ -154,6 +158,11 @@ static size_t __malloc_pagesize;
  */
 static uintptr_t __heapbase, __heaptop;
 
+/*
+ * Lock for the heap.
+ */
+static struct umutex __malloc_lock = UMUTEX_INITIALIZER;
+
 /*
  * Setup function.
  */
@@ -348,8 +357,9 @@ __malloc_split(struct mheader *mh, size_t size)
 /*
  * malloc itself.
  */
+static
 void *
-malloc(size_t size)
+__malloc(size_t size)
 {
 	struct mheader *mh;
 	uintptr_t i;
@@ -530,8 +540,9 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 /*
  * The actual free() implementation.
  */
+static
 void
-free(void *x)
+__free(void *x)
 {
 	struct mheader *mh, *mhnext, *mhprev;
 
@@ -589,3 +600,25 @@ free(void *x)
 	__malloc_dump();
 #endif
 }
+
+/*
+ * Locked entry points.
+ */
+void *
+malloc(size_t size)
+{
+	void *p;
+
+	umutex_lock(&__malloc_lock);
+	p = __malloc(size);
+	umutex_unlock(&__malloc_lock);
+	return p;
+}
+
+void
+free(void *x)
+{
+	umutex_lock(&__malloc_lock);
+	__free(x);
+	umutex_unlock(&__malloc_lock);
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * User-level mutexes and semaphores built on futex().
+ *
+ * The mutex is the classic three-state futex mutex: 0 means free, 1
+ * means held with nobody waiting, and 2 means held and somebody may
+ * be waiting. Lock and unlock are a single atomic operation when
+ * there's no contention; unlock only calls FUTEX_WAKE if the state
+ * was 2.
+ *
+ * The semaphore keeps its count in us_count and the number of
+ * threads blocked (or about to block) in us_waiters, so V only calls
+ * FUTEX_WAKE when someone might be sleeping.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <usync.h>
+
+/*
+ * Atomic compare-and-swap using LL/SC. Stores NEW into *P if *P
+ * equals OLD; either way, returns what *P was.
+ */
+static
+int
+usync_cas(volatile int *p, int old, int new)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		".set noreorder;"	/* we fill our own delay slots */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   if (x != old) goto done */
+		"move %1, %4;"		/*   y = new (delay slot) */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   if (!y) retry */
+		"nop;"			/*   delay slot */
+		"2:;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return x;
+}
+
+/*
+ * Atomic exchange, likewise. Returns the old value.
+ */
+static
+int
+usync_swap(volatile int *p, int new)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		".set noreorder;"	/* we fill our own delay slots */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"move %1, %3;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   if (!y) retry */
+		"nop;"			/*   delay slot */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (new)
+		: "memory");
+	return x;
+}
+
+/*
+ * Atomic add; returns the old value.
+ */
+static
+int
+usync_fetchadd(volatile int *p, int amount)
+{
+	int old;
+
+	do {
+		old = *p;
+	} while (usync_cas(p, old, old + amount) != old);
+	return old;
+}
+
+////////////////////////////////////////////////////////////
+// mutex
+
+void
+umutex_init(struct umutex *mx)
+{
+	mx->um_state = 0;
+}
+
+void
+umutex_lock(struct umutex *mx)
+{
+	int c;
+
+	c = usync_cas(&mx->um_state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+
+	/*
+	 * Contended: mark the lock as having waiters and sleep until
+	 * we're the one who took it from 0.
+	 */
+	if (c != 2) {
+		c = usync_swap(&mx->um_state, 2);
+	}
+	while (c != 0) {
+		futex((int *)&mx->um_state, FUTEX_WAIT, 2, NULL);
+		c = usync_swap(&mx->um_state, 2);
+	}
+}
+
+int
+umutex_trylock(struct umutex *mx)
+{
+	if (usync_cas(&mx->um_state, 0, 1) == 0) {
+		return 0;
+	}
+	return EBUSY;
+}
+
+void
+umutex_unlock(struct umutex *mx)
+{
+	if (usync_swap(&mx->um_state, 0) == 2) {
+		futex((int *)&mx->um_state, FUTEX_WAKE, 1, NULL);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// semaphore
+
+void
+usema_init(struct usema *sem, int count)
+{
+	sem->us_count = count;
+	sem->us_waiters = 0;
+}
+
+int
+usema_tryP(struct usema *sem)
+{
+	int c;
+
+	while ((c = sem->us_count) > 0) {
+		if (usync_cas(&sem->us_count, c, c - 1) == c) {
+			return 0;
+		}
+	}
+	return EAGAIN;
+}
+
+void
+usema_P(struct usema *sem)
+{
+	if (usema_tryP(sem) == 0) {
+		return;
+	}
+
+	/*
+	 * Register as a waiter before sleeping so a V that runs
+	 * after our last look at the count knows to wake us. If the
+	 * count changes between the check and the sleep, futex
+	 * returns EAGAIN and we go around again.
+	 */
+	usync_fetchadd(&sem->us_waiters, 1);
+	while (usema_tryP(sem) != 0) {
+		futex((int *)&sem->us_count, FUTEX_WAIT, 0, NULL);
+	}
+	usync_fetchadd(&sem->us_waiters, -1);
+}
+
+void
+usema_V(struct usema *sem)
+{
+	usync_fetchadd(&sem->us_count, 1);
+	if (sem->us_waiters > 0) {
+		futex((int *)&sem->us_count, FUTEX_WAKE, 1, NULL);
+	}
+}
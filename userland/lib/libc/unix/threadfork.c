@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * User threads: the libc side of threadfork.
+ *
+ * The kernel starts a new thread at a given address with a given
+ * argument and stack pointer; everything else happens here. Each
+ * thread gets a malloc'd stack with a small record at the bottom
+ * holding the function to call, and the thread starts in
+ * threadstart(), which calls it and then threadexit() with its
+ * return value. A thread's stack is freed when it's joined, which
+ * the kernel only lets happen after the thread is gone; stacks of
+ * threads nobody joins stay allocated until the process exits.
+ *
+ * Note that errno is shared among all the threads in a process.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <usync.h>
+
+#define THREAD_STACKSIZE	(64*1024)
+
+/*
+ * Record at the bottom of each thread's stack.
+ */
+struct threadstack {
+	struct threadstack *ts_next;	/* Stacks of unjoined threads */
+	int ts_tid;			/* Thread id */
+	int (*ts_func)(void *);		/* Function to run, or... */
+	void (*ts_vfunc)(void);		/* ...one that takes and returns nothing */
+	void *ts_arg;			/* Argument for ts_func */
+};
+
+static struct umutex threadstacks_lock = UMUTEX_INITIALIZER;
+static struct threadstack *threadstacks;
+
+/*
+ * Where new threads begin.
+ */
+static
+void
+threadstart(void *vts)
+{
+	struct threadstack *ts = vts;
+
+	if (ts->ts_vfunc != NULL) {
+		ts->ts_vfunc();
+		threadexit(0);
+	}
+	threadexit(ts->ts_func(ts->ts_arg));
+}
+
+static
+int
+spawn(int (*func)(void *), void (*vfunc)(void), void *arg)
+{
+	struct threadstack *ts;
+	char *stack;
+	int tid;
+
+	stack = malloc(THREAD_STACKSIZE);
+	if (stack == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ts = (struct threadstack *)stack;
+	ts->ts_func = func;
+	ts->ts_vfunc = vfunc;
+	ts->ts_arg = arg;
+
+	/* leave the 16-byte argument save area the callee may use */
+	tid = __threadfork(threadstart, ts, stack + THREAD_STACKSIZE - 16);
+	if (tid < 0) {
+		free(stack);
+		return -1;
+	}
+
+	umutex_lock(&threadstacks_lock);
+	ts->ts_tid = tid;
+	ts->ts_next = threadstacks;
+	threadstacks = ts;
+	umutex_unlock(&threadstacks_lock);
+
+	return tid;
+}
+
+/*
+ * Start a thread running FUNC(ARG). Its return value becomes the
+ * thread's exit status. Returns the thread id.
+ */
+int
+threadspawn(int (*func)(void *), void *arg)
+{
+	return spawn(func, NULL, arg);
+}
+
+/*
+ * Start a thread running FUNC(). Returns the thread id.
+ */
+int
+threadfork(void (*func)(void))
+{
+	return spawn(NULL, func, NULL);
+}
+
+/*
+ * Wait for thread TID to exit and free its stack.
+ */
+int
+threadjoin(int tid, int *status)
+{
+	struct threadstack **pp, *ts;
+
+	if (__threadjoin(tid, status) < 0) {
+		return -1;
+	}
+
+	ts = NULL;
+	umutex_lock(&threadstacks_lock);
+	for (pp = &threadstacks; *pp != NULL; pp = &(*pp)->ts_next) {
+		if ((*pp)->ts_tid == tid) {
+			ts = *pp;
+			*pp = ts->ts_next;
+			break;
+		}
+	}
+	umutex_unlock(&threadstacks_lock);
+
+	free(ts);
+	return 0;
+}
@@ -0,0 +1,617 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * profsym - symbolize a kernel profile (see the "prof" menu command
+ * and kern/include/prof.h).
+ *
+ *    host-profsym [-c] [-n lines] [-k kernel] [-u prog] [-p pid=prog]...
+ *                 profile
+ *
+ * Kernel-mode samples are looked up in the symbol table of KERNEL;
+ * user-mode samples in the program given for their pid with -p, or
+ * else the one given with -u. Samples with no program to look in are
+ * counted as "?".
+ *
+ * Prints a flat profile: samples per function, most first. With -c,
+ * also prints a call-site profile: samples per (caller, function)
+ * pair, where the caller is taken from the return address register at
+ * the time of the sample. That's only right for leaf functions and
+ * for functions that haven't yet called anything, so take it as a
+ * hint; samples where it points back into the function itself are
+ * left out.
+ *
+ * This runs only on the host. ELF files are read in whichever byte
+ * order their header says; the profile is read as big-endian, as
+ * written on System/161.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+/* The profile format; must match kern/include/prof.h. */
+#define PROF_MAGIC	0x50524f46
+#define PROF_VERSION	1
+#define PS_USER		1
+#define PROF_HEADERWORDS	5
+#define PROF_CPUHEADERWORDS	3
+#define PROF_SAMPLEWORDS	4
+
+/* The little of ELF we need. */
+#define EI_DATA		5
+#define ELFDATA2LSB	1
+#define SHT_SYMTAB	2
+#define SHF_EXECINSTR	0x4
+#define STT_NOTYPE	0
+#define STT_FUNC	2
+#define EHDR_SIZE	52
+#define SHDR_SIZE	40
+#define SYM_SIZE	16
+
+struct sym {
+	uint32_t addr;
+	uint32_t size;
+	const char *name;
+	unsigned count;
+};
+
+struct image {
+	const char *path;
+	struct sym *syms;		/* sorted by address */
+	unsigned nsyms;
+	unsigned unknown;		/* samples matching no symbol */
+};
+
+struct pidmap {
+	uint32_t pid;
+	struct image *image;
+};
+
+struct callsite {
+	struct image *image;
+	int caller;			/* symbol indexes, -1 for "?" */
+	int callee;
+	unsigned count;
+};
+
+static struct image kernimage = { "kernel", NULL, 0, 0 };
+static struct image userimage = { "user", NULL, 0, 0 };
+static struct pidmap *pidmaps;
+static unsigned npidmaps;
+
+static struct callsite *callsites;
+static unsigned ncallsites;
+static unsigned nsamples, nlost;
+
+////////////////////////////////////////////////////////////
+// file access
+
+static
+unsigned char *
+readfile(const char *path, size_t *lenp)
+{
+	FILE *f;
+	unsigned char *buf;
+	long len;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		err(1, "%s", path);
+	}
+	if (fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) < 0) {
+		err(1, "%s", path);
+	}
+	rewind(f);
+	buf = malloc(len > 0 ? len : 1);
+	if (buf == NULL) {
+		err(1, "malloc");
+	}
+	if (fread(buf, 1, len, f) != (size_t)len) {
+		errx(1, "%s: Short read", path);
+	}
+	fclose(f);
+	*lenp = len;
+	return buf;
+}
+
+static
+uint32_t
+get32(const unsigned char *p, bool lsb)
+{
+	if (lsb) {
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static
+uint16_t
+get16(const unsigned char *p, bool lsb)
+{
+	return lsb ? p[0] | (p[1] << 8) : (p[0] << 8) | p[1];
+}
+
+////////////////////////////////////////////////////////////
+// symbol tables
+
+static
+int
+symcmp(const void *av, const void *bv)
+{
+	const struct sym *a = av, *b = bv;
+
+	if (a->addr != b->addr) {
+		return a->addr < b->addr ? -1 : 1;
+	}
+	/* Prefer sized symbols, to keep below. */
+	return (a->size == 0) - (b->size == 0);
+}
+
+/*
+ * Load the function symbols of the ELF file PATH into IMAGE.
+ */
+static
+void
+loadsyms(struct image *image, const char *path)
+{
+	unsigned char *elf, *sh, *symsh, *strsh, *ent, *textsh;
+	size_t len;
+	bool lsb;
+	uint32_t shoff, symoff, symsize, stroff, strsize, namei;
+	unsigned shnum, shentsize, i, n, type, shndx;
+
+	elf = readfile(path, &len);
+	if (len < EHDR_SIZE || memcmp(elf, "\177ELF", 4) != 0) {
+		errx(1, "%s: Not an ELF file", path);
+	}
+	lsb = elf[EI_DATA] == ELFDATA2LSB;
+	shoff = get32(elf + 32, lsb);
+	shentsize = get16(elf + 46, lsb);
+	shnum = get16(elf + 48, lsb);
+	if (shentsize < SHDR_SIZE || shoff + shnum * shentsize > len) {
+		errx(1, "%s: Bad section headers", path);
+	}
+
+	symsh = NULL;
+	for (i=0; i<shnum; i++) {
+		sh = elf + shoff + i * shentsize;
+		if (get32(sh + 4, lsb) == SHT_SYMTAB) {
+			symsh = sh;
+			break;
+		}
+	}
+	if (symsh == NULL) {
+		errx(1, "%s: No symbol table (stripped?)", path);
+	}
+	symoff = get32(symsh + 16, lsb);
+	symsize = get32(symsh + 20, lsb);
+	i = get32(symsh + 24, lsb);		/* sh_link: string table */
+	if (i >= shnum || symoff + symsize > len) {
+		errx(1, "%s: Bad symbol table", path);
+	}
+	strsh = elf + shoff + i * shentsize;
+	stroff = get32(strsh + 16, lsb);
+	strsize = get32(strsh + 20, lsb);
+	if (stroff + strsize > len) {
+		errx(1, "%s: Bad string table", path);
+	}
+
+	image->path = path;
+	image->syms = malloc((symsize / SYM_SIZE + 1) * sizeof(struct sym));
+	if (image->syms == NULL) {
+		err(1, "malloc");
+	}
+	n = 0;
+	for (i=0; i<symsize / SYM_SIZE; i++) {
+		ent = elf + symoff + i * SYM_SIZE;
+		type = ent[12] & 0xf;
+		shndx = get16(ent + 14, lsb);
+		namei = get32(ent, lsb);
+		if (type != STT_FUNC && type != STT_NOTYPE) {
+			continue;
+		}
+		/* Only code: assembler labels in text are NOTYPE. */
+		if (shndx == 0 || shndx >= shnum || namei == 0 ||
+		    namei >= strsize) {
+			continue;
+		}
+		textsh = elf + shoff + shndx * shentsize;
+		if ((get32(textsh + 8, lsb) & SHF_EXECINSTR) == 0) {
+			continue;
+		}
+		image->syms[n].addr = get32(ent + 4, lsb);
+		image->syms[n].size = get32(ent + 8, lsb);
+		image->syms[n].name = (const char *)elf + stroff + namei;
+		image->syms[n].count = 0;
+		n++;
+	}
+	qsort(image->syms, n, sizeof(struct sym), symcmp);
+	image->nsyms = n;
+	/* ELF is left allocated; the names point into it. */
+}
+
+/*
+ * Find the symbol covering ADDR, or -1.
+ */
+static
+int
+lookup(const struct image *image, uint32_t addr)
+{
+	unsigned lo, hi, mid;
+	const struct sym *s;
+
+	lo = 0;
+	hi = image->nsyms;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (image->syms[mid].addr <= addr) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	if (lo == 0) {
+		return -1;
+	}
+	/* Back up over zero-size labels at the same address. */
+	while (lo > 1 && image->syms[lo-2].addr == image->syms[lo-1].addr) {
+		lo--;
+	}
+	s = &image->syms[lo-1];
+	if (s->size != 0 && addr >= s->addr + s->size) {
+		return -1;
+	}
+	return lo - 1;
+}
+
+static
+struct image *
+pidimage(uint32_t pid)
+{
+	unsigned i;
+
+	for (i=0; i<npidmaps; i++) {
+		if (pidmaps[i].pid == pid) {
+			return pidmaps[i].image;
+		}
+	}
+	return &userimage;
+}
+
+////////////////////////////////////////////////////////////
+// reading the profile
+
+static
+void
+addsample(uint32_t pc, uint32_t ra, uint32_t pid, uint32_t flags)
+{
+	struct image *image;
+	struct callsite *cs;
+	int callee, caller;
+
+	image = (flags & PS_USER) ? pidimage(pid) : &kernimage;
+	callee = lookup(image, pc);
+	if (callee < 0) {
+		image->unknown++;
+	}
+	else {
+		image->syms[callee].count++;
+	}
+
+	caller = lookup(image, ra);
+	if (caller != callee || caller < 0) {
+		cs = &callsites[ncallsites++];
+		cs->image = image;
+		cs->caller = caller;
+		cs->callee = callee;
+		cs->count = 1;
+	}
+}
+
+static
+void
+readprofile(const char *path)
+{
+	unsigned char *buf, *p, *end;
+	size_t len;
+	uint32_t ncpus, samplesize, count, lost;
+	unsigned i, j;
+
+	buf = readfile(path, &len);
+	end = buf + len;
+	if (len < PROF_HEADERWORDS * 4 ||
+	    get32(buf, false) != PROF_MAGIC) {
+		errx(1, "%s: Not a profile", path);
+	}
+	if (get32(buf + 4, false) != PROF_VERSION) {
+		errx(1, "%s: Unknown version %u", path, get32(buf + 4, false));
+	}
+	ncpus = get32(buf + 8, false);
+	samplesize = get32(buf + 12, false);
+	if (samplesize < PROF_SAMPLEWORDS * 4) {
+		errx(1, "%s: Bad sample size %u", path, samplesize);
+	}
+	printf("%s: %u cpus, %u samples/sec per cpu\n", path, ncpus,
+	       get32(buf + 16, false));
+
+	/* At most one call site per sample. */
+	callsites = malloc((len / samplesize + 1) * sizeof(*callsites));
+	if (callsites == NULL) {
+		err(1, "malloc");
+	}
+
+	p = buf + PROF_HEADERWORDS * 4;
+	for (i=0; i<ncpus; i++) {
+		if (p + PROF_CPUHEADERWORDS * 4 > end) {
+			errx(1, "%s: Truncated", path);
+		}
+		count = get32(p + 4, false);
+		lost = get32(p + 8, false);
+		p += PROF_CPUHEADERWORDS * 4;
+		if (count > (size_t)(end - p) / samplesize) {
+			errx(1, "%s: Truncated", path);
+		}
+		for (j=0; j<count; j++, p += samplesize) {
+			addsample(get32(p, false), get32(p + 4, false),
+				  get32(p + 8, false), get32(p + 12, false));
+		}
+		nsamples += count;
+		nlost += lost;
+	}
+	free(buf);
+}
+
+////////////////////////////////////////////////////////////
+// printing
+
+struct flatent {
+	const struct image *image;
+	const char *name;
+	unsigned count;
+};
+
+static
+int
+flatcmp(const void *av, const void *bv)
+{
+	const struct flatent *a = av, *b = bv;
+
+	if (a->count != b->count) {
+		return a->count > b->count ? -1 : 1;
+	}
+	return strcmp(a->name, b->name);
+}
+
+static
+double
+pct(unsigned count)
+{
+	return nsamples == 0 ? 0.0 : 100.0 * count / nsamples;
+}
+
+static
+unsigned
+addflat(struct flatent *fe, unsigned n, const struct image *image)
+{
+	unsigned i;
+
+	for (i=0; i<image->nsyms; i++) {
+		if (image->syms[i].count > 0) {
+			fe[n].image = image;
+			fe[n].name = image->syms[i].name;
+			fe[n].count = image->syms[i].count;
+			n++;
+		}
+	}
+	if (image->unknown > 0) {
+		fe[n].image = image;
+		fe[n].name = "?";
+		fe[n].count = image->unknown;
+		n++;
+	}
+	return n;
+}
+
+static
+void
+printflat(unsigned maxlines)
+{
+	struct flatent *fe;
+	unsigned i, n, max;
+
+	max = kernimage.nsyms + userimage.nsyms + 2;
+	for (i=0; i<npidmaps; i++) {
+		max += pidmaps[i].image->nsyms + 1;
+	}
+	fe = malloc(max * sizeof(*fe));
+	if (fe == NULL) {
+		err(1, "malloc");
+	}
+
+	n = addflat(fe, 0, &kernimage);
+	n = addflat(fe, n, &userimage);
+	for (i=0; i<npidmaps; i++) {
+		n = addflat(fe, n, pidmaps[i].image);
+	}
+	qsort(fe, n, sizeof(*fe), flatcmp);
+
+	printf("\n%8s %6s  %s\n", "samples", "%", "function");
+	for (i=0; i<n && i<maxlines; i++) {
+		printf("%8u %6.2f  %s [%s]\n", fe[i].count, pct(fe[i].count),
+		       fe[i].name, fe[i].image->path);
+	}
+	free(fe);
+}
+
+static
+int
+callsitecmp(const void *av, const void *bv)
+{
+	const struct callsite *a = av, *b = bv;
+
+	if (a->image != b->image) {
+		return a->image < b->image ? -1 : 1;
+	}
+	if (a->caller != b->caller) {
+		return a->caller < b->caller ? -1 : 1;
+	}
+	if (a->callee != b->callee) {
+		return a->callee < b->callee ? -1 : 1;
+	}
+	return 0;
+}
+
+static
+const char *
+symname(const struct image *image, int sym)
+{
+	return sym < 0 ? "?" : image->syms[sym].name;
+}
+
+static
+int
+callsitecountcmp(const void *av, const void *bv)
+{
+	const struct callsite *a = av, *b = bv;
+
+	if (a->count != b->count) {
+		return a->count > b->count ? -1 : 1;
+	}
+	return callsitecmp(av, bv);
+}
+
+static
+void
+printcallsites(unsigned maxlines)
+{
+	unsigned i, n;
+
+	/* Sort to bring equal pairs together, and merge them. */
+	qsort(callsites, ncallsites, sizeof(*callsites), callsitecmp);
+	n = 0;
+	for (i=0; i<ncallsites; i++) {
+		if (n > 0 && callsitecmp(&callsites[n-1], &callsites[i]) == 0) {
+			callsites[n-1].count += callsites[i].count;
+		}
+		else {
+			callsites[n++] = callsites[i];
+		}
+	}
+	qsort(callsites, n, sizeof(*callsites), callsitecountcmp);
+
+	printf("\n%8s %6s  %s\n", "samples", "%", "caller -> function");
+	for (i=0; i<n && i<maxlines; i++) {
+		printf("%8u %6.2f  %s -> %s [%s]\n", callsites[i].count,
+		       pct(callsites[i].count),
+		       symname(callsites[i].image, callsites[i].caller),
+		       symname(callsites[i].image, callsites[i].callee),
+		       callsites[i].image->path);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// main
+
+static
+void
+usage(void)
+{
+	errx(1, "Usage: profsym [-c] [-n lines] [-k kernel] [-u prog] "
+	     "[-p pid=prog]... profile");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *profile = NULL;
+	unsigned maxlines = 30;
+	bool docalls = false;
+	struct image *image;
+	char *eq;
+	int i;
+
+	pidmaps = malloc(argc * sizeof(*pidmaps));
+	if (pidmaps == NULL) {
+		err(1, "malloc");
+	}
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-c")) {
+			docalls = true;
+		}
+		else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			maxlines = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-k") && i+1 < argc) {
+			loadsyms(&kernimage, argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-u") && i+1 < argc) {
+			loadsyms(&userimage, argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-p") && i+1 < argc) {
+			eq = strchr(argv[++i], '=');
+			if (eq == NULL) {
+				usage();
+			}
+			*eq = 0;
+			image = malloc(sizeof(*image));
+			if (image == NULL) {
+				err(1, "malloc");
+			}
+			image->unknown = 0;
+			loadsyms(image, eq + 1);
+			pidmaps[npidmaps].pid = atoi(argv[i]);
+			pidmaps[npidmaps].image = image;
+			npidmaps++;
+		}
+		else if (argv[i][0] == '-' || profile != NULL) {
+			usage();
+		}
+		else {
+			profile = argv[i];
+		}
+	}
+	if (profile == NULL) {
+		usage();
+	}
+
+	readprofile(profile);
+	printf("%u samples, %u lost\n", nsamples, nlost);
+	printflat(maxlines);
+	if (docalls) {
+		printcallsites(maxlines);
+	}
+	return 0;
+}
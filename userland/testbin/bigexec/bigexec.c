@@ -32,9 +32,15 @@
  *
  * Checks that argv passing works and is not restricted to an
  * unreasonably small size.
+ *
+ * With -b, instead times fork/exec/wait of the same sizes of argv,
+ * for comparing argv transfer costs between kernels.
  */
 
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -205,6 +211,73 @@ checkmany(int argc, char *argv[], int num, const char *word)
 	return 1;
 }
 
+////////////////////////////////////////////////////////////
+// benchmark
+
+#define BENCH_RUNS 20
+
+/*
+ * Fork and exec ourselves with -x (which exits right away) followed
+ * by NUM copies of WORD, RUNS times, and report the average time per
+ * round trip.
+ */
+static
+void
+benchone(const char *name, int num, const char *word)
+{
+	const char *args[num+3];
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	unsigned long long nsecs;
+	pid_t pid;
+	int i, status;
+
+	args[0] = _PATH_MYSELF;
+	args[1] = "-x";
+	for (i=0; i<num; i++) {
+		args[i+2] = word;
+	}
+	args[num+2] = NULL;
+
+	__time(&startsecs, &startnsecs);
+	for (i=0; i<BENCH_RUNS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execv(_PATH_MYSELF, (char **)args);
+			warn("execv");
+			_exit(1);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "%s: child failed", name);
+		}
+	}
+	__time(&endsecs, &endnsecs);
+
+	nsecs = (endsecs - startsecs) * 1000000000ULL;
+	nsecs += endnsecs;
+	nsecs -= startnsecs;
+	printf("%-24s %6llu us/exec\n", name,
+	       nsecs / BENCH_RUNS / 1000);
+}
+
+static
+void
+bench(void)
+{
+	printf("bigexec: %d runs each\n", BENCH_RUNS);
+	benchone("1 8-letter word", 1, word8);
+	benchone("300 8-letter words", 300, word8);
+	benchone("3850 8-letter words", 3850, word8);
+	benchone("16 4050-letter words", 16, word4050);
+	benchone("4 16320-letter words", 4, word16320);
+}
+
 ////////////////////////////////////////////////////////////
 // test driver
 
@@ -250,6 +323,10 @@ main(int argc, char *argv[])
 	if (argc < 0) {
 		err(1, "argc is negative!?");
 	}
+	if (argc >= 2 && !strcmp(argv[1], "-x")) {
+		/* benchmark child; exit before doing any work */
+		return 0;
+	}
 
 	prepwords();
 	assert(strlen(word8) == 8);
@@ -259,6 +336,11 @@ main(int argc, char *argv[])
 
 	assert(ARG_MAX >= 65536);
 
+	if (argc == 2 && !strcmp(argv[1], "-b")) {
+		bench();
+		return 0;
+	}
+
 	if (argv == NULL || argc == 0 || argc == 1) {
 		/* no args -- start the test */
 		warnx("Starting.");
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fdbench.c
+ *
+ * Check the RLIMIT_NOFILE limit and measure how the file table copes
+ * with lots of open files:
+ *
+ *    1. with the limit lowered, open until EMFILE;
+ *    2. with it raised, open NFILES descriptors (each should be the
+ *       lowest free one);
+ *    3. close every other one and open them again, which should fill
+ *       the holes in order;
+ *    4. fork+exit+waitpid with them all open;
+ *    5. close them all.
+ *
+ *    fdbench [nfiles]      (default 10000)
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+#define SMALLLIMIT 64
+#define FORKS 100
+
+static const char path[] = "null:";
+
+static
+void
+start(time_t *secs, unsigned long *nsecs)
+{
+	__time(secs, nsecs);
+}
+
+/*
+ * Print the elapsed time since START, in total and per operation.
+ */
+static
+void
+report(const char *what, time_t secs0, unsigned long nsecs0, unsigned ops)
+{
+	time_t secs1;
+	unsigned long nsecs1;
+	unsigned long long usecs;
+
+	__time(&secs1, &nsecs1);
+	usecs = (unsigned long long)(secs1 - secs0) * 1000000;
+	usecs += nsecs1 / 1000;
+	usecs -= nsecs0 / 1000;
+	if (ops == 0) {
+		ops = 1;
+	}
+	printf("%-24s %6u ops %10llu us %8llu us/op\n", what, ops,
+	       usecs, usecs / ops);
+}
+
+static
+void
+setlimit(unsigned cur)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+		err(1, "getrlimit");
+	}
+	rl.rlim_cur = cur;
+	if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+		err(1, "setrlimit %u", cur);
+	}
+}
+
+static
+int
+openone(void)
+{
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+	return fd;
+}
+
+/*
+ * Lower the limit and check that open stops there, then put it back.
+ */
+static
+void
+checklimit(void)
+{
+	struct rlimit rl;
+	int fd, lastfd;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+		err(1, "getrlimit");
+	}
+	if (rl.rlim_cur != OPEN_MAX) {
+		warnx("default limit is %llu, not %d",
+		      (unsigned long long)rl.rlim_cur, OPEN_MAX);
+	}
+
+	setlimit(SMALLLIMIT);
+	lastfd = -1;
+	while ((fd = open(path, O_RDONLY)) >= 0) {
+		lastfd = fd;
+	}
+	if (errno != EMFILE) {
+		err(1, "open past the limit");
+	}
+	if (lastfd != SMALLLIMIT - 1) {
+		errx(1, "open stopped at fd %d with limit %d", lastfd,
+		     SMALLLIMIT);
+	}
+	if (dup2(0, SMALLLIMIT) >= 0 || errno != EBADF) {
+		errx(1, "dup2 past the limit didn't fail with EBADF");
+	}
+	for (fd = 3; fd <= lastfd; fd++) {
+		close(fd);
+	}
+	printf("limit of %d enforced\n", SMALLLIMIT);
+}
+
+int
+main(int argc, char *argv[])
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned nfiles = 10000;
+	unsigned i;
+	int *fds;
+	int fd, status;
+	pid_t pid;
+
+	if (argc > 1) {
+		nfiles = atoi(argv[1]);
+	}
+	if (nfiles + 3 > NOFILE_MAX) {
+		errx(1, "at most %d files", NOFILE_MAX - 3);
+	}
+
+	fds = malloc(nfiles * sizeof(int));
+	if (fds == NULL) {
+		err(1, "malloc");
+	}
+
+	checklimit();
+	setlimit(nfiles + 3);
+
+	start(&secs, &nsecs);
+	for (i=0; i<nfiles; i++) {
+		fds[i] = openone();
+		if (fds[i] != (int)i + 3) {
+			errx(1, "open %u: got fd %d", i, fds[i]);
+		}
+	}
+	report("open", secs, nsecs, nfiles);
+
+	start(&secs, &nsecs);
+	for (i=0; i<nfiles; i+=2) {
+		close(fds[i]);
+	}
+	for (i=0; i<nfiles; i+=2) {
+		fd = openone();
+		if (fd != fds[i]) {
+			errx(1, "reopen: got fd %d, not %d", fd, fds[i]);
+		}
+	}
+	report("close+reopen (holes)", secs, nsecs, nfiles);
+
+	start(&secs, &nsecs);
+	for (i=0; i<FORKS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+	}
+	report("fork+exit+waitpid", secs, nsecs, FORKS);
+
+	start(&secs, &nsecs);
+	for (i=0; i<nfiles; i++) {
+		if (close(fds[i]) < 0) {
+			err(1, "close %d", fds[i]);
+		}
+	}
+	report("close", secs, nsecs, nfiles);
+
+	return 0;
+}
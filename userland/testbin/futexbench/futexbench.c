@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futexbench.c
+ *
+ * Compare the cost of semaphore operations done with the futex-based
+ * user-level semaphores in libc (usync.h) against the semfs
+ * semaphores ("sem:") that go through open/read/write.
+ *
+ * Only the uncontended case is timed here, since futex waiters are
+ * per-process and this test doesn't use threads. The futex call
+ * itself is exercised with a short timeout and with a stale value.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <usync.h>
+
+#define LOOPS 2000
+
+static
+void
+start(time_t *secs, unsigned long *nsecs)
+{
+	__time(secs, nsecs);
+}
+
+/*
+ * Print the elapsed time since START, in total and per operation.
+ */
+static
+void
+report(const char *what, time_t secs0, unsigned long nsecs0, unsigned ops)
+{
+	time_t secs1;
+	unsigned long nsecs1;
+	unsigned long long usecs;
+
+	__time(&secs1, &nsecs1);
+	usecs = (unsigned long long)(secs1 - secs0) * 1000000;
+	usecs += nsecs1 / 1000;
+	usecs -= nsecs0 / 1000;
+	printf("%-24s %6u ops %10llu us %8llu ns/op\n", what, ops,
+	       usecs, usecs * 1000 / ops);
+}
+
+static
+void
+bench_usema(void)
+{
+	struct usema sem;
+	time_t secs;
+	unsigned long nsecs;
+	unsigned i;
+
+	usema_init(&sem, 0);
+	start(&secs, &nsecs);
+	for (i=0; i<LOOPS; i++) {
+		usema_V(&sem);
+		usema_P(&sem);
+	}
+	report("usema V+P", secs, nsecs, LOOPS);
+}
+
+static
+void
+bench_umutex(void)
+{
+	struct umutex mx = UMUTEX_INITIALIZER;
+	time_t secs;
+	unsigned long nsecs;
+	unsigned i;
+
+	start(&secs, &nsecs);
+	for (i=0; i<LOOPS; i++) {
+		umutex_lock(&mx);
+		umutex_unlock(&mx);
+	}
+	report("umutex lock+unlock", secs, nsecs, LOOPS);
+}
+
+static
+void
+bench_semfs(void)
+{
+	static const char name[] = "sem:futexbench";
+	time_t secs;
+	unsigned long nsecs;
+	unsigned i;
+	char c = 0;
+	int fd;
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	start(&secs, &nsecs);
+	for (i=0; i<LOOPS; i++) {
+		if (write(fd, &c, 1) != 1) {
+			err(1, "%s: write", name);
+		}
+		if (read(fd, &c, 1) != 1) {
+			err(1, "%s: read", name);
+		}
+	}
+	report("semfs V+P", secs, nsecs, LOOPS);
+	close(fd);
+	(void)remove(name);
+}
+
+/*
+ * Check that the kernel side behaves: waiting with a stale value
+ * returns EAGAIN, a timed wait with nobody to wake it times out, and
+ * a wake with no waiters wakes nobody.
+ */
+static
+void
+check_futex(void)
+{
+	struct timespec ts;
+	int word = 1;
+	int r;
+
+	r = futex(&word, FUTEX_WAIT, 0, NULL);
+	if (r != -1 || errno != EAGAIN) {
+		errx(1, "futex wait on stale value: expected EAGAIN");
+	}
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 50000000;
+	r = futex(&word, FUTEX_WAIT, 1, &ts);
+	if (r != -1 || errno != ETIMEDOUT) {
+		errx(1, "futex timed wait: expected ETIMEDOUT");
+	}
+
+	r = futex(&word, FUTEX_WAKE, 1, NULL);
+	if (r != 0) {
+		errx(1, "futex wake with no waiters returned %d", r);
+	}
+}
+
+int
+main(void)
+{
+	check_futex();
+	bench_umutex();
+	bench_usema();
+	bench_semfs();
+	printf("futexbench done.\n");
+	return 0;
+}
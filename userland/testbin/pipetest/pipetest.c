@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipetest.c
+ *
+ * Test pipes: push a lot of data through one and check it comes out
+ * intact, with EOF when the writer closes; have several processes
+ * write PIPE_BUF-sized records into one pipe at once and check none
+ * got interleaved; and check that writing with no reader fails with
+ * EPIPE. Also reports the throughput of the first test.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+#define BIGSIZE (1024 * 1024)
+#define NKIDS 4
+#define NRECS 64
+
+static char buf[PIPE_BUF * 2];
+
+/*
+ * The byte at position POS of the stream in the bulk test. 251 is
+ * prime, so this doesn't line up with any buffer size.
+ */
+static
+char
+patternbyte(unsigned pos)
+{
+	return (char)(pos % 251);
+}
+
+static
+void
+waitchild(pid_t pid, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s failed", what);
+	}
+}
+
+/*
+ * Read exactly LEN bytes, or fewer at EOF. Returns how many.
+ */
+static
+size_t
+readfull(int fd, char *p, size_t len)
+{
+	size_t got;
+	ssize_t r;
+
+	for (got = 0; got < len; got += r) {
+		r = read(fd, p + got, len - got);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+	}
+	return got;
+}
+
+/*
+ * A child writes BIGSIZE bytes of pattern in odd-sized pieces; the
+ * parent reads and checks them, then expects EOF.
+ */
+static
+void
+bulktest(void)
+{
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	unsigned pos, i, len;
+	int fds[2];
+	pid_t pid;
+	ssize_t r;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	__time(&startsecs, &startnsecs);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (pos = 0; pos < BIGSIZE; pos += len) {
+			len = 1000;
+			if (len > BIGSIZE - pos) {
+				len = BIGSIZE - pos;
+			}
+			for (i = 0; i < len; i++) {
+				buf[i] = patternbyte(pos + i);
+			}
+			r = write(fds[1], buf, len);
+			if (r < 0) {
+				err(1, "child: write");
+			}
+			if ((unsigned)r != len) {
+				errx(1, "child: short write");
+			}
+		}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	pos = 0;
+	while ((r = read(fds[0], buf, sizeof(buf))) > 0) {
+		for (i = 0; i < (unsigned)r; i++) {
+			if (buf[i] != patternbyte(pos + i)) {
+				errx(1, "bad data at %u", pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	if (pos != BIGSIZE) {
+		errx(1, "got %u bytes, expected %u", pos, BIGSIZE);
+	}
+	waitchild(pid, "writer");
+	__time(&endsecs, &endnsecs);
+	close(fds[0]);
+
+	if (endnsecs < startnsecs) {
+		endnsecs += 1000000000;
+		endsecs--;
+	}
+	endnsecs -= startnsecs;
+	endsecs -= startsecs;
+	printf("%u bytes through a pipe in %lu.%03lu seconds\n", pos,
+	       (unsigned long)endsecs, endnsecs / 1000000);
+}
+
+/*
+ * NKIDS children each write NRECS records of PIPE_BUF copies of
+ * their own letter; every PIPE_BUF bytes the parent reads should be
+ * all one letter.
+ */
+static
+void
+atomictest(void)
+{
+	pid_t pids[NKIDS];
+	int counts[NKIDS];
+	int fds[2];
+	int k, i;
+	size_t got;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	for (k = 0; k < NKIDS; k++) {
+		pids[k] = fork();
+		if (pids[k] < 0) {
+			err(1, "fork");
+		}
+		if (pids[k] == 0) {
+			close(fds[0]);
+			memset(buf, 'a' + k, PIPE_BUF);
+			for (i = 0; i < NRECS; i++) {
+				if (write(fds[1], buf, PIPE_BUF) != PIPE_BUF) {
+					err(1, "child %d: write", k);
+				}
+			}
+			_exit(0);
+		}
+		counts[k] = 0;
+	}
+	close(fds[1]);
+
+	while ((got = readfull(fds[0], buf, PIPE_BUF)) > 0) {
+		if (got != PIPE_BUF) {
+			errx(1, "partial record of %u bytes", (unsigned)got);
+		}
+		k = buf[0] - 'a';
+		if (k < 0 || k >= NKIDS) {
+			errx(1, "bad data in record");
+		}
+		for (i = 1; i < PIPE_BUF; i++) {
+			if (buf[i] != buf[0]) {
+				errx(1, "records interleaved");
+			}
+		}
+		counts[k]++;
+	}
+	close(fds[0]);
+
+	for (k = 0; k < NKIDS; k++) {
+		waitchild(pids[k], "writer");
+		if (counts[k] != NRECS) {
+			errx(1, "child %d: got %d records, expected %d",
+			     k, counts[k], NRECS);
+		}
+	}
+	printf("%d writers, %d records each, none interleaved\n",
+	       NKIDS, NRECS);
+}
+
+/*
+ * Writing when the read end is closed fails with EPIPE; reading when
+ * the write end is closed gives EOF.
+ */
+static
+void
+closetest(void)
+{
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	if (write(fds[1], "x", 1) >= 0 || errno != EPIPE) {
+		errx(1, "write with no reader didn't fail with EPIPE");
+	}
+	close(fds[1]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	if (write(fds[1], "xy", 2) != 2) {
+		err(1, "write");
+	}
+	close(fds[1]);
+	if (read(fds[0], buf, sizeof(buf)) != 2) {
+		errx(1, "didn't get back the data written before close");
+	}
+	if (read(fds[0], buf, sizeof(buf)) != 0) {
+		errx(1, "read after writer closed didn't return EOF");
+	}
+	if (lseek(fds[0], 0, SEEK_SET) >= 0 || errno != ESPIPE) {
+		errx(1, "lseek on a pipe didn't fail with ESPIPE");
+	}
+	close(fds[0]);
+}
+
+int
+main(void)
+{
+	bulktest();
+	atomictest();
+	closetest();
+	printf("pipetest: passed\n");
+	return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * prwtest.c
+ *
+ * Test pread and pwrite: several processes sharing one open file
+ * each pwrite their own region of it, without disturbing the seek
+ * position; then the parent checks it all with pread. Then the same
+ * for the vectored calls: a header and payload go out in one writev,
+ * and come back scattered with preadv. Also checks the error cases.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define PATH "prwtest.dat"
+#define NKIDS 4
+#define CHUNK 512
+#define REGION (16 * CHUNK)
+
+static char buf[CHUNK];
+
+/*
+ * Child: fill region K with the letter for K, a chunk at a time, in
+ * reverse order so as not to look like sequential writes.
+ */
+static
+void
+writeregion(int fd, int k)
+{
+	off_t pos;
+	ssize_t r;
+	int i;
+
+	memset(buf, 'a' + k, sizeof(buf));
+	for (i = REGION / CHUNK - 1; i >= 0; i--) {
+		pos = (off_t)k * REGION + i * CHUNK;
+		r = pwrite(fd, buf, CHUNK, pos);
+		if (r < 0) {
+			err(1, "child %d: pwrite at %lld", k, (long long)pos);
+		}
+		if (r != CHUNK) {
+			errx(1, "child %d: short pwrite", k);
+		}
+	}
+}
+
+static
+void
+checkregion(int fd, int k)
+{
+	off_t pos;
+	ssize_t r;
+	int i, j;
+
+	for (i = 0; i < REGION / CHUNK; i++) {
+		pos = (off_t)k * REGION + i * CHUNK;
+		r = pread(fd, buf, CHUNK, pos);
+		if (r < 0) {
+			err(1, "pread at %lld", (long long)pos);
+		}
+		if (r != CHUNK) {
+			errx(1, "short pread at %lld", (long long)pos);
+		}
+		for (j = 0; j < CHUNK; j++) {
+			if (buf[j] != 'a' + k) {
+				errx(1, "bad data at %lld",
+				     (long long)pos + j);
+			}
+		}
+	}
+}
+
+/*
+ * Append a header and a payload with one writev at the seek
+ * position, then read them back into three buffers, split at a
+ * different place, with preadv.
+ */
+static
+void
+checkvectored(int fd)
+{
+	static const char hdr[] = "prwtest header:";
+	char back1[8], back2[CHUNK], back3[sizeof(hdr) - 1];
+	struct iovec iov[3];
+	off_t start;
+	ssize_t r;
+	size_t total;
+
+	start = lseek(fd, 0, SEEK_END);
+	if (start < 0) {
+		err(1, "lseek");
+	}
+
+	memset(buf, 'v', sizeof(buf));
+	iov[0].iov_base = (void *)hdr;
+	iov[0].iov_len = sizeof(hdr) - 1;
+	iov[1].iov_base = buf;
+	iov[1].iov_len = CHUNK;
+	total = iov[0].iov_len + iov[1].iov_len;
+
+	r = writev(fd, iov, 2);
+	if (r < 0) {
+		err(1, "writev");
+	}
+	if ((size_t)r != total) {
+		errx(1, "short writev");
+	}
+	if (lseek(fd, 0, SEEK_CUR) != start + (off_t)total) {
+		errx(1, "writev didn't advance the seek position");
+	}
+
+	/* zero-length segments in the middle are allowed */
+	iov[0].iov_base = back1;
+	iov[0].iov_len = sizeof(back1);
+	iov[1].iov_base = back2;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = back2;
+	iov[2].iov_len = sizeof(back2);
+	r = preadv(fd, iov, 3, start);
+	if (r < 0) {
+		err(1, "preadv");
+	}
+	if ((size_t)r != sizeof(back1) + sizeof(back2)) {
+		errx(1, "short preadv");
+	}
+	if (memcmp(back1, hdr, sizeof(back1)) != 0 ||
+	    memcmp(back2, hdr + sizeof(back1),
+		   sizeof(hdr) - 1 - sizeof(back1)) != 0 ||
+	    back2[sizeof(back2) - 1] != 'v') {
+		errx(1, "preadv returned bad data");
+	}
+
+	/* and a pwritev over the header, checked with readv */
+	iov[0].iov_base = buf;
+	iov[0].iov_len = sizeof(back3);
+	r = pwritev(fd, iov, 1, start);
+	if (r != (ssize_t)sizeof(back3)) {
+		errx(1, "pwritev failed");
+	}
+	if (lseek(fd, start, SEEK_SET) != start) {
+		err(1, "lseek");
+	}
+	iov[0].iov_base = back3;
+	r = readv(fd, iov, 1);
+	if (r != (ssize_t)sizeof(back3)) {
+		errx(1, "readv failed");
+	}
+	if (back3[0] != 'v' || back3[sizeof(back3) - 1] != 'v') {
+		errx(1, "readv returned bad data");
+	}
+
+	/* errors */
+	if (readv(fd, iov, 0) >= 0 || errno != EINVAL) {
+		errx(1, "readv of no segments didn't fail with EINVAL");
+	}
+	if (readv(fd, NULL, 1) >= 0 || errno != EFAULT) {
+		errx(1, "readv from a NULL iovec didn't fail with EFAULT");
+	}
+	printf("vectored I/O checked\n");
+}
+
+int
+main(void)
+{
+	pid_t pids[NKIDS];
+	int fd, k, status;
+	off_t pos;
+
+	fd = open(PATH, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", PATH);
+	}
+
+	/* give the file a seek position pwrite mustn't disturb */
+	if (write(fd, "x", 1) != 1) {
+		err(1, "%s: write", PATH);
+	}
+
+	for (k = 0; k < NKIDS; k++) {
+		pids[k] = fork();
+		if (pids[k] < 0) {
+			err(1, "fork");
+		}
+		if (pids[k] == 0) {
+			writeregion(fd, k);
+			_exit(0);
+		}
+	}
+	for (k = 0; k < NKIDS; k++) {
+		if (waitpid(pids[k], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "child %d failed", k);
+		}
+	}
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos != 1) {
+		errx(1, "seek position moved to %lld", (long long)pos);
+	}
+	for (k = 0; k < NKIDS; k++) {
+		checkregion(fd, k);
+	}
+	printf("%d regions written and checked\n", NKIDS);
+
+	checkvectored(fd);
+
+	/* at and past EOF */
+	pos = lseek(fd, 0, SEEK_END);
+	if (pread(fd, buf, CHUNK, pos) != 0) {
+		errx(1, "pread at EOF didn't return 0");
+	}
+
+	/* errors */
+	if (pread(fd, buf, CHUNK, -1) >= 0 || errno != EINVAL) {
+		errx(1, "pread at negative offset didn't fail with EINVAL");
+	}
+	if (pwrite(STDOUT_FILENO, "x", 1, 0) >= 0 || errno != ESPIPE) {
+		errx(1, "pwrite on the console didn't fail with ESPIPE");
+	}
+	if (pread(-1, buf, CHUNK, 0) >= 0 || errno != EBADF) {
+		errx(1, "pread on a bad fd didn't fail with EBADF");
+	}
+
+	close(fd);
+	remove(PATH);
+	printf("prwtest: passed\n");
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * schedstat.c
+ *
+ * Print the kernel's scheduler latency histograms: how long threads
+ * wait on a run queue before running, and how long they then run.
+ *
+ *    schedstat [-c cpu]                 totals since boot (or reset)
+ *    schedstat [-c cpu] prog [args...]  what running PROG added
+ *
+ * Without -c the histograms of all cpus are added together.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+static
+void
+getstats(int cpu, struct schedstat *ss)
+{
+	if (schedstat(cpu, ss) < 0) {
+		err(1, "schedstat");
+	}
+}
+
+/*
+ * Print the nonempty buckets of two histograms side by side.
+ */
+static
+void
+print(const struct schedstat *ss)
+{
+	unsigned b, lo, hi;
+
+	lo = SCHEDSTAT_BUCKETS;
+	hi = 0;
+	for (b=0; b<SCHEDSTAT_BUCKETS; b++) {
+		if (ss->ss_runqueue[b] != 0 || ss->ss_timeslice[b] != 0) {
+			lo = b < lo ? b : lo;
+			hi = b > hi ? b : hi;
+		}
+	}
+	if (lo > hi) {
+		printf("No context switches.\n");
+		return;
+	}
+
+	printf("%10s %10s %10s\n", "cycles >=", "runqueue", "timeslice");
+	for (b=lo; b<=hi; b++) {
+		printf("%10u %10u %10u\n", b == 0 ? 0 : 1U << b,
+		       ss->ss_runqueue[b], ss->ss_timeslice[b]);
+	}
+}
+
+/*
+ * Run ARGV and wait for it.
+ */
+static
+void
+run(char **argv)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(argv[0], argv);
+		err(1, "%s", argv[0]);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		warnx("%s: signal %d", argv[0], WTERMSIG(status));
+	}
+	else if (WEXITSTATUS(status) != 0) {
+		warnx("%s: exit %d", argv[0], WEXITSTATUS(status));
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct schedstat before, after;
+	int cpu = -1;
+	int i = 1;
+	unsigned b;
+
+	if (argc > 2 && !strcmp(argv[1], "-c")) {
+		cpu = atoi(argv[2]);
+		i = 3;
+	}
+	else if (argc > 1 && argv[1][0] == '-') {
+		errx(1, "Usage: schedstat [-c cpu] [prog [args...]]");
+	}
+
+	getstats(cpu, &before);
+	if (i == argc) {
+		print(&before);
+		return 0;
+	}
+
+	run(&argv[i]);
+	getstats(cpu, &after);
+	for (b=0; b<SCHEDSTAT_BUCKETS; b++) {
+		after.ss_runqueue[b] -= before.ss_runqueue[b];
+		after.ss_timeslice[b] -= before.ss_timeslice[b];
+	}
+	print(&after);
+	return 0;
+}
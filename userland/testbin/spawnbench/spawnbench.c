@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * spawnbench.c
+ *
+ * Measure how fast processes can be created and reaped while many
+ * others are alive, as in forkbomb but under control:
+ *
+ *    1. fork NPROCS children that each block on a semfs semaphore;
+ *    2. with those alive, fork and wait for CHURN short-lived ones;
+ *    3. release the NPROCS children and wait for them all.
+ *
+ * The whole thing is repeated ROUNDS times so that pids get reused.
+ *
+ *    spawnbench [nprocs [rounds]]      (default 1024 and 3)
+ *
+ * If fork fails partway through step 1 (say, out of memory) the
+ * rest goes ahead with however many children were created.
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define CHURN 200
+
+static const char semname[] = "sem:spawnbench";
+static pid_t *pids;
+
+static
+void
+start(time_t *secs, unsigned long *nsecs)
+{
+	__time(secs, nsecs);
+}
+
+/*
+ * Print the elapsed time since START, in total and per operation.
+ */
+static
+void
+report(const char *what, time_t secs0, unsigned long nsecs0, unsigned ops)
+{
+	time_t secs1;
+	unsigned long nsecs1;
+	unsigned long long usecs;
+
+	__time(&secs1, &nsecs1);
+	usecs = (unsigned long long)(secs1 - secs0) * 1000000;
+	usecs += nsecs1 / 1000;
+	usecs -= nsecs0 / 1000;
+	if (ops == 0) {
+		ops = 1;
+	}
+	printf("%-24s %6u ops %10llu us %8llu us/op\n", what, ops,
+	       usecs, usecs / ops);
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid %d", pid);
+	}
+	if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: unexpected exit status 0x%x", pid, status);
+	}
+}
+
+/*
+ * Create up to NPROCS children blocked on the semaphore FD; return
+ * how many there are.
+ */
+static
+unsigned
+spawn(int fd, unsigned nprocs)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned i;
+	pid_t pid;
+
+	start(&secs, &nsecs);
+	for (i=0; i<nprocs; i++) {
+		pid = fork();
+		if (pid < 0) {
+			warn("fork %u", i);
+			break;
+		}
+		if (pid == 0) {
+			if (ioctl(fd, SEMIOC_P, (void *)1) < 0) {
+				_exit(1);
+			}
+			_exit(0);
+		}
+		pids[i] = pid;
+	}
+	report("fork (held)", secs, nsecs, i);
+	return i;
+}
+
+/*
+ * Fork and reap short-lived processes while the held ones are alive.
+ */
+static
+void
+churn(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned i;
+	pid_t pid;
+
+	start(&secs, &nsecs);
+	for (i=0; i<CHURN; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		reap(pid);
+	}
+	report("fork+exit+waitpid", secs, nsecs, CHURN);
+}
+
+static
+void
+release(int fd, unsigned n)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned i;
+
+	start(&secs, &nsecs);
+	if (n > 0 && ioctl(fd, SEMIOC_V, (void *)n) < 0) {
+		err(1, "%s: SEMIOC_V", semname);
+	}
+	for (i=0; i<n; i++) {
+		reap(pids[i]);
+	}
+	report("exit+waitpid (held)", secs, nsecs, n);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned nprocs = 1024, rounds = 3;
+	unsigned i, n;
+	int fd;
+
+	if (argc > 1) {
+		nprocs = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		rounds = atoi(argv[2]);
+	}
+
+	pids = malloc(nprocs * sizeof(pid_t));
+	if (pids == NULL) {
+		err(1, "malloc");
+	}
+
+	fd = open(semname, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", semname);
+	}
+
+	for (i=0; i<rounds; i++) {
+		printf("Round %u: %u processes\n", i, nprocs);
+		n = spawn(fd, nprocs);
+		churn();
+		release(fd, n);
+	}
+
+	close(fd);
+	(void)remove(semname);
+	printf("spawnbench done.\n");
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * usembench.c
+ *
+ * Time semfs ("sem:") semaphore operations done the traditional way,
+ * with read() for P and write() for V, against the same operations
+ * done with the SEMIOC_P and SEMIOC_V ioctls, which skip the uio and
+ * file offset machinery. Also time batched V: one SEMIOC_V of N
+ * units versus N separate ones.
+ *
+ * This is single-process, so nothing ever blocks; it measures the
+ * per-operation overhead.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define LOOPS 2000
+#define BATCH 16
+
+static const char semname[] = "sem:usembench";
+
+static
+void
+report(const char *what, time_t secs0, unsigned long nsecs0, unsigned ops)
+{
+	time_t secs1;
+	unsigned long nsecs1;
+	unsigned long long usecs;
+
+	__time(&secs1, &nsecs1);
+	usecs = (unsigned long long)(secs1 - secs0) * 1000000;
+	usecs += nsecs1 / 1000;
+	usecs -= nsecs0 / 1000;
+	printf("%-24s %6u ops %10llu us %8llu ns/op\n", what, ops,
+	       usecs, usecs * 1000 / ops);
+}
+
+static
+void
+P_rw(int fd)
+{
+	char c;
+
+	if (read(fd, &c, 1) != 1) {
+		err(1, "%s: read", semname);
+	}
+}
+
+static
+void
+V_rw(int fd)
+{
+	char c = 0;
+
+	if (write(fd, &c, 1) != 1) {
+		err(1, "%s: write", semname);
+	}
+}
+
+static
+void
+P_ioctl(int fd, unsigned count)
+{
+	if (ioctl(fd, SEMIOC_P, (void *)(uintptr_t)count) < 0) {
+		err(1, "%s: SEMIOC_P", semname);
+	}
+}
+
+static
+void
+V_ioctl(int fd, unsigned count)
+{
+	if (ioctl(fd, SEMIOC_V, (void *)(uintptr_t)count) < 0) {
+		err(1, "%s: SEMIOC_V", semname);
+	}
+}
+
+int
+main(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned i, j;
+	int fd;
+
+	fd = open(semname, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", semname);
+	}
+
+	__time(&secs, &nsecs);
+	for (i=0; i<LOOPS; i++) {
+		V_rw(fd);
+		P_rw(fd);
+	}
+	report("read/write V+P", secs, nsecs, LOOPS);
+
+	__time(&secs, &nsecs);
+	for (i=0; i<LOOPS; i++) {
+		V_ioctl(fd, 1);
+		P_ioctl(fd, 1);
+	}
+	report("ioctl V+P", secs, nsecs, LOOPS);
+
+	__time(&secs, &nsecs);
+	for (i=0; i<LOOPS/BATCH; i++) {
+		for (j=0; j<BATCH; j++) {
+			V_ioctl(fd, 1);
+		}
+		P_ioctl(fd, BATCH);
+	}
+	report("ioctl V x16, P(16)", secs, nsecs, LOOPS/BATCH);
+
+	__time(&secs, &nsecs);
+	for (i=0; i<LOOPS/BATCH; i++) {
+		V_ioctl(fd, BATCH);
+		P_ioctl(fd, BATCH);
+	}
+	report("ioctl V(16), P(16)", secs, nsecs, LOOPS/BATCH);
+
+	close(fd);
+	(void)remove(semname);
+	printf("usembench done.\n");
+	return 0;
+}
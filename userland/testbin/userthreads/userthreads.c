@@ -38,11 +38,10 @@
  * It also makes various assumptions about the thread API. In
  * particular, it believes (1) that you create a thread by calling
  * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * thread to begin at, (2) that threadjoin() waits for a thread to
+ * finish, since returning from main exits the whole process, and
+ * (3) child threads will exit if they return from the function they
+ * started in.
  *
  * This is also a rather basic test and you'll probably want to write
  * some more of your own.
@@ -51,6 +50,7 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <err.h>
 
 #define NTHREADS  3
 #define MAX       1<<25
@@ -68,15 +68,23 @@ int
 main(int argc, char *argv[])
 {
     int i;
+    int tids[NTHREADS];
 
     (void)argc;
     (void)argv;
 
     for (i=0; i<NTHREADS; i++) {
 	if (i)
-	    threadfork(ThreadRunner);
+	    tids[i] = threadfork(ThreadRunner);
         else
-	    threadfork(BladeRunner);
+	    tids[i] = threadfork(BladeRunner);
+	if (tids[i] < 0)
+	    err(1, "threadfork");
+    }
+
+    for (i=0; i<NTHREADS; i++) {
+	if (threadjoin(tids[i], NULL) < 0)
+	    err(1, "threadjoin");
     }
 
     printf("Parent has left.\n");